@@ -5,25 +5,63 @@ layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec2 in_texcoord;
 layout(location = 2) in vec3 in_normal;
 
+// Only written by the instanced static Vertex Shader, where per draw data comes from the Vertex Shader instead of Push Constants
+layout(location = 3) flat in int in_texture_index;
+layout(location = 4) flat in int in_material_index;
+
 layout(location = 0) out vec4 out_albedo;
 layout(location = 1) out vec4 out_normal_roughness_metallic;
+layout(location = 2) out vec2 out_roughness_metallic; // Only has an attachment in the compact GBuffer layout
+
+// Only enabled for alpha masked Submeshes, discard disables early depth testing
+layout(constant_id = 0) const bool ALPHA_TEST = true;
+
+// In bindless mode all Textures are in a single array and selected using the Push Constant
+// Otherwise the array has a single element and a Descriptor Set is bound per Texture
+layout(constant_id = 1) const int TEXTURE_COUNT = 1;
+
+layout(constant_id = 2) const bool INSTANCED = false;
+
+// The compact layout stores the Normal in a two channel attachment and Roughness + Metallic in a separate one
+layout(constant_id = 3) const bool GBUFFER_COMPACT = false;
 
-layout(binding = 1) uniform sampler2D sampler_diffuse;
+layout(binding = 1) uniform sampler2D textures[TEXTURE_COUNT];
 
-layout(set = 1, binding = 0) uniform MaterialUBO {
+// Offset is sizeof(GBufferPushConstants), the Vertex Shader Push Constants come first
+layout(push_constant) uniform PushConstants {
+	layout(offset = 128) int texture_index;
+	int material_index;
+};
+
+struct Material {
 	float roughness;
 	float metallic;
-} material;
+};
+
+// All Materials of the Scene, indexed by Material id
+layout(set = 1, binding = 0, std430) readonly buffer Materials {
+	Material materials[];
+};
 
 void main() {
-	vec4 diffuse =  texture(sampler_diffuse, in_texcoord);
+	int index = INSTANCED ? in_texture_index : texture_index;
+
+	Material material = materials[INSTANCED ? in_material_index : material_index];
 
-	if (diffuse.a < 0.95f) discard;
+	vec4 diffuse = texture(textures[index], in_texcoord);
+
+	if (ALPHA_TEST && diffuse.a < 0.95f) discard;
 
 	out_albedo = diffuse;
-	out_normal_roughness_metallic = vec4(
-		pack_normal(in_normal),
-		material.roughness,
-		material.metallic
-	);
+
+	if (GBUFFER_COMPACT) {
+		out_normal_roughness_metallic = vec4(pack_normal(in_normal), 0.0f, 0.0f);
+		out_roughness_metallic        = vec2(material.roughness, material.metallic);
+	} else {
+		out_normal_roughness_metallic = vec4(
+			pack_normal(in_normal),
+			material.roughness,
+			material.metallic
+		);
+	}
 }
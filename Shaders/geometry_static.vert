@@ -8,15 +8,52 @@ layout(location = 0) out vec3 out_position;
 layout(location = 1) out vec2 out_texcoord;
 layout(location = 2) out vec3 out_normal;
 
+layout(location = 3) flat out int out_texture_index;
+layout(location = 4) flat out int out_material_index;
+
+layout(location = 5) flat out uint out_draw_index; // Only read in Visibility Buffer mode
+
+// Same layout as GBufferStaticPushConstants
 layout(push_constant, row_major) uniform PushConstants {
+	mat4 view_projection;
+};
+
+struct Instance {
 	mat4 world;
-	mat4 wvp;
+	uint material_index;
+};
+
+layout(set = 2, binding = 0, std430, row_major) readonly buffer Instances {
+	Instance instances[];
+};
+
+// One per drawn Submesh instance, first_instance of each draw is the index of its first Draw
+// Written on the CPU when instancing, or by cull.comp in GPU driven mode
+struct Draw {
+	uint instance_index;
+	uint texture_index;
+	uint first_index;   // Of the Submesh in the shared Geometry Buffers, only used by the Visibility Buffer resolve
+	uint vertex_offset;
+};
+
+layout(set = 2, binding = 1, std430) readonly buffer Draws {
+	Draw draws[];
 };
 
 void main() {
-	gl_Position = wvp * vec4(in_position, 1.0f);
+	Draw     draw     = draws[gl_InstanceIndex];
+	Instance instance = instances[draw.instance_index];
+
+	vec4 world_position = instance.world * vec4(in_position, 1.0f);
 
-	out_position = (world * vec4(in_position, 1.0f)).xyz;
+	gl_Position = view_projection * world_position;
+
+	out_position = world_position.xyz;
 	out_texcoord = in_texcoord;
-	out_normal   = normalize((world * vec4(in_normal, 0.0f)).xyz);
+	out_normal   = normalize((instance.world * vec4(in_normal, 0.0f)).xyz);
+
+	out_texture_index  = int(draw.texture_index);
+	out_material_index = int(instance.material_index);
+
+	out_draw_index = uint(gl_InstanceIndex);
 }
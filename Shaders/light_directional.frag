@@ -9,6 +9,7 @@ layout(location = 0) out vec4 out_colour;
 layout(binding = 0) uniform sampler2D sampler_albedo;
 layout(binding = 1) uniform sampler2D sampler_normal;
 layout(binding = 2) uniform sampler2D sampler_depth;
+layout(binding = 4) uniform sampler2D sampler_material; // Roughness + Metallic, only read in the compact GBuffer layout
 
 layout(binding = 3, row_major) uniform UniformBuffer {
 	DirectionalLight directional_light;
@@ -20,6 +21,9 @@ layout(binding = 3, row_major) uniform UniformBuffer {
 
 layout(set = 1, binding = 0) uniform sampler2D sampler_shadow_map;
 
+// In the compact GBuffer layout Roughness and Metallic are not stored together with the Normal
+layout(constant_id = 1) const bool GBUFFER_COMPACT = false;
+
 void main() {
 	vec3  albedo = texture(sampler_albedo, in_uv).rgb;
 	vec4  packed = texture(sampler_normal, in_uv).rgba;
@@ -45,8 +49,15 @@ void main() {
 
 	Material material;
 	material.albedo = albedo;
-	material.roughness = packed.z;
-	material.metallic  = packed.w;
+	if (GBUFFER_COMPACT) {
+		vec2 roughness_metallic = texture(sampler_material, in_uv).rg;
+
+		material.roughness = roughness_metallic.x;
+		material.metallic  = roughness_metallic.y;
+	} else {
+		material.roughness = packed.z;
+		material.metallic  = packed.w;
+	}
 
 	const float ambient = 0.1f;
 
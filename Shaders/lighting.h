@@ -1,5 +1,8 @@
 const float PI = 3.141592653589793238462643383279502884197169f;
 
+// Size of the PCF kernel is (2 * range + 1)^2, provided as Specialization Constant so that the loop can be unrolled
+layout(constant_id = 0) const int SHADOW_PCF_RANGE = 1;
+
 struct Material {
 	vec3 albedo;
 	float roughness;
@@ -43,7 +46,7 @@ float calc_shadow(sampler2D shadow_map, mat4 light_matrix, vec3 world_position)
 	shadow_map_coords   /= shadow_map_coords.w;
 	shadow_map_coords.xy = shadow_map_coords.xy * 0.5f + 0.5f;
 	
-	const int range = 1;
+	const int range = SHADOW_PCF_RANGE;
 	const int total = (2 * range + 1) * (2 * range + 1); // Normalization factor
 
 	float result = 1.0f;
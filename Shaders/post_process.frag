@@ -4,6 +4,12 @@ layout(location = 0) in vec2 in_uv;
 
 layout(location = 0) out vec4 out_colour;
 
+#define TONEMAP_NONE     0
+#define TONEMAP_REINHARD 1
+#define TONEMAP_ACES     2
+
+layout(constant_id = 0) const int TONEMAP = TONEMAP_ACES;
+
 layout(binding = 0) uniform sampler2D sampler_colour;
 
 vec3 tonemap_reinhard(vec3 colour) {
@@ -24,7 +30,11 @@ vec3 tonemap_aces(vec3 colour) {
 void main() {
 	vec3 colour = texture(sampler_colour, in_uv).rgb;
 
-	colour = tonemap_aces(colour);
+	if (TONEMAP == TONEMAP_REINHARD) {
+		colour = tonemap_reinhard(colour);
+	} else if (TONEMAP == TONEMAP_ACES) {
+		colour = tonemap_aces(colour);
+	}
 
 	out_colour = vec4(colour, 1.0f);
 }
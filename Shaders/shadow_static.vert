@@ -5,9 +5,19 @@ layout(location = 1) in vec2 in_texcoord;
 layout(location = 2) in vec3 in_normal;
 
 layout(push_constant, row_major) uniform PushConstants {
-	mat4 wvp;
+	mat4 light_matrix;
+};
+
+// Same layout as in geometry_static.vert, the Instances of a Mesh batch are contiguous so gl_InstanceIndex indexes them directly
+struct Instance {
+	mat4 world;
+	uint material_index;
+};
+
+layout(set = 0, binding = 0, std430, row_major) readonly buffer Instances {
+	Instance instances[];
 };
 
 void main() {
-	gl_Position = wvp * vec4(in_position, 1.0f);
+	gl_Position = light_matrix * instances[gl_InstanceIndex].world * vec4(in_position, 1.0f);
 }
@@ -0,0 +1,126 @@
+// Scattering model of the Sky and the parameterization of the lookup tables it is precomputed into
+// Based on: https://github.com/SimonWallner/kocmoc-demo/blob/RTVIS/media/shaders/scattering.glsl
+
+// Matches the sizes in SkyLUT.h
+#define TRANSMITTANCE_LUT_SIZE 256
+#define SKY_VIEW_LUT_WIDTH     256
+#define SKY_VIEW_LUT_HEIGHT    128
+
+const float PI = 3.141592653589793238462643383279502884197169f;
+
+const float cutoff_angle = PI / 1.95f;
+const float steepness = 1.5;
+
+const float zenith_length_rayleigh = 8.4e3;
+const float zenith_length_mie      = 1.25e3;
+
+const float sun_intensity = 1000.0f;
+
+const float mie_coefficient   = 0.005f;
+const float mie_directional_g = 0.80f;
+
+const vec3 x_rayleigh = vec3(5.176821E-6f, 1.2785348E-5f, 2.8530756E-5f);
+
+const vec3 up = { 0.0f, 1.0f , 0.0f };
+
+vec3 total_mie() {
+	const vec3 primary_wavelengths = { 680e-9f, 550e-9f, 450e-9f };
+	const vec3 K                   = { 0.686f, 0.678f, 0.666f };
+	const float turbidity = 1.0f;
+
+	const float c = (0.2f * turbidity) * 10e-18f;
+
+	vec3 a = (2.0f * PI) / primary_wavelengths;
+
+	return 0.434f * c * PI * a * a * K;
+}
+
+float phase_rayleigh(float cos_angle_view_sun) {
+	return (3.0f / (16.0f * PI)) * (1.0f + cos_angle_view_sun * cos_angle_view_sun);
+}
+
+float phase_henyey_greenstein(float cos_angle_view_sun, float g) {
+	return (1.0f / (4.0f * PI)) * ((1.0f - g * g) / pow(1.0f - 2.0f * g * cos_angle_view_sun + g * g, 1.5f));
+}
+
+// Extinction along a view ray, only depends on the angle between the ray and the zenith. Rays below the horizon are fully extinct
+vec3 sky_transmittance(float cos_angle_up_view) {
+	if (cos_angle_up_view <= 0.0f) return vec3(0.0f);
+
+	vec3 x_mie = total_mie() * mie_coefficient;
+
+	float optical_length_rayleigh = zenith_length_rayleigh / cos_angle_up_view;
+	float optical_length_mie      = zenith_length_mie      / cos_angle_up_view;
+
+	return exp(-(x_rayleigh * optical_length_rayleigh + x_mie * optical_length_mie));
+}
+
+// Radiance of the Sky in the given direction, extinction_factor is the transmittance along the direction
+vec3 sky_scattering(vec3 direction, vec3 sun_direction, vec3 extinction_factor) {
+	float cos_angle_view_sun = dot(direction, sun_direction);
+	float cos_angle_sun_up   = dot(sun_direction, up);
+
+	vec3 x_mie = total_mie() * mie_coefficient;
+
+	// In-scattering
+	vec3 to_eye_rayleigh = x_rayleigh * phase_rayleigh(cos_angle_view_sun);
+	vec3 to_eye_mie      = x_mie      * phase_henyey_greenstein(cos_angle_view_sun, mie_directional_g);
+
+	vec3 sum_x      = x_rayleigh + x_mie;
+	vec3 sum_to_eye = to_eye_rayleigh + to_eye_mie;
+
+	vec3 sun = sun_intensity * max(0.0f, 1.0f - exp(-((cutoff_angle - acos(cos_angle_sun_up)) / steepness))) * (sum_to_eye / sum_x);
+
+	float t = clamp(pow(1.0f - dot(up, sun_direction), 5.0f), 0.0f, 1.0f);
+
+	vec3 sky = sun * (1.0f - extinction_factor) * mix(vec3(1.0f), sqrt(sun * extinction_factor), t);
+
+	return 0.1f * sky;
+}
+
+// Maps a coordinate in [0, 1] to the centers of the first and last texel, so that both ends are reproduced exactly by linear filtering
+float lut_unit_to_uv(float u, int size) {
+	return (u * float(size - 1) + 0.5f) / float(size);
+}
+
+// The transmittance changes rapidly near the horizon, the square root spends more texels there
+float transmittance_lut_unit_from_cos(float cos_angle_up_view) {
+	return sqrt(max(cos_angle_up_view, 0.0f));
+}
+
+float transmittance_lut_cos_from_unit(float u) {
+	return u * u;
+}
+
+// The Sky is symmetric around the vertical plane through the Sun, so the horizontal axis only covers the absolute azimuth relative to the Sun.
+// The vertical axis is the signed square root of the elevation's sine, which spends more texels near the horizon
+vec2 sky_view_lut_unit_from_direction(vec3 direction, vec3 sun_direction) {
+	vec2 direction_horizontal = direction.xz;
+	vec2 sun_horizontal       = sun_direction.xz;
+
+	// Straight up or a Sun in the zenith make the azimuth meaningless, any value gives the same result then
+	float cos_azimuth = dot(direction_horizontal, sun_horizontal) * inversesqrt(max(dot(direction_horizontal, direction_horizontal) * dot(sun_horizontal, sun_horizontal), 1e-12f));
+
+	float u = acos(clamp(cos_azimuth, -1.0f, 1.0f)) / PI;
+	float v = 0.5f + 0.5f * sign(direction.y) * sqrt(abs(direction.y));
+
+	return vec2(u, v);
+}
+
+vec3 sky_view_lut_direction_from_unit(vec2 unit, vec3 sun_direction) {
+	float s = 2.0f * unit.y - 1.0f;
+
+	float cos_angle_up_view = sign(s) * s * s;
+	float sin_angle_up_view = sqrt(max(1.0f - cos_angle_up_view * cos_angle_up_view, 0.0f));
+
+	vec2 sun_horizontal = sun_direction.xz;
+	float sun_horizontal_length = length(sun_horizontal);
+
+	sun_horizontal = sun_horizontal_length > 1e-6f ? sun_horizontal / sun_horizontal_length : vec2(1.0f, 0.0f);
+
+	float azimuth = unit.x * PI;
+
+	vec2 horizontal = sin_angle_up_view * (cos(azimuth) * sun_horizontal + sin(azimuth) * vec2(-sun_horizontal.y, sun_horizontal.x));
+
+	return vec3(horizontal.x, cos_angle_up_view, horizontal.y);
+}
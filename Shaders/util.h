@@ -6,10 +6,12 @@ vec2 oct_wrap(vec2 v) {
 }
 
 // Based on: https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+// The result is in [0, 1] so it can be stored in UNORM formats. Zero is reserved for the Sky,
+// it is avoided by clamping to the smallest step of a 16 bit UNORM, which would otherwise round to zero
 vec2 pack_normal(vec3 n) {
 	n /= (abs(n.x) + abs(n.y) + abs(n.z));
 	n.xy = n.z >= 0.0f ? n.xy : oct_wrap(n.xy);
-	return n.xy * 0.5f + 0.5f;
+	return max(n.xy * 0.5f + 0.5f, vec2(1.0f / 65535.0f));
 }
 
 // Based on: https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
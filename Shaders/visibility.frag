@@ -0,0 +1,26 @@
+#version 450
+
+layout(location = 1) in vec2 in_texcoord;
+
+layout(location = 3) flat in int  in_texture_index;
+layout(location = 5) flat in uint in_draw_index;
+
+layout(location = 0) out uint out_visibility;
+
+// Only enabled for alpha masked Submeshes, discard disables early depth testing
+layout(constant_id = 0) const bool ALPHA_TEST = true;
+
+// The Visibility Buffer requires bindless, all Textures are in a single array
+layout(constant_id = 1) const int TEXTURE_COUNT = 1;
+
+// Number of low bits that store the triangle, the Draw index + 1 is stored in the remaining bits so that zero means empty
+layout(constant_id = 4) const int TRIANGLE_BITS = 16;
+
+layout(binding = 1) uniform sampler2D textures[TEXTURE_COUNT];
+
+void main() {
+	if (ALPHA_TEST && texture(textures[in_texture_index], in_texcoord).a < 0.95f) discard;
+
+	// gl_PrimitiveID restarts at zero for every instance, so it is the triangle within the Submesh
+	out_visibility = ((in_draw_index + 1u) << TRIANGLE_BITS) | uint(gl_PrimitiveID);
+}
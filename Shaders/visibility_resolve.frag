@@ -0,0 +1,163 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#include "util.h"
+
+layout(location = 0) in vec2 in_uv;
+
+layout(location = 0) out vec4 out_albedo;
+layout(location = 1) out vec4 out_normal_roughness_metallic;
+layout(location = 2) out vec2 out_roughness_metallic; // Only has an attachment in the compact GBuffer layout
+
+layout(constant_id = 1) const int  TEXTURE_COUNT   = 1;
+layout(constant_id = 3) const bool GBUFFER_COMPACT = false;
+layout(constant_id = 4) const int  TRIANGLE_BITS   = 16; // Must match visibility.frag
+
+layout(set = 0, binding = 1) uniform sampler2D textures[TEXTURE_COUNT];
+
+layout(set = 1, binding = 0) uniform usampler2D visibility;
+
+struct Instance {
+	mat4 world;
+	uint material_index;
+};
+
+layout(set = 1, binding = 1, std430, row_major) readonly buffer Instances {
+	Instance instances[];
+};
+
+// Same Draws the Visibility pass was drawn with, indexed by the id in the Visibility Buffer
+struct Draw {
+	uint instance_index;
+	uint texture_index;
+	uint first_index;
+	uint vertex_offset;
+};
+
+layout(set = 1, binding = 2, std430) readonly buffer Draws {
+	Draw draws[];
+};
+
+struct Material {
+	float roughness;
+	float metallic;
+};
+
+layout(set = 1, binding = 3, std430) readonly buffer Materials {
+	Material materials[];
+};
+
+// Same layout as Mesh::Vertex: position xyz, texcoord uv, normal xyz
+layout(set = 1, binding = 4, std430) readonly buffer Vertices {
+	float vertices[];
+};
+
+layout(set = 1, binding = 5, std430) readonly buffer Indices {
+	uint indices[];
+};
+
+layout(push_constant, row_major) uniform PushConstants {
+	mat4 view_projection;
+};
+
+struct Vertex {
+	vec3 position;
+	vec2 texcoord;
+	vec3 normal;
+};
+
+Vertex load_vertex(uint index) {
+	uint offset = index * 8;
+
+	Vertex vertex;
+	vertex.position = vec3(vertices[offset + 0], vertices[offset + 1], vertices[offset + 2]);
+	vertex.texcoord = vec2(vertices[offset + 3], vertices[offset + 4]);
+	vertex.normal   = vec3(vertices[offset + 5], vertices[offset + 6], vertices[offset + 7]);
+
+	return vertex;
+}
+
+// Perspective correct barycentric coordinates of point p in NDC, given the NDC positions and reciprocal clip space w of the triangle's Vertices
+vec3 barycentrics(vec2 p, vec2 a, vec2 b, vec2 c, vec3 inv_w) {
+	vec2 ab = b - a;
+	vec2 ac = c - a;
+	vec2 ap = p - a;
+
+	float inv_area = 1.0f / (ab.x * ac.y - ac.x * ab.y);
+
+	float u = (ap.x * ac.y - ac.x * ap.y) * inv_area;
+	float v = (ab.x * ap.y - ap.x * ab.y) * inv_area;
+
+	vec3 lambda = vec3(1.0f - u - v, u, v) * inv_w;
+
+	return lambda / (lambda.x + lambda.y + lambda.z);
+}
+
+void main() {
+	uint id = texelFetch(visibility, ivec2(gl_FragCoord.xy), 0).r;
+
+	// Nothing was drawn, clear the GBuffer so that the Sky and the Lighting passes see an empty pixel
+	if (id == 0) {
+		out_albedo                    = vec4(0.0f);
+		out_normal_roughness_metallic = vec4(0.0f);
+		out_roughness_metallic        = vec2(0.0f);
+		return;
+	}
+
+	uint draw_index = (id >> TRIANGLE_BITS) - 1u;
+	uint triangle   = id & ((1u << TRIANGLE_BITS) - 1u);
+
+	Draw     draw     = draws[draw_index];
+	Instance instance = instances[draw.instance_index];
+
+	uint first = draw.first_index + 3u * triangle;
+
+	Vertex v0 = load_vertex(draw.vertex_offset + indices[first + 0u]);
+	Vertex v1 = load_vertex(draw.vertex_offset + indices[first + 1u]);
+	Vertex v2 = load_vertex(draw.vertex_offset + indices[first + 2u]);
+
+	// Project the triangle the same way the Visibility pass did
+	mat4 world_view_projection = view_projection * instance.world;
+
+	vec4 clip0 = world_view_projection * vec4(v0.position, 1.0f);
+	vec4 clip1 = world_view_projection * vec4(v1.position, 1.0f);
+	vec4 clip2 = world_view_projection * vec4(v2.position, 1.0f);
+
+	vec3 inv_w = 1.0f / vec3(clip0.w, clip1.w, clip2.w);
+
+	vec2 ndc0 = clip0.xy * inv_w.x;
+	vec2 ndc1 = clip1.xy * inv_w.y;
+	vec2 ndc2 = clip2.xy * inv_w.z;
+
+	// Barycentrics of this pixel and of its right and bottom neighbours, which give the texture coordinate derivatives
+	vec2 pixel_size = 2.0f / vec2(textureSize(visibility, 0));
+	vec2 ndc = in_uv * 2.0f - 1.0f;
+
+	vec3 lambda    = barycentrics(ndc,                             ndc0, ndc1, ndc2, inv_w);
+	vec3 lambda_dx = barycentrics(ndc + vec2(pixel_size.x, 0.0f), ndc0, ndc1, ndc2, inv_w);
+	vec3 lambda_dy = barycentrics(ndc + vec2(0.0f, pixel_size.y), ndc0, ndc1, ndc2, inv_w);
+
+	mat3x2 texcoords = mat3x2(v0.texcoord, v1.texcoord, v2.texcoord);
+
+	vec2 texcoord    = texcoords * lambda;
+	vec2 texcoord_dx = texcoords * lambda_dx - texcoord;
+	vec2 texcoord_dy = texcoords * lambda_dy - texcoord;
+
+	vec3 normal = mat3(v0.normal, v1.normal, v2.normal) * lambda;
+	normal = normalize((instance.world * vec4(normal, 0.0f)).xyz);
+
+	Material material = materials[instance.material_index];
+
+	// Alpha masked pixels were already discarded by the Visibility pass
+	out_albedo = textureGrad(textures[nonuniformEXT(draw.texture_index)], texcoord, texcoord_dx, texcoord_dy);
+
+	if (GBUFFER_COMPACT) {
+		out_normal_roughness_metallic = vec4(pack_normal(normal), 0.0f, 0.0f);
+		out_roughness_metallic        = vec2(material.roughness, material.metallic);
+	} else {
+		out_normal_roughness_metallic = vec4(
+			pack_normal(normal),
+			material.roughness,
+			material.metallic
+		);
+	}
+}
@@ -2,11 +2,33 @@
 #include <algorithm>
 
 #include "Vector3.h"
+#include "Matrix4.h"
 
 struct AABB {
 	Vector3 min;
 	Vector3 max;
 
+	static AABB create_empty() {
+		return { Vector3(INFINITY), Vector3(-INFINITY) };
+	}
+
+	static AABB merge(AABB const & a, AABB const & b) {
+		return { Vector3::min(a.min, b.min), Vector3::max(a.max, b.max) };
+	}
+
+	Vector3 get_center() const { return 0.5f * (min + max); }
+
+	// Bounds of the AABB after transformation, the extent is projected onto the axes of the transformed space
+	AABB transform(Matrix4 const & matrix) const {
+		auto center = 0.5f * (min + max);
+		auto extent = 0.5f * (max - min);
+
+		auto new_center = Matrix4::transform_position (           matrix,  center);
+		auto new_extent = Matrix4::transform_direction(Matrix4::abs(matrix), extent);
+
+		return { new_center - new_extent, new_center + new_extent };
+	}
+
 	bool intersects_ray(Vector3 const & origin, Vector3 const & direction, float max_distance = INFINITY) const {
 		Vector3 inv_direction(
 			1.0f / direction.x,
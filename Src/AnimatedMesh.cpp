@@ -2,6 +2,10 @@
 
 #include "Scene.h"
 
+#include "Math.h"
+
+#include "Profiler.h"
+
 AnimatedMesh::AnimatedMesh(
 	std::vector<Vertex> const & vertices,
 	std::vector<int>    const & indices,
@@ -10,8 +14,9 @@ AnimatedMesh::AnimatedMesh(
 	std::unordered_map<std::string, int> && animation_names,
 	std::vector<Animation>               && animations
 ) :
-	vertex_buffer(Util::vector_size_in_bytes(vertices), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+	vertex_buffer(Util::vector_size_in_bytes(vertices), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
 	index_buffer (Util::vector_size_in_bytes(indices),  VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+	vertex_count(vertices.size()),
 	bones(bones),
 	sub_meshes(sub_meshes),
 	animation_names(animation_names),
@@ -57,9 +62,22 @@ void AnimatedMeshInstance::stop_animation() {
 void AnimatedMeshInstance::update(float delta) {
 	if (current_animation == nullptr) return;
 
+	PROFILE_SCOPE("Animation");
+
 	auto const & mesh = scene.asset_manager.get_animated_mesh(mesh_handle);
 
-	current_time += animation_speed * delta;
+	auto time = current_time + animation_speed * delta;
+
+	// Past either end a non-looping clip holds its first or last KeyFrame, clamping keeps the time from moving while the pose does not
+	if (!loop) time = Math::clamp(time, 0.0f, current_animation->get_length());
+
+	current_time = time;
+
+	// Paused, or held at the end of the clip, bone_transforms are still valid and do not need to be skinned again
+	if (current_animation == posed_animation && current_time == posed_time) return;
+
+	posed_animation = current_animation;
+	posed_time      = current_time;
 
 	for (int i = 0; i < mesh.bones.size(); i++) {
 		auto const & bone = mesh.bones[i];
@@ -83,4 +101,6 @@ void AnimatedMeshInstance::update(float delta) {
 	for (int i = 0; i < mesh.bones.size(); i++) {
 		bone_transforms[i] = bone_transforms[i] * mesh.bones[i].inv_bind_pose;
 	}
+
+	pose_version++;
 }
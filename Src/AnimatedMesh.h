@@ -71,9 +71,11 @@ struct AnimatedMesh {
 		}
 	};
 
-	VulkanMemory::Buffer vertex_buffer;
+	VulkanMemory::Buffer vertex_buffer; // Also read by the skinning Shader
 	VulkanMemory::Buffer index_buffer;
 
+	int vertex_count;
+
 	struct Bone {
 		std::string name;
 
@@ -110,6 +112,7 @@ struct AnimatedMesh {
 	explicit AnimatedMesh(AnimatedMesh && other) noexcept :
 		vertex_buffer(std::move(other.vertex_buffer)),
 		index_buffer (std::move(other.index_buffer)),
+		vertex_count(other.vertex_count),
 		bones     (std::move(other.bones)),
 		sub_meshes(std::move(other.sub_meshes)),
 		animation_names(std::move(other.animation_names)),
@@ -138,6 +141,14 @@ struct AnimatedMeshInstance {
 	float animation_speed = 1.0f;
 
 	std::vector<Matrix4> bone_transforms;
+	u32                  pose_version = 0; // Incremented whenever bone_transforms change, so that paused instances are not skinned again
+
+private:
+	// Animation and time that bone_transforms were last computed for
+	Animation * posed_animation = nullptr;
+	float       posed_time      = 0.0f;
+
+public:
 
 	AnimatedMeshInstance(struct Scene & scene, std::string const & name, AnimatedMeshHandle mesh_handle, Material * material);
 
@@ -2,13 +2,15 @@
 
 #include <cmath>
 
+#include "Math.h"
+
 Vector3 Animation::ChannelPosition::get_position(float time, bool loop) {
 	if (key_frames.size() == 0) return Vector3(0.0f, 0.0f, 0.0f);
 
 	auto total_length = key_frames[key_frames.size() - 1].time;
 
 	if (time >= total_length && loop) {
-		time = std::fmodf(time, total_length);
+		time = std::fmod(time, total_length);
 
 		current_frame = 0;
 	}
@@ -34,7 +36,7 @@ Quaternion Animation::ChannelRotation::get_rotation(float time, bool loop) {
 	auto total_length = key_frames[key_frames.size() - 1].time;
 
 	if (time >= total_length && loop) {
-		time = std::fmodf(time, total_length);
+		time = std::fmod(time, total_length);
 
 		current_frame = 0;
 	}
@@ -53,3 +55,16 @@ Quaternion Animation::ChannelRotation::get_rotation(float time, bool loop) {
 
 	return Quaternion::nlerp(key_frame_curr.rotation, key_frame_next.rotation, t);
 }
+
+float Animation::get_length() const {
+	auto length = 0.0f;
+
+	for (auto const & channel : position_channels) {
+		if (channel.key_frames.size() > 0) length = Math::max(length, channel.key_frames[channel.key_frames.size() - 1].time);
+	}
+	for (auto const & channel : rotation_channels) {
+		if (channel.key_frames.size() > 0) length = Math::max(length, channel.key_frames[channel.key_frames.size() - 1].time);
+	}
+
+	return length;
+}
@@ -29,4 +29,6 @@ struct Animation {
 
 	std::vector<ChannelPosition> position_channels;
 	std::vector<ChannelRotation> rotation_channels;
+
+	float get_length() const; // Time of the last KeyFrame over all Channels
 };
@@ -15,6 +15,8 @@
 #include "VulkanCheck.h"
 #include "VulkanContext.h"
 
+#include "Profiler.h"
+
 AssetManager::~AssetManager() {
 	auto device = VulkanContext::get_device();
 
@@ -35,6 +37,8 @@ MeshHandle AssetManager::load_mesh(std::string const & filename) {
 
 	if (mesh_handle != 0) return mesh_handle - 1;
 
+	PROFILE_SCOPE("Load Mesh");
+
 	std::string path = filename.substr(0, filename.find_last_of("/\\") + 1);
 
 	Assimp::Importer assimp_importer;
@@ -135,6 +139,8 @@ MeshHandle AssetManager::load_mesh(std::string const & filename) {
 
 		if (sub_mesh.texture_handle == -1) sub_mesh.texture_handle = load_texture("Data/bricks.png");
 
+		sub_mesh.alpha_masked = get_texture(sub_mesh.texture_handle).alpha_masked;
+
 		offset_vertex += num_vertices;
 		offset_index  += num_indices;
 	}
@@ -183,6 +189,8 @@ AnimatedMeshHandle AssetManager::load_animated_mesh(std::string const & filename
 
 	if (mesh_handle != 0) return mesh_handle - 1;
 
+	PROFILE_SCOPE("Load Animated Mesh");
+
 	std::string path = filename.substr(0, filename.find_last_of("/\\") + 1);
 
 	Assimp::Importer assimp_importer;
@@ -467,6 +475,8 @@ TextureHandle AssetManager::load_texture(std::string const & filename) {
 
 	if (texture_handle != 0) return texture_handle - 1;
 
+	PROFILE_SCOPE("Load Texture");
+
 	int texture_width;
 	int texture_height;
 	int texture_channels;
@@ -487,10 +497,25 @@ TextureHandle AssetManager::load_texture(std::string const & filename) {
 
 	VulkanMemory::buffer_copy_direct(staging_buffer, pixels, texture_size);
 
+	// Only Textures with texels below the alpha test threshold need the alpha tested Pipeline
+	// Mipmaps average texels, so if no texel is below the threshold no mip level is either
+	// Grey + alpha files are expanded to RGBA as well, so both layouts with an alpha channel are scanned
+	auto alpha_masked = false;
+
+	if (texture_channels == 2 || texture_channels == 4) {
+		for (int i = 0; i < texture_width * texture_height; i++) {
+			if (float(pixels[4*i + 3]) < 0.95f * 255.0f) {
+				alpha_masked = true;
+				break;
+			}
+		}
+	}
+
 	stbi_image_free(pixels);
 
 	texture_handle = textures.size() + 1;
 	auto & texture = textures.emplace_back();
+	texture.alpha_masked = alpha_masked;
 
 	auto mip_levels = 1 + u32(std::log2(std::max(texture_width, texture_height)));
 
@@ -20,6 +20,9 @@ public:
 
 	std::vector<AnimatedMesh>         animated_meshes;
 	std::vector<VulkanMemory::Buffer> storage_buffer_bones;
+	std::vector<VulkanMemory::Buffer> storage_buffer_skinned; // Skinned Vertices of all animated Mesh instances in Mesh::Vertex layout, written by RenderTaskSkinning
+
+	std::vector<VulkanMemory::Buffer> storage_buffer_instances; // Per static Mesh instance transform and Material, in Scene::mesh_batches order
 
 	std::vector<Texture> textures;
 
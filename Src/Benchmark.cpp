@@ -0,0 +1,240 @@
+#include "Benchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+
+#include "Math.h"
+
+void Benchmark::load_camera_path(std::string const & filename) {
+	std::ifstream file(filename);
+
+	if (!file.is_open()) {
+		printf("ERROR: Unable to open Camera path '%s'!\n", filename.c_str());
+		abort();
+	}
+
+	key_frames.clear();
+
+	KeyFrame key_frame = { };
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+
+		// A KeyFrame is complete once its vertical angle has been read
+		if (sscanf(line.c_str(), " camera.position = Vector3(%ff, %ff, %ff);", &key_frame.position.x, &key_frame.position.y, &key_frame.position.z) == 3) continue;
+		if (sscanf(line.c_str(), " camera.angle_x = %ff;", &key_frame.angle_x) == 1) continue;
+		if (sscanf(line.c_str(), " camera.angle_y = %ff;", &key_frame.angle_y) == 1) {
+			key_frames.push_back(key_frame);
+			continue;
+		}
+
+		printf("WARNING: Unable to parse line '%s' in Camera path '%s'!\n", line.c_str(), filename.c_str());
+	}
+
+	if (key_frames.size() == 0) {
+		printf("ERROR: Camera path '%s' contains no KeyFrames!\n", filename.c_str());
+		abort();
+	}
+}
+
+int Benchmark::get_frame_count() const {
+	int frames_per_key_frame = int(std::ceil(key_frame_duration / timestep));
+
+	return warmup_frames + Math::max(1, int(key_frames.size()) - 1) * frames_per_key_frame;
+}
+
+void Benchmark::apply(Camera & camera, int frame) const {
+	// The Camera stays at the first KeyFrame during warmup
+	float time = float(Math::max(0, frame - warmup_frames)) * timestep;
+
+	float t     = time / key_frame_duration;
+	int   index = Math::min(int(t), int(key_frames.size()) - 1);
+
+	auto const & a = key_frames[index];
+	auto const & b = key_frames[Math::min(index + 1, int(key_frames.size()) - 1)];
+
+	float alpha = Math::clamp(t - float(index), 0.0f, 1.0f);
+
+	camera.position = Vector3::lerp(a.position, b.position, alpha);
+	camera.angle_x  = a.angle_x + alpha * (b.angle_x - a.angle_x);
+	camera.angle_y  = a.angle_y + alpha * (b.angle_y - a.angle_y);
+}
+
+Benchmark::Statistics Benchmark::calc_statistics(std::vector<float> samples) {
+	Statistics stats = { };
+
+	if (samples.size() == 0) return stats;
+
+	std::sort(samples.begin(), samples.end());
+
+	// Nearest rank percentile
+	auto percentile = [&](float p) {
+		int rank = int(std::ceil(p * float(samples.size())));
+		return samples[Math::clamp(rank - 1, 0, int(samples.size()) - 1)];
+	};
+
+	double sum = 0.0;
+	for (auto sample : samples) sum += sample;
+
+	stats.mean = float(sum / double(samples.size()));
+	stats.min  = samples.front();
+	stats.max  = samples.back();
+	stats.p50 = percentile(0.50f);
+	stats.p95 = percentile(0.95f);
+	stats.p99 = percentile(0.99f);
+
+	return stats;
+}
+
+static void write_statistics(FILE * file, char const * name, std::vector<float> const & samples, bool last) {
+	auto stats = Benchmark::calc_statistics(samples);
+
+	fprintf(file, "\t\t\"%s\": {\n", name);
+	fprintf(file, "\t\t\t\"mean\": %.4f, \"min\": %.4f, \"max\": %.4f,\n", stats.mean, stats.min, stats.max);
+	fprintf(file, "\t\t\t\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f,\n", stats.p50, stats.p95, stats.p99);
+	fprintf(file, "\t\t\t\"samples\": [");
+
+	for (int i = 0; i < samples.size(); i++) {
+		fprintf(file, i == 0 ? "%.4f" : ", %.4f", samples[i]);
+	}
+
+	fprintf(file, "]\n\t\t}%s\n", last ? "" : ",");
+}
+
+void Benchmark::write_report(std::string const & filename, Info const & info, std::vector<float> const & cpu_times, std::vector<GPUProfiler::FrameResult> const & gpu_timings) const {
+	// Gather samples of all Frames after warmup, GPU timings are matched to CPU timings by Frame index
+	std::vector<float> samples_cpu;
+	std::vector<float> samples_gpu;
+
+	std::vector<char const *>       pass_names;
+	std::vector<std::vector<float>> samples_passes;
+
+	for (auto const & gpu : gpu_timings) {
+		if (gpu.frame < warmup_frames || gpu.frame >= cpu_times.size()) continue;
+
+		samples_cpu.push_back(cpu_times[gpu.frame]);
+		samples_gpu.push_back(gpu.total_ms);
+
+		for (auto const & pass : gpu.passes) {
+			auto index = std::find_if(pass_names.begin(), pass_names.end(), [&](char const * name) { return strcmp(name, pass.name) == 0; }) - pass_names.begin();
+
+			if (index == pass_names.size()) {
+				pass_names.push_back(pass.name);
+				samples_passes.emplace_back();
+			}
+
+			samples_passes[index].push_back(pass.time_ms);
+		}
+	}
+
+	FILE * file = fopen(filename.c_str(), "wb");
+	if (file == nullptr) {
+		printf("ERROR: Unable to open '%s' for writing!\n", filename.c_str());
+		abort();
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"scene\": \"%s\",\n", info.scene.c_str());
+	fprintf(file, "\t\"width\": %u,\n",  info.width);
+	fprintf(file, "\t\"height\": %u,\n", info.height);
+	fprintf(file, "\t\"seed\": %u,\n",   info.seed);
+	fprintf(file, "\t\"gbuffer_layout\": \"%s\",\n", info.gbuffer_layout.c_str());
+	fprintf(file, "\t\"gbuffer_bytes_per_pixel\": %u,\n", info.gbuffer_bytes_per_pixel);
+	fprintf(file, "\t\"timestep\": %f,\n", timestep);
+	fprintf(file, "\t\"warmup_frames\": %i,\n", warmup_frames);
+	fprintf(file, "\t\"frames\": %zu,\n", samples_cpu.size());
+	fprintf(file, "\t\"unit\": \"ms\",\n");
+
+	fprintf(file, "\t\"frame\": {\n");
+	write_statistics(file, "cpu", samples_cpu, false);
+	write_statistics(file, "gpu", samples_gpu, true);
+	fprintf(file, "\t},\n");
+
+	fprintf(file, "\t\"passes\": {\n");
+	for (int i = 0; i < pass_names.size(); i++) {
+		write_statistics(file, pass_names[i], samples_passes[i], i == pass_names.size() - 1);
+	}
+	fprintf(file, "\t}\n");
+
+	fprintf(file, "}\n");
+	fclose(file);
+
+	auto stats_cpu = calc_statistics(samples_cpu);
+	auto stats_gpu = calc_statistics(samples_gpu);
+
+	printf("Benchmark '%s' %ux%u, %s GBuffer layout (%u bytes/pixel), %zu frames:\n", info.scene.c_str(), info.width, info.height, info.gbuffer_layout.c_str(), info.gbuffer_bytes_per_pixel, samples_cpu.size());
+	printf("      %8s %8s %8s\n", "p50", "p95", "p99");
+	printf("CPU:  %8.3f %8.3f %8.3f\n", stats_cpu.p50, stats_cpu.p95, stats_cpu.p99);
+	printf("GPU:  %8.3f %8.3f %8.3f\n", stats_gpu.p50, stats_gpu.p95, stats_gpu.p99);
+	printf("Written report to '%s'\n", filename.c_str());
+}
+
+void Benchmark::run_culling(int object_count, int iterations) {
+	// Objects are scattered around a Camera at the origin, so that a fraction of them is visible
+	constexpr float SCENE_SIZE = 500.0f;
+
+	Frustum frustum;
+	frustum.from_matrix(Matrix4::perspective(DEG_TO_RAD(70.0f), 16.0f / 9.0f, 0.1f, 250.0f));
+
+	std::mt19937 rng(1337);
+	auto rand_float = [&rng](float min, float max) { return min + (max - min) * float(rng()) / float(std::mt19937::max()); };
+
+	Frustum::AABBsSoA   aabbs;
+	Frustum::SpheresSoA spheres;
+
+	for (int i = 0; i < object_count; i++) {
+		Vector3 center(rand_float(-SCENE_SIZE, SCENE_SIZE), rand_float(-SCENE_SIZE, SCENE_SIZE), rand_float(-SCENE_SIZE, SCENE_SIZE));
+		Vector3 extent(rand_float(0.1f, 10.0f), rand_float(0.1f, 10.0f), rand_float(0.1f, 10.0f));
+
+		aabbs  .add(center, extent);
+		spheres.add(center, Vector3::length(extent));
+	}
+
+	std::vector<u64> visible;
+
+	auto count_visible = [&]() {
+		int count = 0;
+		for (int i = 0; i < object_count; i++) count += Frustum::is_visible(visible, i);
+		return count;
+	};
+
+	// Runs the culling function once to warm the caches, then reports the throughput of the best iteration
+	auto measure = [&](auto && cull) {
+		cull();
+
+		double best = INFINITY;
+		for (int i = 0; i < iterations; i++) {
+			auto time_start = std::chrono::high_resolution_clock::now();
+			cull();
+			best = Math::min(best, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - time_start).count());
+		}
+
+		return double(object_count) / best;
+	};
+
+	static constexpr char const * LEVEL_NAMES[] = { "Scalar", "SSE", "AVX2", "AVX-512" };
+
+	auto simd_level_detected = Frustum::detect_simd_level();
+
+	printf("Batch Frustum culling of %i objects, best of %i iterations:\n", object_count, iterations);
+	printf("         %16s %16s %10s\n", "AABBs/s", "Spheres/s", "Visible");
+
+	for (int level = 0; level <= int(simd_level_detected); level++) {
+		Frustum::simd_level = Frustum::SIMDLevel(level);
+
+		auto throughput_aabbs   = measure([&]() { frustum.cull_aabbs  (aabbs,   visible); });
+		auto visible_aabbs = count_visible();
+
+		auto throughput_spheres = measure([&]() { frustum.cull_spheres(spheres, visible); });
+
+		printf("%-8s %16.0f %16.0f %10i\n", LEVEL_NAMES[level], throughput_aabbs, throughput_spheres, visible_aabbs);
+	}
+
+	Frustum::simd_level = simd_level_detected;
+}
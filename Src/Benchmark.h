@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <string>
+
+#include "Camera.h"
+#include "GPUProfiler.h"
+
+// Replays a recorded Camera path using a fixed timestep, so that runs on the same machine are comparable
+struct Benchmark {
+	// Keyframes use the same format as the debug output of Camera::update (press F)
+	struct KeyFrame {
+		Vector3 position;
+		float   angle_x;
+		float   angle_y;
+	};
+	std::vector<KeyFrame> key_frames;
+
+	float timestep           = 1.0f / 60.0f;
+	float key_frame_duration = 2.0f; // Seconds to travel between two consecutive KeyFrames
+
+	int warmup_frames = 10; // These Frames are rendered but excluded from the statistics
+
+	void load_camera_path(std::string const & filename);
+
+	int get_frame_count() const; // Number of Frames needed to play back the entire path
+
+	void apply(Camera & camera, int frame) const;
+
+	struct Statistics {
+		float mean;
+		float min;
+		float max;
+
+		float p50;
+		float p95;
+		float p99;
+	};
+	static Statistics calc_statistics(std::vector<float> samples);
+
+	struct Info {
+		std::string scene;
+		u32         seed;
+
+		u32 width;
+		u32 height;
+
+		std::string gbuffer_layout;
+		u32         gbuffer_bytes_per_pixel; // Excluding depth
+	};
+	void write_report(std::string const & filename, Info const & info, std::vector<float> const & cpu_times, std::vector<GPUProfiler::FrameResult> const & gpu_timings) const;
+
+	// Microbenchmark of the batch Frustum culling functions, prints objects per second for every SIMD level the CPU supports
+	static void run_culling(int object_count, int iterations);
+};
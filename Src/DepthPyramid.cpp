@@ -0,0 +1,216 @@
+#include "DepthPyramid.h"
+
+#include "VulkanCheck.h"
+#include "VulkanContext.h"
+#include "VulkanMemory.h"
+
+#include "Math.h"
+#include "Util.h"
+
+struct DepthPyramidPushConstants {
+	alignas(4) int input_width;
+	alignas(4) int input_height;
+	alignas(4) int output_width;
+	alignas(4) int output_height;
+};
+
+static constexpr VkFormat DEPTH_PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+
+static constexpr int DEPTH_PYRAMID_GROUP_SIZE = 8; // Matches local_size in depth_pyramid.comp
+
+void DepthPyramid::init(DescriptorAllocator & descriptor_allocator, int depth_width, int depth_height, VkImageView depth_view) {
+	auto device = VulkanContext::get_device();
+
+	// Create Descriptor Set Layout
+	VkDescriptorSetLayoutBinding layout_bindings[2] = { };
+	layout_bindings[0].binding = 0;
+	layout_bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layout_bindings[0].descriptorCount = 1;
+	layout_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	layout_bindings[1].binding = 1;
+	layout_bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	layout_bindings[1].descriptorCount = 1;
+	layout_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layout_create_info.bindingCount = Util::array_element_count(layout_bindings);
+	layout_create_info.pBindings    = layout_bindings;
+
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layout));
+
+	// Create Pipeline
+	VulkanContext::PipelineLayoutDetails pipeline_layout_details;
+	pipeline_layout_details.descriptor_set_layouts = { descriptor_set_layout };
+	pipeline_layout_details.push_constants = { { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstants) } };
+
+	pipeline_layout = VulkanContext::create_pipeline_layout(pipeline_layout_details);
+
+	VulkanContext::PipelineDetails pipeline_details;
+	pipeline_details.shaders = { { "Shaders/depth_pyramid.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT } };
+	pipeline_details.pipeline_layout = pipeline_layout;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipeline);
+
+	// Create Sampler, the Shaders only use texelFetch so filtering is irrelevant
+	VkSamplerCreateInfo sampler_create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	sampler_create_info.magFilter = VK_FILTER_NEAREST;
+	sampler_create_info.minFilter = VK_FILTER_NEAREST;
+	sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.mipLodBias = 0.0f;
+	sampler_create_info.maxAnisotropy = 1.0f;
+	sampler_create_info.minLod = 0.0f;
+	sampler_create_info.maxLod = float(MAX_MIP_COUNT);
+	sampler_create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+
+	VK_CHECK(vkCreateSampler(device, &sampler_create_info, nullptr, &sampler));
+
+	// The number of levels depends on the size, allocate enough Descriptor Sets for the largest possible Pyramid
+	for (int i = 0; i < MAX_MIP_COUNT; i++) {
+		descriptor_sets[i] = descriptor_allocator.allocate(descriptor_set_layout);
+	}
+
+	this->depth_width  = depth_width;
+	this->depth_height = depth_height;
+
+	image_create(depth_view);
+}
+
+void DepthPyramid::free() {
+	auto device = VulkanContext::get_device();
+
+	image_destroy();
+
+	vkDestroySampler(device, sampler, nullptr);
+
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
+	vkDestroyPipelineLayout     (device, pipeline_layout,       nullptr);
+
+	VulkanContext::destroy_pipeline(pipeline);
+}
+
+void DepthPyramid::resize(int depth_width, int depth_height, VkImageView depth_view) {
+	this->depth_width  = depth_width;
+	this->depth_height = depth_height;
+
+	image_destroy();
+	image_create(depth_view);
+}
+
+void DepthPyramid::image_create(VkImageView depth_view) {
+	width  = Math::max(depth_width  / 2, 1);
+	height = Math::max(depth_height / 2, 1);
+
+	mip_count = 1;
+	while ((Math::max(width, height) >> mip_count) > 0) mip_count++;
+
+	mip_count = Math::min(mip_count, MAX_MIP_COUNT);
+
+	VulkanMemory::create_image(width, height, mip_count, DEPTH_PYRAMID_FORMAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		image, memory
+	);
+
+	// The Pyramid stays in the general layout, it is both written as storage Image and sampled
+	VulkanMemory::transition_image_layout(image, mip_count, DEPTH_PYRAMID_FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	image_view = VulkanMemory::create_image_view(image, mip_count, DEPTH_PYRAMID_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	for (int i = 0; i < mip_count; i++) {
+		mip_views[i] = VulkanMemory::create_image_view(image, 1, DEPTH_PYRAMID_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, i);
+	}
+
+	// Update Descriptor Sets
+	struct {
+		VkDescriptorImageInfo input;
+		VkDescriptorImageInfo output;
+	} descriptors;
+
+	DescriptorUpdateTemplate update_template;
+	update_template.init(descriptor_set_layout, {
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(decltype(descriptors), input) },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          offsetof(decltype(descriptors), output) }
+	});
+
+	for (int i = 0; i < mip_count; i++) {
+		if (i == 0) {
+			descriptors.input = { sampler, depth_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		} else {
+			descriptors.input = { sampler, mip_views[i - 1], VK_IMAGE_LAYOUT_GENERAL };
+		}
+		descriptors.output = { VK_NULL_HANDLE, mip_views[i], VK_IMAGE_LAYOUT_GENERAL };
+
+		update_template.update(descriptor_sets[i], &descriptors);
+	}
+
+	update_template.free();
+}
+
+void DepthPyramid::image_destroy() {
+	auto device = VulkanContext::get_device();
+
+	for (int i = 0; i < mip_count; i++) {
+		vkDestroyImageView(device, mip_views[i], nullptr);
+	}
+	vkDestroyImageView(device, image_view, nullptr);
+
+	vkDestroyImage(device, image,  nullptr);
+	vkFreeMemory  (device, memory, nullptr);
+}
+
+void DepthPyramid::build(VkCommandBuffer command_buffer) {
+	// The previous Frame's cull may still be sampling the Pyramid
+	VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount   = mip_count;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount     = 1;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+	auto input_width  = depth_width;
+	auto input_height = depth_height;
+
+	for (int i = 0; i < mip_count; i++) {
+		DepthPyramidPushConstants push_constants = { };
+		push_constants.input_width   = input_width;
+		push_constants.input_height  = input_height;
+		push_constants.output_width  = Math::max(width  >> i, 1);
+		push_constants.output_height = Math::max(height >> i, 1);
+
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[i], 0, nullptr);
+		vkCmdPushConstants     (command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstants), &push_constants);
+
+		vkCmdDispatch(command_buffer,
+			(push_constants.output_width  + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+			(push_constants.output_height + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+			1
+		);
+
+		// The next level (or the cull Shader) reads this level
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.subresourceRange.baseMipLevel = i;
+		barrier.subresourceRange.levelCount   = 1;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		input_width  = push_constants.output_width;
+		input_height = push_constants.output_height;
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.h"
+
+// Hierarchical depth buffer used for occlusion culling
+// Every texel stores the farthest depth of the region it covers in the level above, level 0 is half the size of the depth buffer
+struct DepthPyramid {
+	static constexpr int MAX_MIP_COUNT = 16;
+
+	VkImage        image;
+	VkDeviceMemory memory;
+	VkImageView    image_view; // All levels, sampled by the cull Shader
+	VkSampler      sampler;
+
+	int width;
+	int height;
+	int mip_count;
+
+private:
+	int depth_width;
+	int depth_height;
+
+	VkImageView mip_views[MAX_MIP_COUNT];
+
+	VkDescriptorSetLayout descriptor_set_layout;
+	VkPipelineLayout      pipeline_layout;
+	VkPipeline            pipeline;
+
+	// One per level, reads the previous level (or the depth buffer for level 0) and writes the current one
+	VkDescriptorSet descriptor_sets[MAX_MIP_COUNT];
+
+	void image_create(VkImageView depth_view);
+	void image_destroy();
+
+public:
+	void init(DescriptorAllocator & descriptor_allocator, int depth_width, int depth_height, VkImageView depth_view);
+	void free();
+
+	void resize(int depth_width, int depth_height, VkImageView depth_view); // Only recreates size dependent resources
+
+	// Downsamples the depth buffer into all levels, the depth buffer must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	void build(VkCommandBuffer command_buffer);
+};
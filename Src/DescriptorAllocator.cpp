@@ -0,0 +1,134 @@
+#include "DescriptorAllocator.h"
+
+#include "VulkanCheck.h"
+#include "VulkanContext.h"
+
+#include "Util.h"
+
+// Number of Descriptors per Set of each type, Pools are sized using these ratios
+static constexpr struct {
+	VkDescriptorType type;
+	float            ratio;
+} POOL_RATIOS[] = {
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         2.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          1.0f }
+};
+
+void DescriptorAllocator::init(u32 sets_per_pool) {
+	this->sets_per_pool = sets_per_pool;
+
+	pool_current = VK_NULL_HANDLE;
+}
+
+void DescriptorAllocator::free() {
+	auto device = VulkanContext::get_device();
+
+	for (auto pool : pools_used) vkDestroyDescriptorPool(device, pool, nullptr);
+	for (auto pool : pools_free) vkDestroyDescriptorPool(device, pool, nullptr);
+
+	pools_used.clear();
+	pools_free.clear();
+
+	pool_current = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::pool_acquire() {
+	VkDescriptorPool pool;
+
+	if (pools_free.size() > 0) {
+		pool = pools_free.back();
+		pools_free.pop_back();
+	} else {
+		VkDescriptorPoolSize pool_sizes[Util::array_element_count(POOL_RATIOS)];
+
+		for (int i = 0; i < Util::array_element_count(POOL_RATIOS); i++) {
+			pool_sizes[i].type            = POOL_RATIOS[i].type;
+			pool_sizes[i].descriptorCount = u32(POOL_RATIOS[i].ratio * float(sets_per_pool));
+		}
+
+		VkDescriptorPoolCreateInfo pool_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		pool_create_info.poolSizeCount = Util::array_element_count(pool_sizes);
+		pool_create_info.pPoolSizes    = pool_sizes;
+		pool_create_info.maxSets = sets_per_pool;
+
+		VK_CHECK(vkCreateDescriptorPool(VulkanContext::get_device(), &pool_create_info, nullptr, &pool));
+	}
+
+	pools_used.push_back(pool);
+
+	return pool;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+	if (pool_current == VK_NULL_HANDLE) pool_current = pool_acquire();
+
+	VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	alloc_info.descriptorPool = pool_current;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts        = &layout;
+
+	VkDescriptorSet descriptor_set;
+
+	auto result = vkAllocateDescriptorSets(VulkanContext::get_device(), &alloc_info, &descriptor_set);
+
+	// If the current Pool is exhausted, continue with a new one
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+		pool_current = pool_acquire();
+
+		alloc_info.descriptorPool = pool_current;
+		result = vkAllocateDescriptorSets(VulkanContext::get_device(), &alloc_info, &descriptor_set);
+	}
+
+	VK_CHECK(result);
+
+	return descriptor_set;
+}
+
+void DescriptorAllocator::reset() {
+	auto device = VulkanContext::get_device();
+
+	for (auto pool : pools_used) {
+		VK_CHECK(vkResetDescriptorPool(device, pool, 0));
+		pools_free.push_back(pool);
+	}
+	pools_used.clear();
+
+	pool_current = VK_NULL_HANDLE;
+}
+
+void DescriptorUpdateTemplate::init(VkDescriptorSetLayout layout, std::vector<Entry> const & entries) {
+	std::vector<VkDescriptorUpdateTemplateEntry> template_entries(entries.size());
+
+	for (int i = 0; i < entries.size(); i++) {
+		bool is_image =
+			entries[i].type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			entries[i].type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+			entries[i].type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+		template_entries[i].dstBinding      = entries[i].binding;
+		template_entries[i].dstArrayElement = 0;
+		template_entries[i].descriptorCount = 1;
+		template_entries[i].descriptorType  = entries[i].type;
+		template_entries[i].offset = entries[i].offset;
+		template_entries[i].stride = is_image ? sizeof(VkDescriptorImageInfo) : sizeof(VkDescriptorBufferInfo);
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo template_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO };
+	template_create_info.descriptorUpdateEntryCount = template_entries.size();
+	template_create_info.pDescriptorUpdateEntries   = template_entries.data();
+	template_create_info.templateType        = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	template_create_info.descriptorSetLayout = layout;
+
+	VK_CHECK(vkCreateDescriptorUpdateTemplate(VulkanContext::get_device(), &template_create_info, nullptr, &update_template));
+}
+
+void DescriptorUpdateTemplate::free() {
+	vkDestroyDescriptorUpdateTemplate(VulkanContext::get_device(), update_template, nullptr);
+}
+
+void DescriptorUpdateTemplate::update(VkDescriptorSet descriptor_set, void const * data) const {
+	vkUpdateDescriptorSetWithTemplate(VulkanContext::get_device(), descriptor_set, update_template, data);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Allocates Descriptor Sets from a chain of Descriptor Pools, a new Pool is created whenever the current one runs out
+// Long-lived and per-frame transient Sets should use separate allocators, transient allocators are reset in bulk
+struct DescriptorAllocator {
+private:
+	u32 sets_per_pool;
+
+	VkDescriptorPool pool_current = VK_NULL_HANDLE;
+
+	std::vector<VkDescriptorPool> pools_used;
+	std::vector<VkDescriptorPool> pools_free; // Pools that have been reset and can be reused
+
+	VkDescriptorPool pool_acquire();
+
+public:
+	void init(u32 sets_per_pool = 256);
+	void free();
+
+	[[nodiscard]] VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+	void reset(); // Returns all Sets allocated so far to their Pools at once, the Pools are kept for reuse
+};
+
+// Writes all Descriptors of a Set from a single struct in CPU memory, instead of filling a VkWriteDescriptorSet per binding
+struct DescriptorUpdateTemplate {
+	struct Entry {
+		u32              binding;
+		VkDescriptorType type;
+		size_t           offset; // Offset of the VkDescriptorImageInfo or VkDescriptorBufferInfo in the data
+	};
+
+private:
+	VkDescriptorUpdateTemplate update_template;
+
+public:
+	void init(VkDescriptorSetLayout layout, std::vector<Entry> const & entries);
+	void free();
+
+	void update(VkDescriptorSet descriptor_set, void const * data) const;
+};
@@ -0,0 +1,63 @@
+#include "DrawList.h"
+
+#include <string.h>
+
+#include "Math.h"
+#include "Profiler.h"
+
+u64 DrawList::make_key(u32 pipeline, u32 texture, u32 mesh, float depth) {
+	// Non-negative floats order the same as their bit patterns, the sign bit is always zero so the top 24 of the remaining 31 bits are kept
+	depth = Math::max(depth, 0.0f);
+
+	u32 depth_bits;
+	memcpy(&depth_bits, &depth, sizeof(float));
+
+	return
+		u64(pipeline & 0xf)     << 60 |
+		u64(texture  & 0xffff)  << 44 |
+		u64(mesh     & 0xfffff) << 24 |
+		u64(depth_bits >> 7);
+}
+
+void DrawList::sort() {
+	PROFILE_SCOPE("DrawList::sort");
+
+	constexpr int DIGIT_BITS   = 8;
+	constexpr int DIGIT_COUNT  = 64 / DIGIT_BITS;
+	constexpr int BUCKET_COUNT = 1 << DIGIT_BITS;
+
+	if (packets.size() <= 1) return;
+
+	// Histograms of all digits are built in a single pass over the keys
+	u32 histograms[DIGIT_COUNT][BUCKET_COUNT] = { };
+
+	for (auto const & packet : packets) {
+		for (int d = 0; d < DIGIT_COUNT; d++) {
+			histograms[d][(packet.key >> (d * DIGIT_BITS)) & (BUCKET_COUNT - 1)]++;
+		}
+	}
+
+	packets_tmp.resize(packets.size());
+
+	for (int d = 0; d < DIGIT_COUNT; d++) {
+		auto shift = d * DIGIT_BITS;
+		auto & histogram = histograms[d];
+
+		// If all keys share this digit the pass would not change the order, this skips most passes since the upper fields vary little
+		if (histogram[(packets[0].key >> shift) & (BUCKET_COUNT - 1)] == packets.size()) continue;
+
+		// Exclusive prefix sum gives the first output index of each bucket
+		u32 offset = 0;
+		for (int b = 0; b < BUCKET_COUNT; b++) {
+			auto count = histogram[b];
+			histogram[b] = offset;
+			offset += count;
+		}
+
+		for (auto const & packet : packets) {
+			packets_tmp[histogram[(packet.key >> shift) & (BUCKET_COUNT - 1)]++] = packet;
+		}
+
+		packets.swap(packets_tmp);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+
+#include "Types.h"
+
+// Draws of a Render Pass, sorted by a 64 bit key before recording so that draws sharing state end up next to each other
+// Key fields from most to least significant: Pipeline (4 bits), Texture (16 bits), Mesh (20 bits), depth (24 bits)
+// Fields that are more expensive to change are more significant, within the same state draws are sorted front to back
+struct DrawList {
+	struct Packet {
+		u64 key;
+		u32 index; // Into the draw data of the owner of the DrawList
+	};
+
+	std::vector<Packet> packets;
+
+	static u64 make_key(u32 pipeline, u32 texture, u32 mesh, float depth);
+
+	void clear() { packets.clear(); }
+	void add(u64 key, u32 index) { packets.push_back({ key, index }); }
+
+	void sort(); // Stable LSD radix sort on the keys
+
+private:
+	std::vector<Packet> packets_tmp;
+};
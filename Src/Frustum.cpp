@@ -1,5 +1,6 @@
 #include "Frustum.h"
 
+#include <intrin.h>
 #include <immintrin.h>
 
 void Frustum::from_matrix(Matrix4 const & matrix) {
@@ -122,3 +123,271 @@ Frustum::IntersectionType Frustum::intersect_sphere(Vector3 const & center, floa
 
 	return IntersectionType::FULLY_INSIDE;
 }
+
+Frustum::SIMDLevel Frustum::detect_simd_level() {
+	int info[4];
+
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool has_sse     = (info[3] & (1 << 25)) != 0;
+	bool has_fma     = (info[2] & (1 << 12)) != 0;
+	bool has_osxsave = (info[2] & (1 << 27)) != 0;
+
+	bool has_avx2    = false;
+	bool has_avx512f = false;
+
+	if (max_leaf >= 7) {
+		__cpuidex(info, 7, 0);
+		has_avx2    = (info[1] & (1 <<  5)) != 0;
+		has_avx512f = (info[1] & (1 << 16)) != 0;
+	}
+
+	// The OS has to save the wider registers on context switches, which it reports through XCR0
+	u64 xcr0 = has_osxsave ? _xgetbv(0) : 0;
+
+	bool os_avx    = (xcr0 & 0x06) == 0x06; // XMM and YMM state
+	bool os_avx512 = (xcr0 & 0xe6) == 0xe6; // XMM, YMM, opmask, and ZMM state
+
+	if (has_avx512f && os_avx512)          return SIMDLevel::AVX512;
+	if (has_avx2 && has_fma && os_avx)     return SIMDLevel::AVX2;
+	if (has_sse)                           return SIMDLevel::SSE;
+
+	return SIMDLevel::SCALAR;
+}
+
+void Frustum::AABBsSoA::clear() {
+	center_x.clear(); center_y.clear(); center_z.clear();
+	extent_x.clear(); extent_y.clear(); extent_z.clear();
+}
+
+void Frustum::AABBsSoA::add(Vector3 const & center, Vector3 const & extent) {
+	center_x.push_back(center.x); center_y.push_back(center.y); center_z.push_back(center.z);
+	extent_x.push_back(extent.x); extent_y.push_back(extent.y); extent_z.push_back(extent.z);
+}
+
+void Frustum::SpheresSoA::clear() {
+	center_x.clear(); center_y.clear(); center_z.clear();
+	radius.clear();
+}
+
+void Frustum::SpheresSoA::add(Vector3 const & center, float radius) {
+	center_x.push_back(center.x); center_y.push_back(center.y); center_z.push_back(center.z);
+	this->radius.push_back(radius);
+}
+
+// Plane components are stored separately so each can be broadcast directly
+struct PlanesSoA {
+	float n_x[6], n_y[6], n_z[6], d[6];
+	float n_abs_x[6], n_abs_y[6], n_abs_z[6];
+};
+
+// For spheres the extent is unused and radius holds the radius, for AABBs radius holds the x extent
+struct BoundsSoA {
+	float const * center_x;
+	float const * center_y;
+	float const * center_z;
+	float const * radius;
+	float const * extent_y;
+	float const * extent_z;
+};
+
+// An object is outside if it is fully behind any plane, i.e. the signed distance of its center is below minus its radius
+// For AABBs the radius is the projection of the extent onto the plane normal
+template<bool SPHERE>
+static void cull_scalar(PlanesSoA const & planes, int first, int count, BoundsSoA const & bounds, u64 * visible) {
+	for (int i = first; i < count; i++) {
+		bool outside = false;
+
+		for (int p = 0; p < 6; p++) {
+			float distance = planes.n_x[p] * bounds.center_x[i] + planes.n_y[p] * bounds.center_y[i] + planes.n_z[p] * bounds.center_z[i] + planes.d[p];
+			float radius;
+			if constexpr (SPHERE) {
+				radius = bounds.radius[i];
+			} else {
+				radius = planes.n_abs_x[p] * bounds.radius[i] + planes.n_abs_y[p] * bounds.extent_y[i] + planes.n_abs_z[p] * bounds.extent_z[i];
+			}
+
+			outside |= distance + radius < 0.0f;
+		}
+
+		if (!outside) visible[i >> 6] |= u64(1) << (i & 63);
+	}
+}
+
+// The SIMD kernels return how many objects they processed, the remainder is handled by cull_scalar
+// Widths divide 64, so the bits of a single iteration never straddle two words of the mask
+template<bool SPHERE>
+static int cull_sse(PlanesSoA const & planes, int count, BoundsSoA const & bounds, u64 * visible) {
+	__m128 const zero = _mm_setzero_ps();
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 center_x = _mm_loadu_ps(bounds.center_x + i);
+		__m128 center_y = _mm_loadu_ps(bounds.center_y + i);
+		__m128 center_z = _mm_loadu_ps(bounds.center_z + i);
+		__m128 radius_x = _mm_loadu_ps(bounds.radius   + i);
+		__m128 extent_y, extent_z;
+		if constexpr (!SPHERE) {
+			extent_y = _mm_loadu_ps(bounds.extent_y + i);
+			extent_z = _mm_loadu_ps(bounds.extent_z + i);
+		}
+
+		__m128 outside = zero;
+
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.n_x[p]), center_x), _mm_mul_ps(_mm_set1_ps(planes.n_y[p]), center_y)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.n_z[p]), center_z), _mm_set1_ps(planes.d[p]))
+			);
+
+			__m128 radius;
+			if constexpr (SPHERE) {
+				radius = radius_x;
+			} else {
+				radius = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.n_abs_x[p]), radius_x), _mm_mul_ps(_mm_set1_ps(planes.n_abs_y[p]), extent_y)),
+					_mm_mul_ps(_mm_set1_ps(planes.n_abs_z[p]), extent_z)
+				);
+			}
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		u64 mask = ~u64(_mm_movemask_ps(outside)) & 0xf;
+		visible[i >> 6] |= mask << (i & 63);
+	}
+
+	return i;
+}
+
+template<bool SPHERE>
+static int cull_avx2(PlanesSoA const & planes, int count, BoundsSoA const & bounds, u64 * visible) {
+	__m256 const zero = _mm256_setzero_ps();
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 center_x = _mm256_loadu_ps(bounds.center_x + i);
+		__m256 center_y = _mm256_loadu_ps(bounds.center_y + i);
+		__m256 center_z = _mm256_loadu_ps(bounds.center_z + i);
+		__m256 radius_x = _mm256_loadu_ps(bounds.radius   + i);
+		__m256 extent_y, extent_z;
+		if constexpr (!SPHERE) {
+			extent_y = _mm256_loadu_ps(bounds.extent_y + i);
+			extent_z = _mm256_loadu_ps(bounds.extent_z + i);
+		}
+
+		__m256 outside = zero;
+
+		for (int p = 0; p < 6; p++) {
+			__m256 distance =
+				_mm256_fmadd_ps(_mm256_set1_ps(planes.n_x[p]), center_x,
+				_mm256_fmadd_ps(_mm256_set1_ps(planes.n_y[p]), center_y,
+				_mm256_fmadd_ps(_mm256_set1_ps(planes.n_z[p]), center_z, _mm256_set1_ps(planes.d[p]))));
+
+			__m256 radius;
+			if constexpr (SPHERE) {
+				radius = radius_x;
+			} else {
+				radius =
+					_mm256_fmadd_ps(_mm256_set1_ps(planes.n_abs_x[p]), radius_x,
+					_mm256_fmadd_ps(_mm256_set1_ps(planes.n_abs_y[p]), extent_y,
+					_mm256_mul_ps  (_mm256_set1_ps(planes.n_abs_z[p]), extent_z)));
+			}
+
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+		}
+
+		u64 mask = ~u64(_mm256_movemask_ps(outside)) & 0xff;
+		visible[i >> 6] |= mask << (i & 63);
+	}
+
+	return i;
+}
+
+template<bool SPHERE>
+static int cull_avx512(PlanesSoA const & planes, int count, BoundsSoA const & bounds, u64 * visible) {
+	__m512 const zero = _mm512_setzero_ps();
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m512 center_x = _mm512_loadu_ps(bounds.center_x + i);
+		__m512 center_y = _mm512_loadu_ps(bounds.center_y + i);
+		__m512 center_z = _mm512_loadu_ps(bounds.center_z + i);
+		__m512 radius_x = _mm512_loadu_ps(bounds.radius   + i);
+		__m512 extent_y, extent_z;
+		if constexpr (!SPHERE) {
+			extent_y = _mm512_loadu_ps(bounds.extent_y + i);
+			extent_z = _mm512_loadu_ps(bounds.extent_z + i);
+		}
+
+		__mmask16 outside = 0;
+
+		for (int p = 0; p < 6; p++) {
+			__m512 distance =
+				_mm512_fmadd_ps(_mm512_set1_ps(planes.n_x[p]), center_x,
+				_mm512_fmadd_ps(_mm512_set1_ps(planes.n_y[p]), center_y,
+				_mm512_fmadd_ps(_mm512_set1_ps(planes.n_z[p]), center_z, _mm512_set1_ps(planes.d[p]))));
+
+			__m512 radius;
+			if constexpr (SPHERE) {
+				radius = radius_x;
+			} else {
+				radius =
+					_mm512_fmadd_ps(_mm512_set1_ps(planes.n_abs_x[p]), radius_x,
+					_mm512_fmadd_ps(_mm512_set1_ps(planes.n_abs_y[p]), extent_y,
+					_mm512_mul_ps  (_mm512_set1_ps(planes.n_abs_z[p]), extent_z)));
+			}
+
+			outside |= _mm512_cmp_ps_mask(_mm512_add_ps(distance, radius), zero, _CMP_LT_OQ);
+		}
+
+		u64 mask = ~u64(outside) & 0xffff;
+		visible[i >> 6] |= mask << (i & 63);
+	}
+
+	return i;
+}
+
+template<bool SPHERE>
+static void cull_batch(Frustum const & frustum, int count, BoundsSoA const & bounds, std::vector<u64> & visible) {
+	visible.assign((count + 63) / 64, 0);
+
+	PlanesSoA planes;
+	for (int p = 0; p < 6; p++) {
+		auto const & plane = frustum.planes[p];
+
+		planes.n_x[p] = plane.n.x;
+		planes.n_y[p] = plane.n.y;
+		planes.n_z[p] = plane.n.z;
+		planes.d  [p] = plane.d;
+
+		planes.n_abs_x[p] = fabsf(plane.n.x);
+		planes.n_abs_y[p] = fabsf(plane.n.y);
+		planes.n_abs_z[p] = fabsf(plane.n.z);
+	}
+
+	int done = 0;
+
+	switch (Frustum::simd_level) {
+		case Frustum::SIMDLevel::AVX512: done = cull_avx512<SPHERE>(planes, count, bounds, visible.data()); break;
+		case Frustum::SIMDLevel::AVX2:   done = cull_avx2  <SPHERE>(planes, count, bounds, visible.data()); break;
+		case Frustum::SIMDLevel::SSE:    done = cull_sse   <SPHERE>(planes, count, bounds, visible.data()); break;
+		case Frustum::SIMDLevel::SCALAR: break;
+	}
+
+	cull_scalar<SPHERE>(planes, done, count, bounds, visible.data());
+}
+
+void Frustum::cull_aabbs(AABBsSoA const & aabbs, std::vector<u64> & visible) const {
+	BoundsSoA bounds = { aabbs.center_x.data(), aabbs.center_y.data(), aabbs.center_z.data(), aabbs.extent_x.data(), aabbs.extent_y.data(), aabbs.extent_z.data() };
+
+	cull_batch<false>(*this, aabbs.size(), bounds, visible);
+}
+
+void Frustum::cull_spheres(SpheresSoA const & spheres, std::vector<u64> & visible) const {
+	BoundsSoA bounds = { spheres.center_x.data(), spheres.center_y.data(), spheres.center_z.data(), spheres.radius.data(), nullptr, nullptr };
+
+	cull_batch<true>(*this, spheres.size(), bounds, visible);
+}
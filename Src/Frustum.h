@@ -1,7 +1,11 @@
 #pragma once
+#include <vector>
+
 #include "Vector3.h"
 #include "Matrix4.h"
 
+#include "Types.h"
+
 struct Frustum {
 	enum struct IntersectionType {
 		FULLY_OUTSIDE,
@@ -22,4 +26,44 @@ struct Frustum {
 
 	IntersectionType intersect_aabb(Vector3 const & min, Vector3 const & max) const;
 	IntersectionType intersect_sphere(Vector3 const & center, float radius) const;
+
+	// Instruction sets used by the batch culling functions
+	enum struct SIMDLevel {
+		SCALAR,
+		SSE,    // 4 objects per iteration
+		AVX2,   // 8 objects per iteration
+		AVX512  // 16 objects per iteration
+	};
+	static SIMDLevel detect_simd_level(); // Widest instruction set supported by both the CPU and the OS
+
+	static inline SIMDLevel simd_level = detect_simd_level(); // Can be lowered to compare the fallbacks
+
+	// Bounds of many objects as structure of arrays, so that a single SIMD load reads the same component of multiple objects
+	struct AABBsSoA {
+		std::vector<float> center_x, center_y, center_z;
+		std::vector<float> extent_x, extent_y, extent_z;
+
+		int size() const { return center_x.size(); }
+
+		void clear();
+		void add(Vector3 const & center, Vector3 const & extent);
+	};
+
+	struct SpheresSoA {
+		std::vector<float> center_x, center_y, center_z;
+		std::vector<float> radius;
+
+		int size() const { return center_x.size(); }
+
+		void clear();
+		void add(Vector3 const & center, float radius);
+	};
+
+	// Batch culling, bit i of the visibility mask is set if object i is not fully outside the Frustum
+	void cull_aabbs  (AABBsSoA   const & aabbs,   std::vector<u64> & visible) const;
+	void cull_spheres(SpheresSoA const & spheres, std::vector<u64> & visible) const;
+
+	static bool is_visible(std::vector<u64> const & visible, int index) {
+		return (visible[index >> 6] >> (index & 63)) & 1;
+	}
 };
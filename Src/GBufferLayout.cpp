@@ -0,0 +1,67 @@
+#include "GBufferLayout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "VulkanContext.h"
+
+static u32 format_size(VkFormat format) {
+	switch (format) {
+		case VK_FORMAT_UNDEFINED:               return 0;
+		case VK_FORMAT_R8G8_UNORM:              return 2;
+		case VK_FORMAT_R8G8B8A8_UNORM:          return 4;
+		case VK_FORMAT_R16G16_UNORM:            return 4;
+		case VK_FORMAT_R16G16_SFLOAT:           return 4;
+		case VK_FORMAT_B10G11R11_UFLOAT_PACK32: return 4;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:     return 8;
+
+		default: printf("ERROR: Unknown GBuffer format %i!\n", format); abort();
+	}
+}
+
+static bool is_colour_attachment_supported(VkFormat format) {
+	VkFormatProperties properties; vkGetPhysicalDeviceFormatProperties(VulkanContext::get_physical_device(), format, &properties);
+
+	auto features = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+	return (properties.optimalTilingFeatures & features) == features;
+}
+
+u32 GBufferFormats::get_bytes_per_pixel() const {
+	return format_size(albedo) + format_size(normal) + format_size(material) + format_size(lighting);
+}
+
+GBufferFormats GBufferFormats::get(GBufferLayout layout) {
+	GBufferFormats formats = { };
+	formats.albedo = VK_FORMAT_R8G8B8A8_UNORM;
+
+	switch (layout) {
+		case GBufferLayout::STANDARD: {
+			formats.normal   = VK_FORMAT_R16G16B16A16_SFLOAT;
+			formats.material = VK_FORMAT_UNDEFINED;
+			formats.lighting = VK_FORMAT_R16G16B16A16_SFLOAT;
+			break;
+		}
+
+		case GBufferLayout::COMPACT: {
+			// Unlike the other formats R16G16_UNORM is not required to be renderable, half floats have the same size but less precision
+			formats.normal   = is_colour_attachment_supported(VK_FORMAT_R16G16_UNORM) ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R16G16_SFLOAT;
+			formats.material = VK_FORMAT_R8G8_UNORM;
+			formats.lighting = VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+			break;
+		}
+
+		default: abort();
+	}
+
+	return formats;
+}
+
+char const * gbuffer_layout_name(GBufferLayout layout) {
+	switch (layout) {
+		case GBufferLayout::STANDARD: return "standard";
+		case GBufferLayout::COMPACT:  return "compact";
+
+		default: abort();
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Selects the formats of the GBuffer and of the HDR target the Lighting pass renders into
+// The compact layout trades precision for bandwidth, both the geometry and the lighting passes read and write fewer bytes per pixel
+enum struct GBufferLayout {
+	STANDARD, // Albedo RGBA8, Normal + Roughness + Metallic RGBA16F, HDR RGBA16F
+	COMPACT   // Albedo RGBA8, Normal RG16 UNORM, Roughness + Metallic RG8 UNORM, HDR B10G11R11 UFLOAT
+};
+
+struct GBufferFormats {
+	VkFormat albedo;
+	VkFormat normal;   // Octahedral encoded in xy, in the standard layout Roughness and Metallic are stored in zw
+	VkFormat material; // Roughness + Metallic, VK_FORMAT_UNDEFINED if they are stored together with the Normal
+	VkFormat lighting;
+
+	// Colour attachments of the GBuffer plus the HDR target, the depth buffer is the same for every layout
+	u32 get_bytes_per_pixel() const;
+
+	// Falls back to wider formats if the compact ones are not supported as colour attachment
+	static GBufferFormats get(GBufferLayout layout);
+};
+
+// Indices into the attachments of the GBuffer Render Target, the Material attachment only exists if GBufferFormats::material is defined
+static constexpr int GBUFFER_ATTACHMENT_ALBEDO   = 0;
+static constexpr int GBUFFER_ATTACHMENT_NORMAL   = 1;
+static constexpr int GBUFFER_ATTACHMENT_DEPTH    = 2;
+static constexpr int GBUFFER_ATTACHMENT_MATERIAL = 3;
+
+char const * gbuffer_layout_name(GBufferLayout layout);
@@ -0,0 +1,77 @@
+#include "GPUProfiler.h"
+
+#include <cassert>
+
+#include "VulkanCheck.h"
+#include "VulkanContext.h"
+
+#include "Types.h"
+
+void GPUProfiler::init(int slot_count) {
+	VkQueryPoolCreateInfo query_pool_create_info = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	query_pool_create_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_create_info.queryCount = slot_count * MAX_TIMESTAMPS;
+
+	VK_CHECK(vkCreateQueryPool(VulkanContext::get_device(), &query_pool_create_info, nullptr, &query_pool));
+
+	// Only the lower timestampValidBits bits are valid, masking the difference also handles the counter wrapping around
+	auto valid_bits = VulkanContext::get_timestamp_valid_bits();
+	timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+	slots.clear();
+	slots.resize(slot_count);
+}
+
+void GPUProfiler::free() {
+	vkDestroyQueryPool(VulkanContext::get_device(), query_pool, nullptr);
+}
+
+void GPUProfiler::begin(VkCommandBuffer command_buffer, int slot, int frame) {
+	slots[slot].frame = frame;
+	slots[slot].names.clear();
+
+	vkCmdResetQueryPool(command_buffer, query_pool, slot * MAX_TIMESTAMPS, MAX_TIMESTAMPS);
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, slot * MAX_TIMESTAMPS);
+}
+
+void GPUProfiler::timestamp(VkCommandBuffer command_buffer, int slot, char const * name) {
+	auto & names = slots[slot].names;
+
+	assert(names.size() + 1 < MAX_TIMESTAMPS);
+	names.push_back(name);
+
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, slot * MAX_TIMESTAMPS + names.size());
+}
+
+bool GPUProfiler::resolve(int slot, FrameResult & result) {
+	auto & names = slots[slot].names;
+
+	if (slots[slot].frame == -1 || names.size() == 0) return false;
+
+	u64 timestamps[MAX_TIMESTAMPS];
+
+	auto query_result = vkGetQueryPoolResults(VulkanContext::get_device(), query_pool,
+		slot * MAX_TIMESTAMPS, names.size() + 1,
+		sizeof(timestamps), timestamps, sizeof(u64),
+		VK_QUERY_RESULT_64_BIT
+	);
+	if (query_result == VK_NOT_READY) return false;
+
+	VK_CHECK(query_result);
+
+	float ms_per_tick = VulkanContext::get_timestamp_period() * 1e-6f;
+
+	result.frame    = slots[slot].frame;
+	result.total_ms = float((timestamps[names.size()] - timestamps[0]) & timestamp_mask) * ms_per_tick;
+	result.passes.resize(names.size());
+
+	for (int i = 0; i < names.size(); i++) {
+		result.passes[i].name    = names[i];
+		result.passes[i].time_ms = float((timestamps[i + 1] - timestamps[i]) & timestamp_mask) * ms_per_tick;
+	}
+
+	// Slot has been consumed
+	slots[slot].frame = -1;
+
+	return true;
+}
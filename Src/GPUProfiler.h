@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "Types.h"
+
+// Measures GPU time per render pass using timestamp queries
+// Every in-flight frame uses its own slot of queries, which can be read back once that frame is done
+struct GPUProfiler {
+	static constexpr int MAX_TIMESTAMPS = 16;
+
+	struct Pass {
+		char const * name;
+		float        time_ms;
+	};
+
+	struct FrameResult {
+		int frame;
+
+		float             total_ms;
+		std::vector<Pass> passes;
+	};
+
+private:
+	VkQueryPool query_pool;
+	u64         timestamp_mask;
+
+	struct Slot {
+		int frame = -1;
+		std::vector<char const *> names;
+	};
+	std::vector<Slot> slots;
+
+public:
+	void init(int slot_count);
+	void free();
+
+	void begin    (VkCommandBuffer command_buffer, int slot, int frame);
+	void timestamp(VkCommandBuffer command_buffer, int slot, char const * name); // Marks the end of the pass with the given name
+
+	bool resolve(int slot, FrameResult & result);
+};
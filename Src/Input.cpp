@@ -4,7 +4,7 @@
 
 #define KEY_TABLE_SIZE GLFW_KEY_LAST
 
-static GLFWwindow * window;
+static GLFWwindow * window = nullptr;
 
 static bool keyboard_state_curr[KEY_TABLE_SIZE] = { };
 static bool keyboard_state_prev[KEY_TABLE_SIZE] = { };
@@ -34,10 +34,14 @@ void Input::get_mouse_pos(int * x, int * y) {
 }
 
 void Input::set_mouse_pos(int x, int y) {
+	if (window == nullptr) return;
+
 	glfwSetCursorPos(window, double(x), double(y));
 }
 
 void Input::set_mouse_enabled(bool enabled) {
+	if (window == nullptr) return;
+
 	glfwSetInputMode(window, GLFW_CURSOR, enabled ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
 }
 
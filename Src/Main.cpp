@@ -1,19 +1,257 @@
+#include <string.h>
+
+#include <chrono>
+
 #include "VulkanCheck.h"
 #include "VulkanContext.h"
 #include "VulkanMemory.h"
 
 #include "Renderer.h"
+#include "Benchmark.h"
 
 #include "Input.h"
+#include "Profiler.h"
 
 static u32 screen_width  = 1280;
 static u32 screen_height = 720;
 
+static std::string scene_name = "default";
+
+static int profile_frames = 0;
+
+static FramePacing frame_pacing;
+
+static bool async_compute = true;
+
+static GBufferLayout gbuffer_layout = GBufferLayout::STANDARD;
+
+static bool visibility_buffer = false;
+
+// Headless options
+static bool headless = false;
+
+static int headless_frame_count = -1; // -1 means 1000 Frames, or the length of the Camera path when benchmarking
+static int headless_dump_every  = 0;  // Save every N-th Frame as PPM, 0 disables
+
+static std::string headless_output = "timings.csv";
+
+// Benchmark options, only used if a Camera path is provided
+static std::string benchmark_camera_path;
+static std::string benchmark_report = "benchmark.json";
+
+static float benchmark_timestep      = 1.0f / 60.0f;
+static int   benchmark_warmup_frames = 10;
+
+static int benchmark_culling_objects = 0; // Runs the culling microbenchmark instead of rendering if non-zero
+
+static std::chrono::high_resolution_clock::time_point time_startup;
+
+// Reports the time from program start until the first Frame, Pipeline creation dominates when the Pipeline Cache is cold
+static void report_startup_time() {
+	float time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - time_startup).count();
+
+	printf("Startup took %.2f ms (Pipeline Cache: %s)\n", time, VulkanContext::is_pipeline_cache_warm() ? "warm" : "cold");
+}
+
 static void glfw_framebuffer_resize_callback(GLFWwindow * window, int width, int height) {
 	reinterpret_cast<Renderer *>(glfwGetWindowUserPointer(window))->framebuffer_needs_resize = true;
 }
 
-int main() {
+static VkPresentModeKHR parse_present_mode(char const * name) {
+	if (strcmp(name, "immediate")    == 0) return VK_PRESENT_MODE_IMMEDIATE_KHR;
+	if (strcmp(name, "mailbox")      == 0) return VK_PRESENT_MODE_MAILBOX_KHR;
+	if (strcmp(name, "fifo")         == 0) return VK_PRESENT_MODE_FIFO_KHR;
+	if (strcmp(name, "fifo_relaxed") == 0) return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+
+	printf("WARNING: Unknown Present Mode '%s', using FIFO!\n", name);
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+static GBufferLayout parse_gbuffer_layout(char const * name) {
+	if (strcmp(name, "standard") == 0) return GBufferLayout::STANDARD;
+	if (strcmp(name, "compact")  == 0) return GBufferLayout::COMPACT;
+
+	printf("WARNING: Unknown GBuffer layout '%s', using standard!\n", name);
+	return GBufferLayout::STANDARD;
+}
+
+static void parse_command_line(int argc, char ** argv) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (strcmp(arg, "--headless") == 0) {
+			headless = true;
+		} else if (strcmp(arg, "--width") == 0 && has_value) {
+			screen_width = atoi(argv[++i]);
+		} else if (strcmp(arg, "--height") == 0 && has_value) {
+			screen_height = atoi(argv[++i]);
+		} else if (strcmp(arg, "--scene") == 0 && has_value) {
+			scene_name = argv[++i];
+		} else if (strcmp(arg, "--frames") == 0 && has_value) {
+			headless_frame_count = atoi(argv[++i]);
+		} else if (strcmp(arg, "--dump-every") == 0 && has_value) {
+			headless_dump_every = atoi(argv[++i]);
+		} else if (strcmp(arg, "--output") == 0 && has_value) {
+			headless_output = argv[++i];
+		} else if (strcmp(arg, "--camera-path") == 0 && has_value) {
+			benchmark_camera_path = argv[++i];
+		} else if (strcmp(arg, "--report") == 0 && has_value) {
+			benchmark_report = argv[++i];
+		} else if (strcmp(arg, "--timestep") == 0 && has_value) {
+			benchmark_timestep = float(atof(argv[++i]));
+		} else if (strcmp(arg, "--warmup") == 0 && has_value) {
+			benchmark_warmup_frames = atoi(argv[++i]);
+		} else if (strcmp(arg, "--benchmark-culling") == 0 && has_value) {
+			benchmark_culling_objects = atoi(argv[++i]);
+		} else if (strcmp(arg, "--profile-frames") == 0 && has_value) {
+			profile_frames = atoi(argv[++i]);
+		} else if (strcmp(arg, "--frames-in-flight") == 0 && has_value) {
+			frame_pacing.frames_in_flight = atoi(argv[++i]);
+		} else if (strcmp(arg, "--present-mode") == 0 && has_value) {
+			frame_pacing.present_mode = parse_present_mode(argv[++i]);
+		} else if (strcmp(arg, "--wait-to-start") == 0) {
+			frame_pacing.wait_to_start = true;
+		} else if (strcmp(arg, "--no-async-compute") == 0) {
+			async_compute = false;
+		} else if (strcmp(arg, "--gbuffer-layout") == 0 && has_value) {
+			gbuffer_layout = parse_gbuffer_layout(argv[++i]);
+		} else if (strcmp(arg, "--visibility-buffer") == 0) {
+			visibility_buffer = true;
+		} else {
+			printf("WARNING: Unknown command line argument '%s'!\n", arg);
+		}
+	}
+}
+
+// Renders a fixed number of Frames without a window or swapchain and writes per-frame CPU and GPU timings as CSV
+// If a Camera path is provided the Frames are rendered deterministically and a JSON report with percentiles is written
+static void run_headless() {
+	bool benchmarking = !benchmark_camera_path.empty();
+
+	Benchmark benchmark;
+	if (benchmarking) {
+		benchmark.timestep      = benchmark_timestep;
+		benchmark.warmup_frames = benchmark_warmup_frames;
+		benchmark.load_camera_path(benchmark_camera_path);
+
+		if (headless_frame_count == -1) headless_frame_count = benchmark.get_frame_count();
+	}
+
+	if (headless_frame_count == -1) headless_frame_count = 1000;
+
+	VulkanContext::init(nullptr);
+	{
+		Renderer renderer(nullptr, screen_width, screen_height, scene_name, frame_pacing, gbuffer_layout, visibility_buffer);
+		renderer.record_gpu_timings = true;
+		renderer.async_compute      = async_compute;
+
+		report_startup_time();
+
+		if (profile_frames > 0) Profiler::capture(profile_frames);
+
+		std::vector<float> cpu_times(headless_frame_count);
+
+		auto time_prev = std::chrono::high_resolution_clock::now();
+
+		for (int i = 0; i < headless_frame_count; i++) {
+			renderer.begin_frame();
+
+			auto time_curr = std::chrono::high_resolution_clock::now();
+			{
+				PROFILE_SCOPE("Frame");
+
+				float time_delta;
+				if (benchmarking) {
+					benchmark.apply(renderer.scene.camera, i);
+					time_delta = benchmark.timestep;
+				} else {
+					time_delta = std::chrono::duration<float>(time_curr - time_prev).count();
+				}
+
+				renderer.update(time_delta);
+				renderer.render();
+
+				Input::detail::finish_frame();
+			}
+			time_prev = time_curr;
+
+			cpu_times[i] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - time_curr).count();
+
+			Profiler::frame_end();
+
+			if (headless_dump_every > 0 && i % headless_dump_every == 0) {
+				char filename[32]; snprintf(filename, sizeof(filename), "frame_%04i.ppm", i);
+				renderer.save_frame(filename);
+			}
+		}
+
+		// Sync before reading back the remaining GPU timings
+		VK_CHECK(vkDeviceWaitIdle(VulkanContext::get_device()));
+
+		renderer.flush_gpu_timings();
+
+		FILE * file = fopen(headless_output.c_str(), "wb");
+		if (file == nullptr) {
+			printf("ERROR: Unable to open '%s' for writing!\n", headless_output.c_str());
+			abort();
+		}
+
+		auto const & gpu_timings = renderer.gpu_timings_history;
+
+		// Header
+		fprintf(file, "frame,cpu_ms,gpu_ms");
+		if (gpu_timings.size() > 0) {
+			for (auto const & pass : gpu_timings[0].passes) fprintf(file, ",%s_ms", pass.name);
+		}
+		fprintf(file, "\n");
+
+		float cpu_sum = 0.0f;
+		float gpu_sum = 0.0f;
+
+		for (int i = 0; i < gpu_timings.size(); i++) {
+			auto const & gpu = gpu_timings[i];
+
+			fprintf(file, "%i,%.4f,%.4f", gpu.frame, cpu_times[gpu.frame], gpu.total_ms);
+			for (auto const & pass : gpu.passes) fprintf(file, ",%.4f", pass.time_ms);
+			fprintf(file, "\n");
+
+			cpu_sum += cpu_times[gpu.frame];
+			gpu_sum += gpu.total_ms;
+		}
+
+		fclose(file);
+
+		if (gpu_timings.size() > 0) {
+			printf("Rendered %i frames of Scene '%s' at %ux%u, %s GBuffer layout (%u bytes/pixel)\n", headless_frame_count, scene_name.c_str(), screen_width, screen_height, gbuffer_layout_name(gbuffer_layout), GBufferFormats::get(gbuffer_layout).get_bytes_per_pixel());
+			printf("Avg CPU: %.3f ms\n", cpu_sum / float(gpu_timings.size()));
+			printf("Avg GPU: %.3f ms\n", gpu_sum / float(gpu_timings.size()));
+		}
+		printf("Written timings to '%s'\n", headless_output.c_str());
+
+		if (benchmarking) {
+			Benchmark::Info info = { scene_name, Scene::RANDOM_SEED, screen_width, screen_height, gbuffer_layout_name(gbuffer_layout), GBufferFormats::get(gbuffer_layout).get_bytes_per_pixel() };
+			benchmark.write_report(benchmark_report, info, cpu_times, gpu_timings);
+		}
+	}
+	VulkanContext::destroy();
+}
+
+int main(int argc, char ** argv) {
+	time_startup = std::chrono::high_resolution_clock::now();
+
+	parse_command_line(argc, argv);
+
+	if (benchmark_culling_objects > 0) {
+		Benchmark::run_culling(benchmark_culling_objects, 100);
+		return 0;
+	}
+
+	if (headless) {
+		run_headless();
+		return 0;
+	}
+
 	int init_result = glfwInit();
 	if (init_result == GLFW_FALSE) {
 		puts("ERROR: Unable to create GLFW context!");
@@ -39,26 +277,40 @@ int main() {
 
 	VulkanContext::init(window);
 	{
-		Renderer renderer(window, screen_width, screen_height);
+		Renderer renderer(window, screen_width, screen_height, scene_name, frame_pacing, gbuffer_layout, visibility_buffer);
+		renderer.async_compute = async_compute;
 
 		glfwSetWindowUserPointer(window, &renderer);
 
+		report_startup_time();
+
+		if (profile_frames > 0) Profiler::capture(profile_frames);
+
 		double time_curr = 0.0f;
 		double time_prev = 0.0f;
 		double time_delta;
 
 		// Main loop
 		while (!glfwWindowShouldClose(window)) {
-			glfwPollEvents();
+			{
+				PROFILE_SCOPE("Frame");
+
+				// Input is sampled after the Renderer has (optionally) waited for the GPU
+				renderer.begin_frame();
+
+				glfwPollEvents();
+
+				time_curr  = glfwGetTime();
+				time_delta = time_curr - time_prev;
+				time_prev  = time_curr;
 
-			time_curr  = glfwGetTime();
-			time_delta = time_curr - time_prev;
-			time_prev  = time_curr;
+				renderer.update(float(time_delta));
+				renderer.render();
 
-			renderer.update(float(time_delta));
-			renderer.render();
+				Input::detail::finish_frame();
+			}
 
-			Input::detail::finish_frame();
+			Profiler::frame_end();
 		}
 
 		// Sync before destroying
@@ -4,5 +4,7 @@ struct Material {
 	float roughness = 0.9f;
 	float metallic  = 0.0f;
 
+	int id = -1; // Index into Scene::materials and into the Materials Buffer on the GPU, assigned by Scene::add_material
+
 	Material(float roughness, float metallic) : roughness(roughness), metallic(metallic) { }
 };
@@ -61,6 +61,9 @@ struct Mesh {
 	VulkanMemory::Buffer vertex_buffer;
 	VulkanMemory::Buffer index_buffer;
 
+	int vertex_count;
+	int index_count;
+
 	struct SubMesh {
 		int index_offset;
 		int index_count;
@@ -68,6 +71,8 @@ struct Mesh {
 		AABB aabb;
 
 		TextureHandle texture_handle;
+
+		bool alpha_masked; // Drawn with the alpha tested Pipeline, after all opaque Submeshes
 	};
 
 	std::vector<SubMesh> sub_meshes;
@@ -86,3 +91,11 @@ struct MeshInstance {
 
 	MeshInstance(std::string const & name, MeshHandle mesh_handle, Material * material) : name(name), mesh_handle(mesh_handle), material(material) { }
 };
+
+// All static instances of the same Mesh, drawn together using hardware instancing
+struct MeshBatch {
+	MeshHandle mesh_handle;
+
+	int instance_offset; // First instance of the batch in Scene::mesh_batch_instances
+	int instance_count;
+};
@@ -0,0 +1,166 @@
+#include "Profiler.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Event {
+	char const * name;
+
+	u64 tick_begin;
+	u64 tick_end;
+};
+
+// Each thread writes into its own ring buffer, so recording a marker never takes a lock
+struct ThreadBuffer {
+	static constexpr u64 CAPACITY = 1 << 16;
+
+	int thread_id;
+
+	std::atomic<u64> event_count = 0;
+	Event            events[CAPACITY];
+};
+
+static std::mutex                                 thread_buffers_mutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers;
+
+static thread_local ThreadBuffer * thread_buffer = nullptr;
+
+// Reference points used to convert rdtsc ticks into microseconds
+static u64                                   calibration_tick = Profiler::detail::timestamp();
+static std::chrono::steady_clock::time_point calibration_time = std::chrono::steady_clock::now();
+
+static struct {
+	bool active = false;
+
+	int frames_remaining;
+	u64 tick_begin;
+
+	char const * filename;
+
+	std::vector<u64> frame_ticks;
+} capture_state;
+
+static ThreadBuffer * get_thread_buffer() {
+	if (thread_buffer == nullptr) {
+		std::lock_guard<std::mutex> lock(thread_buffers_mutex);
+
+		thread_buffer = thread_buffers.emplace_back(std::make_unique<ThreadBuffer>()).get();
+		thread_buffer->thread_id = int(thread_buffers.size()) - 1;
+	}
+
+	return thread_buffer;
+}
+
+static void write_trace() {
+	FILE * file = fopen(capture_state.filename, "wb");
+	if (file == nullptr) {
+		printf("WARNING: Unable to open '%s' for writing profile!\n", capture_state.filename);
+		return;
+	}
+
+	auto tick_now = Profiler::detail::timestamp();
+	auto time_now = std::chrono::steady_clock::now();
+
+	double elapsed_us   = std::chrono::duration<double, std::micro>(time_now - calibration_time).count();
+	double ticks_per_us = double(tick_now - calibration_tick) / elapsed_us;
+
+	auto to_us = [&](u64 tick) { return double(tick - capture_state.tick_begin) / ticks_per_us; };
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+	bool first = true;
+	auto separator = [&]() { if (!first) fputs(",\n", file); first = false; };
+
+	for (int i = 0; i < capture_state.frame_ticks.size(); i++) {
+		separator();
+		fprintf(file, "{\"name\":\"Frame %i\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":%.3f}", i, to_us(capture_state.frame_ticks[i]));
+	}
+
+	std::lock_guard<std::mutex> lock(thread_buffers_mutex);
+
+	for (auto const & buffer : thread_buffers) {
+		separator();
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%i,\"args\":{\"name\":\"%s %i\"}}", buffer->thread_id, buffer->thread_id == 0 ? "Main" : "Worker", buffer->thread_id);
+
+		u64 count = buffer->event_count.load(std::memory_order_acquire);
+		u64 first_event = count > ThreadBuffer::CAPACITY ? count - ThreadBuffer::CAPACITY : 0;
+
+		bool dropped = false;
+
+		for (u64 e = first_event; e < count; e++) {
+			auto const & event = buffer->events[e % ThreadBuffer::CAPACITY];
+
+			if (event.tick_begin < capture_state.tick_begin) continue;
+
+			if (e == first_event && first_event > 0) dropped = true;
+
+			separator();
+			fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f}",
+				event.name,
+				buffer->thread_id,
+				to_us(event.tick_begin),
+				double(event.tick_end - event.tick_begin) / ticks_per_us
+			);
+		}
+
+		if (dropped) {
+			printf("WARNING: Profiler ring buffer of thread %i overflowed, oldest markers were dropped!\n", buffer->thread_id);
+		}
+	}
+
+	fputs("\n]}\n", file);
+	fclose(file);
+
+	printf("Written profile of %zu frames to '%s'\n", capture_state.frame_ticks.size(), capture_state.filename);
+}
+
+void Profiler::capture(int num_frames, char const * filename) {
+#if PROFILER_ENABLED
+	if (capture_state.active || num_frames <= 0) return;
+
+	// Make sure the main thread gets id 0
+	get_thread_buffer();
+
+	capture_state.active = true;
+	capture_state.frames_remaining = num_frames;
+	capture_state.tick_begin = detail::timestamp();
+	capture_state.filename = filename;
+	capture_state.frame_ticks.clear();
+	capture_state.frame_ticks.push_back(capture_state.tick_begin);
+
+	printf("Capturing profile of %i frames...\n", num_frames);
+#else
+	puts("WARNING: Profiler was disabled at compile time!");
+#endif
+}
+
+bool Profiler::is_capturing() {
+	return capture_state.active;
+}
+
+void Profiler::frame_end() {
+#if PROFILER_ENABLED
+	if (!capture_state.active) return;
+
+	capture_state.frame_ticks.push_back(detail::timestamp());
+
+	if (--capture_state.frames_remaining == 0) {
+		write_trace();
+
+		capture_state.active = false;
+	}
+#endif
+}
+
+void Profiler::detail::record(char const * name, u64 tick_begin, u64 tick_end) {
+	auto buffer = get_thread_buffer();
+
+	u64 index = buffer->event_count.load(std::memory_order_relaxed);
+	buffer->events[index % ThreadBuffer::CAPACITY] = { name, tick_begin, tick_end };
+	buffer->event_count.store(index + 1, std::memory_order_release);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Types.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+// Define PROFILER_ENABLED as 0 to compile out all CPU markers
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+namespace Profiler {
+	// Records the markers of every thread during the next N frames, starting at the call, and then writes them as a Chrome trace (chrome://tracing or ui.perfetto.dev)
+	void capture(int num_frames, char const * filename = "profile.json");
+
+	bool is_capturing();
+
+	void frame_end();
+
+	namespace detail {
+		inline u64 timestamp() {
+			return __rdtsc();
+		}
+
+		void record(char const * name, u64 tick_begin, u64 tick_end);
+
+		struct ScopeTimer {
+			char const * name;
+			u64          tick_begin;
+
+			inline ScopeTimer(char const * name) : name(name), tick_begin(timestamp()) { }
+
+			inline ~ScopeTimer() {
+				record(name, tick_begin, timestamp());
+			}
+		};
+	}
+}
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#define PROFILE_SCOPE(name) Profiler::detail::ScopeTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
@@ -9,52 +9,11 @@
 #include "Util.h"
 
 void RenderTarget::add_attachment(int width, int height, VkFormat format, unsigned usage, VkImageLayout image_layout, VkClearValue clear_value) {
-	auto device = VulkanContext::get_device();
-
-	VkImageAspectFlags image_aspect_mask = 0;
-
-	if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)         image_aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
-	if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) image_aspect_mask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-	assert(image_aspect_mask != 0);
-
 	auto & attachment = attachments.emplace_back();
 	attachment.format = format;
+	attachment.usage  = usage;
 
-	VkImageCreateInfo image_create_info = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
-	image_create_info.imageType = VK_IMAGE_TYPE_2D;
-	image_create_info.format = format;
-	image_create_info.extent = { u32(width), u32(height), 1 };
-	image_create_info.mipLevels = 1;
-	image_create_info.arrayLayers = 1;
-	image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
-	image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-	image_create_info.usage = usage;
-
-	VK_CHECK(vkCreateImage(device, &image_create_info, nullptr, &attachment.image));
-
-	VkMemoryRequirements memory_requirements; vkGetImageMemoryRequirements(device, attachment.image, &memory_requirements);
-
-	VkMemoryAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-	alloc_info.allocationSize = memory_requirements.size;
-	alloc_info.memoryTypeIndex = VulkanMemory::find_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	VK_CHECK(vkAllocateMemory(device, &alloc_info, nullptr, &attachment.memory));
-
-	VK_CHECK(vkBindImageMemory(device, attachment.image, attachment.memory, 0));
-
-	VkImageViewCreateInfo image_view_create_info = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
-	image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	image_view_create_info.format = format;
-	image_view_create_info.subresourceRange = { };
-	image_view_create_info.subresourceRange.aspectMask = image_aspect_mask;
-	image_view_create_info.subresourceRange.baseMipLevel = 0;
-	image_view_create_info.subresourceRange.levelCount   = 1;
-	image_view_create_info.subresourceRange.baseArrayLayer = 0;
-	image_view_create_info.subresourceRange.layerCount     = 1;
-	image_view_create_info.image = attachment.image;
-
-	VK_CHECK(vkCreateImageView(device, &image_view_create_info, nullptr, &attachment.image_view));
+	attachment_create(attachment, width, height);
 
 	attachment.description.format = format;
 	attachment.description.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -71,14 +30,7 @@ void RenderTarget::add_attachment(int width, int height, VkFormat format, unsign
 void RenderTarget::init(int width, int height, VkRenderPass render_pass, VkFilter filter) {
 	auto device = VulkanContext::get_device();
 
-	std::vector<VkImageView> attachment_views(attachments.size());
-
-	for (int i = 0; i < attachments.size(); i++) {
-		attachment_views[i] = attachments[i].image_view;
-	}
-
-	// Create Frame Buffer
-	frame_buffer = VulkanContext::create_frame_buffer(width, height, render_pass, attachment_views);
+	frame_buffer_create(width, height, render_pass);
 
 	// Create Sampler to sample from the GBuffer's color attachments
 	VkSamplerCreateInfo sampler_create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
@@ -101,9 +53,7 @@ void RenderTarget::free() {
 	auto device = VulkanContext::get_device();
 
 	for (auto & attachment : attachments) {
-		vkDestroyImage    (device, attachment.image,      nullptr);
-		vkDestroyImageView(device, attachment.image_view, nullptr);
-		vkFreeMemory      (device, attachment.memory,     nullptr);
+		attachment_destroy(attachment);
 	}
 
 	attachments.clear();
@@ -114,6 +64,81 @@ void RenderTarget::free() {
 	clear_values.clear();
 }
 
+void RenderTarget::resize(int width, int height, VkRenderPass render_pass) {
+	vkDestroyFramebuffer(VulkanContext::get_device(), frame_buffer, nullptr);
+
+	for (auto & attachment : attachments) {
+		attachment_destroy(attachment);
+		attachment_create (attachment, width, height);
+	}
+
+	frame_buffer_create(width, height, render_pass);
+}
+
+void RenderTarget::attachment_create(Attachment & attachment, int width, int height) {
+	auto device = VulkanContext::get_device();
+
+	VkImageAspectFlags image_aspect_mask = 0;
+
+	if (attachment.usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)         image_aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
+	if (attachment.usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) image_aspect_mask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+	assert(image_aspect_mask != 0);
+
+	VkImageCreateInfo image_create_info = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	image_create_info.imageType = VK_IMAGE_TYPE_2D;
+	image_create_info.format = attachment.format;
+	image_create_info.extent = { u32(width), u32(height), 1 };
+	image_create_info.mipLevels = 1;
+	image_create_info.arrayLayers = 1;
+	image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_create_info.usage = attachment.usage;
+
+	VK_CHECK(vkCreateImage(device, &image_create_info, nullptr, &attachment.image));
+
+	VkMemoryRequirements memory_requirements; vkGetImageMemoryRequirements(device, attachment.image, &memory_requirements);
+
+	VkMemoryAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	alloc_info.allocationSize = memory_requirements.size;
+	alloc_info.memoryTypeIndex = VulkanMemory::find_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VK_CHECK(vkAllocateMemory(device, &alloc_info, nullptr, &attachment.memory));
+
+	VK_CHECK(vkBindImageMemory(device, attachment.image, attachment.memory, 0));
+
+	VkImageViewCreateInfo image_view_create_info = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+	image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	image_view_create_info.format = attachment.format;
+	image_view_create_info.subresourceRange = { };
+	image_view_create_info.subresourceRange.aspectMask = image_aspect_mask;
+	image_view_create_info.subresourceRange.baseMipLevel = 0;
+	image_view_create_info.subresourceRange.levelCount   = 1;
+	image_view_create_info.subresourceRange.baseArrayLayer = 0;
+	image_view_create_info.subresourceRange.layerCount     = 1;
+	image_view_create_info.image = attachment.image;
+
+	VK_CHECK(vkCreateImageView(device, &image_view_create_info, nullptr, &attachment.image_view));
+}
+
+void RenderTarget::attachment_destroy(Attachment & attachment) {
+	auto device = VulkanContext::get_device();
+
+	vkDestroyImage    (device, attachment.image,      nullptr);
+	vkDestroyImageView(device, attachment.image_view, nullptr);
+	vkFreeMemory      (device, attachment.memory,     nullptr);
+}
+
+void RenderTarget::frame_buffer_create(int width, int height, VkRenderPass render_pass) {
+	std::vector<VkImageView> attachment_views(attachments.size());
+
+	for (int i = 0; i < attachments.size(); i++) {
+		attachment_views[i] = attachments[i].image_view;
+	}
+
+	frame_buffer = VulkanContext::create_frame_buffer(width, height, render_pass, attachment_views);
+}
+
 std::vector<VkAttachmentDescription> RenderTarget::get_attachment_descriptions() {
 	std::vector<VkAttachmentDescription> descs(attachments.size());
 
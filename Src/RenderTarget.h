@@ -13,6 +13,7 @@ struct RenderTarget {
 		VkFormat       format;
 
 		private: VkAttachmentDescription description;
+		private: unsigned                usage;
 	};
 	std::vector<Attachment> attachments;
 
@@ -26,5 +27,14 @@ struct RenderTarget {
 	void init(int width, int height, VkRenderPass render_pass, VkFilter filter = VK_FILTER_NEAREST);
 	void free();
 
+	// Recreates the Images and Frame Buffer at a new size, keeping formats, Sampler, and Render Pass compatibility
+	void resize(int width, int height, VkRenderPass render_pass);
+
 	std::vector<VkAttachmentDescription> get_attachment_descriptions();
+
+private:
+	static void attachment_create(Attachment & attachment, int width, int height);
+	static void attachment_destroy(Attachment & attachment);
+
+	void frame_buffer_create(int width, int height, VkRenderPass render_pass);
 };
@@ -10,6 +10,7 @@
 #include "Texture.h"
 
 #include "Util.h"
+#include "Profiler.h"
 
 // Same layout as VkDrawIndexedIndirectCommand
 struct IndexedIndirectCommand {
@@ -22,29 +23,92 @@ struct IndexedIndirectCommand {
 
 struct Stats {
 	unsigned draw_count;
+	unsigned draw_count_late;
+	unsigned culled_frustum;
+	unsigned culled_occlusion;
 };
 
-struct Model {
-	Vector3  position;
+// Padded to the std430 array stride of Model in cull.comp, which is aligned to its vec3 members
+struct alignas(16) Model {
+	Vector3  aabb_center;
 	unsigned index_count;
+	Vector3  aabb_extent;
+	unsigned first_index;
+
+	unsigned instance_index;
+	unsigned texture_index;
+	unsigned group_index;
+	unsigned group_offset;
+
+	unsigned geometry_first_vertex; // Of the Mesh in the shared Geometry Buffers, zero if not in Visibility Buffer mode
+	unsigned geometry_first_index;
 };
 
+// Per static Mesh instance data, read by geometry_static.vert and shadow_static.vert
+struct alignas(16) Instance {
+	Matrix4 world;
+	u32     material_index;
+};
+
+// One per visible Submesh instance, written by the cull Shader or on the CPU
+struct InstanceDraw {
+	unsigned instance_index;
+	unsigned texture_index;
+	unsigned first_index;   // Of the Submesh in the shared Geometry Buffers, only used by the Visibility Buffer resolve
+	unsigned vertex_offset;
+};
+
+struct CullPushConstants {
+	alignas(16) Matrix4 view_projection;
+	alignas(4) unsigned model_count;
+	alignas(4) unsigned phase;
+	alignas(4) int pyramid_width;
+	alignas(4) int pyramid_height;
+	alignas(4) int pyramid_mip_count;
+};
+
+static VkImageAspectFlags get_depth_aspect(VkFormat format) {
+	if (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT) {
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+// Matches the PHASE_* defines in cull.comp
+static constexpr unsigned CULL_PHASE_FRUSTUM = 0;
+static constexpr unsigned CULL_PHASE_EARLY   = 1;
+static constexpr unsigned CULL_PHASE_LATE    = 2;
+
+// Pipeline field of the DrawList keys, opaque static geometry comes first so that it fills the depth buffer before any alpha tested draws
+static constexpr u32 DRAW_PIPELINE_STATIC        = 0;
+static constexpr u32 DRAW_PIPELINE_ANIMATED      = 1;
+static constexpr u32 DRAW_PIPELINE_STATIC_MASKED = 2;
+
+// Animated Meshes are drawn one instance at a time
 struct GBufferPushConstants {
 	alignas(16) Matrix4 world;
-	union {
-		alignas(16) Matrix4 wvp;
-		alignas(16) Matrix4 view_projection;
-	};
-	alignas(4) int bone_offset;
+	alignas(16) Matrix4 view_projection;
+};
+
+// Instanced and indirect static geometry reads its world matrix from the Instances Buffer
+struct GBufferStaticPushConstants {
+	alignas(16) Matrix4 view_projection;
+};
+
+// Follows GBufferPushConstants in both Pipeline Layouts, only used by the Fragment Shader
+struct GBufferFragmentPushConstants {
+	alignas(4) int texture_index;
+	alignas(4) int material_index; // Only used by animated Meshes, static Meshes get it from their Instance
 };
 
 struct CameraUBO {
 	alignas(16) Vector4 frustum_planes[6];
 };
 
-struct MaterialUBO {
-	alignas(4) float material_roughness;
-	alignas(4) float material_metallic;
+// Same layout as Material in geometry.frag, indexed by Material id
+struct MaterialData {
+	float roughness;
+	float metallic;
 };
 
 struct SkyUBO {
@@ -55,16 +119,18 @@ struct SkyUBO {
 	alignas(16) Vector3 sun_direction;
 };
 
-void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int height, int swapchain_image_count) {
+void RenderTaskGBuffer::init(DescriptorAllocator & descriptor_allocator, int width, int height, int swapchain_image_count, GBufferLayout layout, bool visibility) {
 	auto device = VulkanContext::get_device();
 
 	this->width  = width;
 	this->height = height;
 
+	this->layout = layout;
+
 	// Create Descriptor Set Layouts
 	{
 		// Compute Culling
-		VkDescriptorSetLayoutBinding layout_bindings_cull[4] = { };
+		VkDescriptorSetLayoutBinding layout_bindings_cull[7] = { };
 
 		layout_bindings_cull[0].binding = 0;
 		layout_bindings_cull[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
@@ -74,8 +140,8 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 		layout_bindings_cull[1].binding = 1;
 		layout_bindings_cull[1].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		layout_bindings_cull[1].descriptorCount = 1;
-		layout_bindings_cull[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
-			;
+		layout_bindings_cull[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
 		layout_bindings_cull[2].binding = 2;
 		layout_bindings_cull[2].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 		layout_bindings_cull[2].descriptorCount = 1;
@@ -86,6 +152,21 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 		layout_bindings_cull[3].descriptorCount = 1;
 		layout_bindings_cull[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
+		layout_bindings_cull[4].binding = 4;
+		layout_bindings_cull[4].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings_cull[4].descriptorCount = 1;
+		layout_bindings_cull[4].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		layout_bindings_cull[5].binding = 5;
+		layout_bindings_cull[5].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings_cull[5].descriptorCount = 1;
+		layout_bindings_cull[5].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		layout_bindings_cull[6].binding = 6;
+		layout_bindings_cull[6].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings_cull[6].descriptorCount = 1;
+		layout_bindings_cull[6].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
 		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
 		layout_create_info.bindingCount = Util::array_element_count(layout_bindings_cull);
 		layout_create_info.pBindings    = layout_bindings_cull;
@@ -93,19 +174,76 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.cull));
 	}
 
+	{
+		// Depth Pyramid, sampled by the late cull phase
+		VkDescriptorSetLayoutBinding layout_bindings_depth_pyramid[1] = { };
+		layout_bindings_depth_pyramid[0].binding = 0;
+		layout_bindings_depth_pyramid[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		layout_bindings_depth_pyramid[0].descriptorCount = 1;
+		layout_bindings_depth_pyramid[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layout_create_info.bindingCount = Util::array_element_count(layout_bindings_depth_pyramid);
+		layout_create_info.pBindings    = layout_bindings_depth_pyramid;
+
+		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.depth_pyramid));
+	}
+
+	// Bindless requires all Textures to fit in the array
+	auto texture_count = int(scene.asset_manager.textures.size());
+
+	bindless_texture_count = Math::min(MAX_BINDLESS_TEXTURES, int(VulkanContext::get_bindless_max_textures()));
+	bindless = VulkanContext::is_bindless_supported() && texture_count <= bindless_texture_count;
+
+	if (VulkanContext::is_bindless_supported() && !bindless) {
+		printf("WARNING: Scene has %i Textures, more than the %i supported in bindless mode!\n", texture_count, bindless_texture_count);
+	}
+
+	// GPU driven drawing selects the Texture per draw in the Shader, which requires bindless
+	gpu_driven = bindless && VulkanContext::is_draw_indirect_count_supported();
+
+	cull_model_count = 0;
+	for (auto const & mesh_instance : scene.meshes) {
+		cull_model_count += scene.asset_manager.get_mesh(mesh_instance.mesh_handle).sub_meshes.size();
+	}
+
+	// Every static Submesh instance can become a Draw in both occlusion culling phases, Draw indices have to fit in the ids of the Visibility Buffer
+	this->visibility = false;
+
+	if (visibility) {
+		if (!bindless || !VulkanContext::is_visibility_buffer_supported()) {
+			printf("WARNING: Visibility Buffer is not supported, falling back to the GBuffer!\n");
+		} else if (!VisibilityBuffer::is_supported(scene, 2 * cull_model_count)) {
+			printf("WARNING: Scene has too many static Submesh instances for the Visibility Buffer, falling back to the GBuffer!\n");
+		} else {
+			this->visibility = true;
+		}
+	}
+
 	{
 		// Static Geometry
 		VkDescriptorSetLayoutBinding layout_bindings_geometry[1] = { };
 		layout_bindings_geometry[0].binding = 1;
 		layout_bindings_geometry[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		layout_bindings_geometry[0].descriptorCount = 1;
+		layout_bindings_geometry[0].descriptorCount = bindless ? bindless_texture_count : 1;
 		layout_bindings_geometry[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 		layout_bindings_geometry[0].pImmutableSamplers = nullptr;
 
+		VkDescriptorBindingFlags binding_flags[1] = { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT };
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO };
+		binding_flags_create_info.bindingCount  = Util::array_element_count(binding_flags);
+		binding_flags_create_info.pBindingFlags = binding_flags;
+
 		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
 		layout_create_info.bindingCount = Util::array_element_count(layout_bindings_geometry);
 		layout_create_info.pBindings    = layout_bindings_geometry;
 
+		if (bindless) {
+			layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+			layout_create_info.pNext = &binding_flags_create_info;
+		}
+
 		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.geometry));
 	}
 
@@ -113,7 +251,7 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 		// Material
 		VkDescriptorSetLayoutBinding layout_bindings_material[1] = { };
 		layout_bindings_material[0].binding = 0;
-		layout_bindings_material[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		layout_bindings_material[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 		layout_bindings_material[0].descriptorCount = 1;
 		layout_bindings_material[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 		layout_bindings_material[0].pImmutableSamplers = nullptr;
@@ -125,31 +263,21 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.material));
 	}
 
-	{
-		// Bones
-		VkDescriptorSetLayoutBinding layout_bindings_geometry[1] = { };
-		layout_bindings_geometry[0].binding = 0;
-		layout_bindings_geometry[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		layout_bindings_geometry[0].descriptorCount = 1;
-		layout_bindings_geometry[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-		layout_bindings_geometry[0].pImmutableSamplers = nullptr;
-
-		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-		layout_create_info.bindingCount = Util::array_element_count(layout_bindings_geometry);
-		layout_create_info.pBindings    = layout_bindings_geometry;
-
-		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.bones));
-	}
-
 	{
 		// Sky
-		VkDescriptorSetLayoutBinding layout_bindings_sky[1] = { };
+		VkDescriptorSetLayoutBinding layout_bindings_sky[2] = { };
 		layout_bindings_sky[0].binding = 0;
 		layout_bindings_sky[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		layout_bindings_sky[0].descriptorCount = 1;
 		layout_bindings_sky[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 		layout_bindings_sky[0].pImmutableSamplers = nullptr;
 
+		layout_bindings_sky[1].binding = 1;
+		layout_bindings_sky[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		layout_bindings_sky[1].descriptorCount = 1;
+		layout_bindings_sky[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		layout_bindings_sky[1].pImmutableSamplers = nullptr;
+
 		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
 		layout_create_info.bindingCount = Util::array_element_count(layout_bindings_sky);
 		layout_create_info.pBindings    = layout_bindings_sky;
@@ -157,48 +285,125 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.sky));
 	}
 
+	{
+		// Instances and Draws
+		VkDescriptorSetLayoutBinding layout_bindings_instanced[2] = { };
+		layout_bindings_instanced[0].binding = 0;
+		layout_bindings_instanced[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings_instanced[0].descriptorCount = 1;
+		layout_bindings_instanced[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		layout_bindings_instanced[0].pImmutableSamplers = nullptr;
+
+		layout_bindings_instanced[1].binding = 1;
+		layout_bindings_instanced[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings_instanced[1].descriptorCount = 1;
+		layout_bindings_instanced[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		layout_bindings_instanced[1].pImmutableSamplers = nullptr;
+
+		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layout_create_info.bindingCount = Util::array_element_count(layout_bindings_instanced);
+		layout_create_info.pBindings    = layout_bindings_instanced;
+
+		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.instanced));
+	}
+
 	// Initialize FrameBuffers and their attachments
 	constexpr auto attachment_colour = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT         | VK_IMAGE_USAGE_SAMPLED_BIT;
 	constexpr auto attachment_depth  = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 	constexpr auto readonly = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	render_target.add_attachment(width, height, VK_FORMAT_R8G8B8A8_UNORM,                    attachment_colour, readonly, VulkanContext::create_clear_value_colour()); // Albedo
-	render_target.add_attachment(width, height, VK_FORMAT_R16G16B16A16_SFLOAT,               attachment_colour, readonly, VulkanContext::create_clear_value_colour()); // Normal (packed in xy) + Roughness + Metallic
+	auto formats = GBufferFormats::get(layout);
+
+	render_target.add_attachment(width, height, formats.albedo,                              attachment_colour, readonly, VulkanContext::create_clear_value_colour()); // Albedo
+	render_target.add_attachment(width, height, formats.normal,                              attachment_colour, readonly, VulkanContext::create_clear_value_colour()); // Normal (packed in xy), in the standard layout + Roughness + Metallic
 	render_target.add_attachment(width, height, VulkanContext::get_supported_depth_format(), attachment_depth,  readonly, VulkanContext::create_clear_value_depth());  // Depth
 
+	// Comes after Depth so that Depth keeps the same index in every layout
+	if (formats.material != VK_FORMAT_UNDEFINED) {
+		render_target.add_attachment(width, height, formats.material, attachment_colour, readonly, VulkanContext::create_clear_value_colour()); // Roughness + Metallic
+	}
+
 	render_pass = VulkanContext::create_render_pass(render_target.get_attachment_descriptions());
 	render_target.init(width, height, render_pass);
 
-	VkPushConstantRange push_constants;
-	push_constants.offset = 0;
-	push_constants.size = sizeof(GBufferPushConstants);
-	push_constants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	// Compatible with render_pass, so the same Frame Buffer and Pipelines can be used
+	auto attachment_descriptions_load = render_target.get_attachment_descriptions();
+	for (auto & description : attachment_descriptions_load) {
+		bool is_depth = description.format == VulkanContext::get_supported_depth_format();
+
+		description.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		description.initialLayout = is_depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : description.finalLayout;
+	}
+	render_pass_load = VulkanContext::create_render_pass(attachment_descriptions_load);
+
+	if (visibility) {
+		// Depth continues from the Visibility pass, the colour attachments are fully overwritten by the resolve so their contents are not loaded
+		auto attachment_descriptions_resolve = render_target.get_attachment_descriptions();
+		for (auto & description : attachment_descriptions_resolve) {
+			bool is_depth = description.format == VulkanContext::get_supported_depth_format();
+
+			if (is_depth) {
+				description.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+				description.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			} else {
+				description.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			}
+		}
+		render_pass_resolve = VulkanContext::create_render_pass(attachment_descriptions_resolve);
+
+		VisibilityBuffer::InitDetails visibility_details = { };
+		visibility_details.width  = width;
+		visibility_details.height = height;
+		visibility_details.swapchain_image_count = swapchain_image_count;
+		visibility_details.depth_description = render_target.get_attachment_descriptions()[GBUFFER_ATTACHMENT_DEPTH];
+		visibility_details.depth_view        = render_target.attachments[GBUFFER_ATTACHMENT_DEPTH].image_view;
+		visibility_details.sampler           = render_target.sampler;
+		visibility_details.render_pass_gbuffer = render_pass;
+		visibility_details.gbuffer_layout      = layout;
+		visibility_details.descriptor_set_layout_textures = descriptor_set_layouts.geometry;
+		visibility_details.texture_count                  = bindless_texture_count;
+
+		visibility_buffer.init(descriptor_allocator, scene, visibility_details);
+	}
+
+	VkPushConstantRange push_constants[3];
+	push_constants[0].offset = 0;
+	push_constants[0].size = sizeof(GBufferPushConstants);
+	push_constants[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_constants[1].offset = sizeof(GBufferPushConstants);
+	push_constants[1].size = sizeof(GBufferFragmentPushConstants);
+	push_constants[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	push_constants[2].offset = 0;
+	push_constants[2].size = sizeof(GBufferStaticPushConstants);
+	push_constants[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
 	VulkanContext::PipelineLayoutDetails pipeline_layout_details;
 
 	// Cull Pipeline Layout
 	pipeline_layout_details.descriptor_set_layouts = {
-		descriptor_set_layouts.cull
+		descriptor_set_layouts.cull,
+		descriptor_set_layouts.depth_pyramid
 	};
-	pipeline_layout_details.push_constants = { };
+	pipeline_layout_details.push_constants = { { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants) } };
 
 	pipeline_layouts.cull = VulkanContext::create_pipeline_layout(pipeline_layout_details);
 
 	// Static Geometry Pipeline Layout
 	pipeline_layout_details.descriptor_set_layouts = {
 		descriptor_set_layouts.geometry,
-		descriptor_set_layouts.material
+		descriptor_set_layouts.material,
+		descriptor_set_layouts.instanced
 	};
-	pipeline_layout_details.push_constants = { push_constants };
+	pipeline_layout_details.push_constants = { push_constants[2], push_constants[1] };
 
 	pipeline_layouts.geometry_static = VulkanContext::create_pipeline_layout(pipeline_layout_details);
 
-	// Animated Geometry Pipeline Layout
+	// Animated Geometry Pipeline Layout, the Vertices were already skinned so no Bones are needed
 	pipeline_layout_details.descriptor_set_layouts = {
 		descriptor_set_layouts.geometry,
-		descriptor_set_layouts.material,
-		descriptor_set_layouts.bones
+		descriptor_set_layouts.material
 	};
+	pipeline_layout_details.push_constants = { push_constants[0], push_constants[1] };
 
 	pipeline_layouts.geometry_animated = VulkanContext::create_pipeline_layout(pipeline_layout_details);
 
@@ -209,70 +414,122 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 	pipeline_layouts.sky = VulkanContext::create_pipeline_layout(pipeline_layout_details);
 
 	// Create Pipelines
+	VulkanContext::PipelineDetails pipeline_details_cull;
+	pipeline_details_cull.shaders = { { "Shaders/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT } };
+	pipeline_details_cull.pipeline_layout = pipeline_layouts.cull;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details_cull, &pipelines.cull);
+
 	VulkanContext::PipelineDetails pipeline_details;
 
 	pipeline_details.vertex_bindings   = Mesh::Vertex::get_binding_descriptions();
 	pipeline_details.vertex_attributes = Mesh::Vertex::get_attribute_descriptions();
-	pipeline_details.width  = width;
-	pipeline_details.height = height;
 	pipeline_details.blends = {
 		VulkanContext::PipelineDetails::BLEND_NONE,
 		VulkanContext::PipelineDetails::BLEND_NONE
 	};
+	if (formats.material != VK_FORMAT_UNDEFINED) {
+		pipeline_details.blends.push_back(VulkanContext::PipelineDetails::BLEND_NONE);
+	}
 	pipeline_details.cull_mode = VK_CULL_MODE_BACK_BIT;
 	pipeline_details.shaders = {
 		{ "Shaders/geometry_static.vert.spv", VK_SHADER_STAGE_VERTEX_BIT   },
 		{ "Shaders/geometry.frag.spv",        VK_SHADER_STAGE_FRAGMENT_BIT }
 	};
+	pipeline_details.specialization_constants = {
+		{ 0, VK_FALSE },                                   // ALPHA_TEST
+		{ 1, u32(bindless ? bindless_texture_count : 1) }, // TEXTURE_COUNT
+		{ 2, VK_TRUE },                                    // INSTANCED
+		{ 3, u32(layout == GBufferLayout::COMPACT) }       // GBUFFER_COMPACT
+	};
 	pipeline_details.pipeline_layout = pipeline_layouts.geometry_static;
 	pipeline_details.render_pass     = render_pass;
 
-	pipelines.geometry_static = VulkanContext::create_pipeline(pipeline_details);
+	// In Visibility Buffer mode static geometry only writes its id, Textures are only sampled for the alpha test
+	auto pipeline_details_static = pipeline_details;
+	if (visibility) {
+		pipeline_details_static.blends = { VulkanContext::PipelineDetails::BLEND_NONE };
+		pipeline_details_static.shaders[1] = { "Shaders/visibility.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT };
+		pipeline_details_static.specialization_constants.push_back({ 4, u32(visibility_buffer.triangle_bits) }); // TRIANGLE_BITS
+		pipeline_details_static.render_pass = visibility_buffer.render_pass;
+	}
+
+	VulkanContext::create_pipeline_deferred(pipeline_details_static, &pipelines.geometry_static);
+
+	pipeline_details_static.specialization_constants[0].value = VK_TRUE;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details_static, &pipelines.geometry_static_masked);
 
-	pipeline_details.vertex_bindings   = AnimatedMesh::Vertex::get_binding_descriptions();
-	pipeline_details.vertex_attributes = AnimatedMesh::Vertex::get_attribute_descriptions();
+	// Skinned Vertices use the same layout as static ones
 	pipeline_details.shaders = {
 		{ "Shaders/geometry_animated.vert.spv", VK_SHADER_STAGE_VERTEX_BIT   },
 		{ "Shaders/geometry.frag.spv",          VK_SHADER_STAGE_FRAGMENT_BIT }
 	};
+	pipeline_details.specialization_constants = {
+		{ 0, VK_TRUE },                                    // ALPHA_TEST
+		{ 1, u32(bindless ? bindless_texture_count : 1) }, // TEXTURE_COUNT
+		{ 3, u32(layout == GBufferLayout::COMPACT) }       // GBUFFER_COMPACT
+	};
 	pipeline_details.pipeline_layout = pipeline_layouts.geometry_animated;
 
-	pipelines.geometry_animated = VulkanContext::create_pipeline(pipeline_details);
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.geometry_animated);
 
 	pipeline_details.vertex_bindings   = { };
 	pipeline_details.vertex_attributes = { };
-	pipeline_details.blends[1].colorWriteMask = 0; // Don't write to normal buffer
+	for (int i = 1; i < pipeline_details.blends.size(); i++) {
+		pipeline_details.blends[i].colorWriteMask = 0; // Don't write to normal and material buffers
+	}
 	pipeline_details.cull_mode = VK_CULL_MODE_NONE;
 	pipeline_details.shaders = {
 		{ "Shaders/sky.vert.spv", VK_SHADER_STAGE_VERTEX_BIT },
 		{ "Shaders/sky.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT }
 	};
+	pipeline_details.specialization_constants = { };
 	pipeline_details.enable_depth_write = false;
 	pipeline_details.depth_compare = VK_COMPARE_OP_EQUAL;
 	pipeline_details.pipeline_layout = pipeline_layouts.sky;
 
-	pipelines.sky = VulkanContext::create_pipeline(pipeline_details);
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.sky);
 
 	// Create Uniform Buffers
-	uniform_buffers.material.reserve(swapchain_image_count);
-	uniform_buffers.sky     .reserve(swapchain_image_count);
+	uniform_buffers.sky.reserve(swapchain_image_count);
 	storage_buffers.cull_commands.reserve(swapchain_image_count);
-	scene.asset_manager.storage_buffer_bones.reserve(swapchain_image_count);
+	scene.asset_manager.storage_buffer_instances.reserve(swapchain_image_count);
+
+	auto aligned_size_camera = Math::round_up(sizeof(CameraUBO), VulkanContext::get_min_uniform_buffer_alignment());
+	auto aligned_size_sky    = Math::round_up(sizeof(SkyUBO),    VulkanContext::get_min_uniform_buffer_alignment());
 
-	auto aligned_size_camera       = Math::round_up(sizeof(CameraUBO),              VulkanContext::get_min_uniform_buffer_alignment());
-	auto aligned_size_material     = Math::round_up(sizeof(MaterialUBO),            VulkanContext::get_min_uniform_buffer_alignment());
-	auto aligned_size_sky          = Math::round_up(sizeof(SkyUBO),                 VulkanContext::get_min_uniform_buffer_alignment());
-	auto aligned_size_cull_command = Math::round_up(sizeof(IndexedIndirectCommand), VulkanContext::get_min_uniform_buffer_alignment());
-	auto aligned_size_cull_stats   = Math::round_up(sizeof(Stats),                  VulkanContext::get_min_uniform_buffer_alignment());
-	auto aligned_size_cull_model   = Math::round_up(sizeof(Model),                  VulkanContext::get_min_uniform_buffer_alignment());
+	// The opaque and alpha masked Submeshes of each MeshBatch get a contiguous range of Commands that the cull Shader compacts into
+	indirect_groups.clear();
+
+	auto command_offset = 0;
+	for (auto alpha_masked : { false, true }) {
+		for (int i = 0; i < scene.mesh_batches.size(); i++) {
+			auto const & batch = scene.mesh_batches[i];
+			auto const & mesh  = scene.asset_manager.get_mesh(batch.mesh_handle);
+
+			auto sub_mesh_count = 0;
+			for (auto const & sub_mesh : mesh.sub_meshes) {
+				if (sub_mesh.alpha_masked == alpha_masked) sub_mesh_count++;
+			}
+			if (sub_mesh_count == 0) continue;
 
-	auto total_mesh_count = scene.animated_meshes.size() + scene.meshes.size();
-	auto total_bone_count = 0;
+			auto command_count = batch.instance_count * sub_mesh_count;
 
-	for (auto const & mesh_instance : scene.animated_meshes) {
-		total_bone_count += scene.asset_manager.get_animated_mesh(mesh_instance.mesh_handle).bones.size();
+			indirect_groups.push_back({ i, alpha_masked, command_offset, command_count });
+			command_offset += command_count;
+		}
 	}
 
+	// Storage Buffers are tightly packed (std430), Vulkan does not allow empty Buffers
+	auto size_cull_commands = Math::max(cull_model_count, 1) * sizeof(IndexedIndirectCommand);
+	auto size_cull_models   = Math::max(cull_model_count, 1) * sizeof(Model);
+	auto size_cull_draws    = Math::max(cull_model_count, 1) * sizeof(InstanceDraw) * 2; // Separate ranges for the early and late phase
+	auto size_cull_counts   = Math::max(int(indirect_groups.size()), 1) * sizeof(u32);
+
+	auto size_instances = Math::max(int(scene.meshes.size()), 1) * sizeof(Instance);
+	auto size_materials = Math::max(int(scene.materials.size()), 1) * sizeof(MaterialData);
+
 	for (int i = 0; i < swapchain_image_count; i++) {
 		// Uniform Buffers
 		uniform_buffers.camera.push_back(VulkanMemory::Buffer(aligned_size_camera,
@@ -280,184 +537,174 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 		));
 
-		uniform_buffers.material.push_back(VulkanMemory::Buffer(total_mesh_count * aligned_size_material,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		));
-
 		uniform_buffers.sky.push_back(VulkanMemory::Buffer(aligned_size_sky,
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 		));
 
 		// Storage Buffers
-		storage_buffers.cull_commands.push_back(VulkanMemory::Buffer(total_mesh_count * aligned_size_cull_command,
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		storage_buffers.cull_commands.push_back(VulkanMemory::Buffer(size_cull_commands,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 		));
 
-		storage_buffers.cull_stats.push_back(VulkanMemory::Buffer(aligned_size_cull_stats,
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		storage_buffers.cull_stats.push_back(VulkanMemory::Buffer(sizeof(Stats),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT  | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		));
+
+		storage_buffers.cull_model.push_back(VulkanMemory::Buffer(size_cull_models,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 		));
 
-		storage_buffers.cull_model.push_back(VulkanMemory::Buffer(aligned_size_cull_model,
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, ////////////////////////////////////////////////////////////////////////////// VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+		storage_buffers.cull_draws.push_back(VulkanMemory::Buffer(size_cull_draws,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			gpu_driven ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		));
+
+		storage_buffers.cull_counts.push_back(VulkanMemory::Buffer(size_cull_counts,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 		));
 
-		scene.asset_manager.storage_buffer_bones.push_back(VulkanMemory::Buffer(total_bone_count * sizeof(Matrix4),
+
+		storage_buffers.materials.push_back(VulkanMemory::Buffer(size_materials,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		));
+
+		Stats stats = { };
+		VulkanMemory::buffer_copy_direct(storage_buffers.cull_stats.back(), &stats, sizeof(Stats));
+
+		scene.asset_manager.storage_buffer_instances.push_back(VulkanMemory::Buffer(size_instances,
 			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 		));
 	}
 
-	// Allocate and update Descriptor Sets
-	for (auto & texture : scene.asset_manager.textures) {
-		VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-		alloc_info.descriptorPool = descriptor_pool;
-		alloc_info.descriptorSetCount = 1;
-		alloc_info.pSetLayouts        = &descriptor_set_layouts.geometry;
+	materials_versions.resize(swapchain_image_count);
+	for (int i = 0; i < swapchain_image_count; i++) materials_upload(i);
 
-		VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &texture.descriptor_set));
+	if (gpu_driven) {
+		storage_buffers.cull_visibility = VulkanMemory::Buffer(Math::max(cull_model_count, 1) * sizeof(u32),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
 
-		VkDescriptorImageInfo image_info;
-		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		image_info.imageView = texture.image_view;
-		image_info.sampler   = texture.sampler;
+		// Nothing was visible before the first Frame, the late phase then draws everything that passes the occlusion test
+		auto command_buffer = VulkanMemory::command_buffer_single_use_begin();
+		vkCmdFillBuffer(command_buffer, storage_buffers.cull_visibility.buffer, 0, VK_WHOLE_SIZE, 0);
+		VulkanMemory::command_buffer_single_use_end(command_buffer);
 
-		VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-		write_descriptor_set.dstSet = texture.descriptor_set;
-		write_descriptor_set.dstBinding = 1;
-		write_descriptor_set.dstArrayElement = 0;
-		write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		write_descriptor_set.descriptorCount = 1;
-		write_descriptor_set.pImageInfo      = &image_info;
+		depth_pyramid.init(descriptor_allocator, width, height, render_target.attachments[GBUFFER_ATTACHMENT_DEPTH].image_view);
 
-		vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+		descriptor_sets.depth_pyramid = descriptor_allocator.allocate(descriptor_set_layouts.depth_pyramid);
+		depth_pyramid_descriptor_update();
 	}
 
-	{
-		std::vector<VkDescriptorSetLayout> layouts(swapchain_image_count, descriptor_set_layouts.cull);
+	// Allocate and update Descriptor Sets
+	if (bindless) {
+		// Bindless Textures need a Descriptor Pool that allows updating after binding
+		VkDescriptorPoolSize descriptor_pool_size = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, u32(bindless_texture_count) };
+
+		VkDescriptorPoolCreateInfo pool_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+		pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		pool_create_info.poolSizeCount = 1;
+		pool_create_info.pPoolSizes    = &descriptor_pool_size;
+		pool_create_info.maxSets = 1;
+
+		VK_CHECK(vkCreateDescriptorPool(device, &pool_create_info, nullptr, &descriptor_pool_bindless));
 
 		VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-		alloc_info.descriptorPool = descriptor_pool;
-		alloc_info.descriptorSetCount = layouts.size();
-		alloc_info.pSetLayouts        = layouts.data();
+		alloc_info.descriptorPool = descriptor_pool_bindless;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts        = &descriptor_set_layouts.geometry;
+
+		VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set_bindless));
+	}
+
+	textures_written = 0;
+	textures_write(descriptor_allocator);
+
+	// Culling only happens in GPU driven mode, the Visibility Buffer does not exist otherwise
+	if (gpu_driven) {
+		struct {
+			VkDescriptorBufferInfo commands;
+			VkDescriptorBufferInfo camera;
+			VkDescriptorBufferInfo stats;
+			VkDescriptorBufferInfo model;
+			VkDescriptorBufferInfo draws;
+			VkDescriptorBufferInfo counts;
+			VkDescriptorBufferInfo visibility;
+		} descriptors;
+
+		DescriptorUpdateTemplate update_template;
+		update_template.init(descriptor_set_layouts.cull, {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), commands) },
+			{ 1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(decltype(descriptors), camera) },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), stats) },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), model) },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), draws) },
+			{ 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), counts) },
+			{ 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), visibility) }
+		});
 
 		descriptor_sets.cull.resize(swapchain_image_count);
-		VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets.cull.data()));
 
 		for (int i = 0; i < descriptor_sets.cull.size(); i++) {
-			auto descriptor_set = descriptor_sets.cull[i];
-
-			VkWriteDescriptorSet write_descriptors[4] = { };
-
-			VkDescriptorBufferInfo descriptor_commands = { };
-			descriptor_commands.buffer = storage_buffers.cull_commands[i].buffer;
-			descriptor_commands.offset = 0;
-			descriptor_commands.range = sizeof(IndexedIndirectCommand);
-
-			write_descriptors[0].sType = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-			write_descriptors[0].dstSet = descriptor_set;
-			write_descriptors[0].dstBinding = 0;
-			write_descriptors[0].dstArrayElement = 0;
-			write_descriptors[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-			write_descriptors[0].descriptorCount = 1;
-			write_descriptors[0].pBufferInfo     = &descriptor_commands;
-
-			VkDescriptorBufferInfo descriptor_camera = { };
-			descriptor_camera.buffer = uniform_buffers.camera[i].buffer;
-			descriptor_camera.offset = 0;
-			descriptor_camera.range = sizeof(CameraUBO);
-
-			write_descriptors[1].sType = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-			write_descriptors[1].dstSet = descriptor_set;
-			write_descriptors[1].dstBinding = 1;
-			write_descriptors[1].dstArrayElement = 0;
-			write_descriptors[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			write_descriptors[1].descriptorCount = 1;
-			write_descriptors[1].pBufferInfo     = &descriptor_camera;
-
-			VkDescriptorBufferInfo descriptor_stats = { };
-			descriptor_stats.buffer = storage_buffers.cull_stats[i].buffer;
-			descriptor_stats.offset = 0;
-			descriptor_stats.range = sizeof(CameraUBO);
-
-			write_descriptors[2].sType = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-			write_descriptors[2].dstSet = descriptor_set;
-			write_descriptors[2].dstBinding = 2;
-			write_descriptors[2].dstArrayElement = 0;
-			write_descriptors[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-			write_descriptors[2].descriptorCount = 1;
-			write_descriptors[2].pBufferInfo     = &descriptor_stats;
-
-			VkDescriptorBufferInfo descriptor_model = { };
-			descriptor_model.buffer = storage_buffers.cull_model[i].buffer;
-			descriptor_model.offset = 0;
-			descriptor_model.range = sizeof(CameraUBO);
-
-			write_descriptors[3].sType = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-			write_descriptors[3].dstSet = descriptor_set;
-			write_descriptors[3].dstBinding = 3;
-			write_descriptors[3].dstArrayElement = 0;
-			write_descriptors[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-			write_descriptors[3].descriptorCount = 1;
-			write_descriptors[3].pBufferInfo     = &descriptor_model;
-
-			vkUpdateDescriptorSets(device, Util::array_element_count(write_descriptors), write_descriptors, 0, nullptr);
+			descriptor_sets.cull[i] = descriptor_allocator.allocate(descriptor_set_layouts.cull);
+
+			descriptors.commands   = { storage_buffers.cull_commands[i].buffer, 0, VK_WHOLE_SIZE };
+			descriptors.camera     = { uniform_buffers.camera[i]       .buffer, 0, sizeof(CameraUBO) };
+			descriptors.stats      = { storage_buffers.cull_stats[i]   .buffer, 0, sizeof(Stats) };
+			descriptors.model      = { storage_buffers.cull_model[i]   .buffer, 0, VK_WHOLE_SIZE };
+			descriptors.draws      = { storage_buffers.cull_draws[i]   .buffer, 0, VK_WHOLE_SIZE };
+			descriptors.counts     = { storage_buffers.cull_counts[i]  .buffer, 0, VK_WHOLE_SIZE };
+			descriptors.visibility = { storage_buffers.cull_visibility.buffer, 0, VK_WHOLE_SIZE };
+
+			update_template.update(descriptor_sets.cull[i], &descriptors);
 		}
+
+		update_template.free();
 	}
 
 	{
-		std::vector<VkDescriptorSetLayout> layouts(swapchain_image_count, descriptor_set_layouts.material);
-
-		VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-		alloc_info.descriptorPool = descriptor_pool;
-		alloc_info.descriptorSetCount = layouts.size();
-		alloc_info.pSetLayouts        = layouts.data();
+		struct {
+			VkDescriptorBufferInfo instances;
+			VkDescriptorBufferInfo draws;
+		} descriptors;
 
-		descriptor_sets.material.resize(swapchain_image_count);
-		VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets.material.data()));
+		DescriptorUpdateTemplate update_template;
+		update_template.init(descriptor_set_layouts.instanced, {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), instances) },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(decltype(descriptors), draws) }
+		});
 
-		for (int i = 0; i < descriptor_sets.material.size(); i++) {
-			auto descriptor_set = descriptor_sets.material[i];
+		descriptor_sets.instanced.resize(swapchain_image_count);
 
-			VkDescriptorBufferInfo descriptor_ubo = { };
-			descriptor_ubo.buffer = uniform_buffers.material[i].buffer;
-			descriptor_ubo.offset = 0;
-			descriptor_ubo.range = sizeof(MaterialUBO);
+		for (int i = 0; i < descriptor_sets.instanced.size(); i++) {
+			descriptor_sets.instanced[i] = descriptor_allocator.allocate(descriptor_set_layouts.instanced);
 
-			VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-			write_descriptor_set.dstSet = descriptor_set;
-			write_descriptor_set.dstBinding = 0;
-			write_descriptor_set.dstArrayElement = 0;
-			write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-			write_descriptor_set.descriptorCount = 1;
-			write_descriptor_set.pBufferInfo     = &descriptor_ubo;
+			descriptors.instances = { scene.asset_manager.storage_buffer_instances[i].buffer, 0, VK_WHOLE_SIZE };
+			descriptors.draws     = { storage_buffers.cull_draws[i].buffer,                   0, VK_WHOLE_SIZE };
 
-			vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+			update_template.update(descriptor_sets.instanced[i], &descriptors);
 		}
+
+		update_template.free();
 	}
 
 	{
-		std::vector<VkDescriptorSetLayout> layouts(swapchain_image_count, descriptor_set_layouts.bones);
-
-		VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-		alloc_info.descriptorPool = descriptor_pool;
-		alloc_info.descriptorSetCount = layouts.size();
-		alloc_info.pSetLayouts        = layouts.data();
-
-		descriptor_sets.bones.resize(swapchain_image_count);
-		VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets.bones.data()));
+		descriptor_sets.material.resize(swapchain_image_count);
 
-		for (int i = 0; i < descriptor_sets.bones.size(); i++) {
-			auto descriptor_set = descriptor_sets.bones[i];
+		for (int i = 0; i < descriptor_sets.material.size(); i++) {
+			auto descriptor_set = descriptor_sets.material[i] = descriptor_allocator.allocate(descriptor_set_layouts.material);
 
 			VkDescriptorBufferInfo buffer_info = { };
-			buffer_info.buffer = scene.asset_manager.storage_buffer_bones[i].buffer;
+			buffer_info.buffer = storage_buffers.materials[i].buffer;
 			buffer_info.offset = 0;
-			buffer_info.range  = total_bone_count * sizeof(Matrix4);
+			buffer_info.range = VK_WHOLE_SIZE;
 
 			VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
 			write_descriptor_set.dstSet = descriptor_set;
@@ -472,34 +719,53 @@ void RenderTaskGBuffer::init(VkDescriptorPool descriptor_pool, int width, int he
 	}
 
 	{
-		std::vector<VkDescriptorSetLayout> layouts(swapchain_image_count, descriptor_set_layouts.sky);
-
-		VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-		alloc_info.descriptorPool = descriptor_pool;
-		alloc_info.descriptorSetCount = layouts.size();
-		alloc_info.pSetLayouts        = layouts.data();
+		sky_lut.init(descriptor_allocator);
 
 		descriptor_sets.sky.resize(swapchain_image_count);
-		VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets.sky.data()));
 
 		for (int i = 0; i < descriptor_sets.sky.size(); i++) {
-			auto descriptor_set = descriptor_sets.sky[i];
+			auto descriptor_set = descriptor_sets.sky[i] = descriptor_allocator.allocate(descriptor_set_layouts.sky);
 
 			VkDescriptorBufferInfo descriptor_ubo = { };
 			descriptor_ubo.buffer = uniform_buffers.sky[i].buffer;
 			descriptor_ubo.offset = 0;
 			descriptor_ubo.range = sizeof(SkyUBO);
 
-			VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-			write_descriptor_set.dstSet = descriptor_set;
-			write_descriptor_set.dstBinding = 0;
-			write_descriptor_set.dstArrayElement = 0;
-			write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			write_descriptor_set.descriptorCount = 1;
-			write_descriptor_set.pBufferInfo     = &descriptor_ubo;
+			VkDescriptorImageInfo descriptor_sky_view = { sky_lut.sampler, sky_lut.get_sky_view(), VK_IMAGE_LAYOUT_GENERAL };
+
+			VkWriteDescriptorSet write_descriptor_sets[2] = { };
+			write_descriptor_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write_descriptor_sets[0].dstSet = descriptor_set;
+			write_descriptor_sets[0].dstBinding = 0;
+			write_descriptor_sets[0].dstArrayElement = 0;
+			write_descriptor_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			write_descriptor_sets[0].descriptorCount = 1;
+			write_descriptor_sets[0].pBufferInfo     = &descriptor_ubo;
+
+			write_descriptor_sets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write_descriptor_sets[1].dstSet = descriptor_set;
+			write_descriptor_sets[1].dstBinding = 1;
+			write_descriptor_sets[1].dstArrayElement = 0;
+			write_descriptor_sets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write_descriptor_sets[1].descriptorCount = 1;
+			write_descriptor_sets[1].pImageInfo      = &descriptor_sky_view;
+
+			vkUpdateDescriptorSets(device, Util::array_element_count(write_descriptor_sets), write_descriptor_sets, 0, nullptr);
+		}
+	}
 
-			vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+	if (visibility) {
+		std::vector<VkBuffer> buffers_instances(swapchain_image_count);
+		std::vector<VkBuffer> buffers_draws    (swapchain_image_count);
+		std::vector<VkBuffer> buffers_materials(swapchain_image_count);
+
+		for (int i = 0; i < swapchain_image_count; i++) {
+			buffers_instances[i] = scene.asset_manager.storage_buffer_instances[i].buffer;
+			buffers_draws    [i] = storage_buffers.cull_draws[i].buffer;
+			buffers_materials[i] = storage_buffers.materials [i].buffer;
 		}
+
+		visibility_buffer.descriptor_sets_update(buffers_instances, buffers_draws, buffers_materials);
 	}
 }
 
@@ -511,165 +777,475 @@ void RenderTaskGBuffer::free() {
 	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.cull,     nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.geometry, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.material, nullptr);
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.bones,    nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.sky,      nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.instanced, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.depth_pyramid, nullptr);
 
 	vkDestroyPipelineLayout(device, pipeline_layouts.cull,              nullptr);
 	vkDestroyPipelineLayout(device, pipeline_layouts.geometry_static,   nullptr);
 	vkDestroyPipelineLayout(device, pipeline_layouts.geometry_animated, nullptr);
 	vkDestroyPipelineLayout(device, pipeline_layouts.sky,               nullptr);
 
-	vkDestroyPipeline(device, pipelines.cull,              nullptr);
-	vkDestroyPipeline(device, pipelines.geometry_static,   nullptr);
-	vkDestroyPipeline(device, pipelines.geometry_animated, nullptr);
-	vkDestroyPipeline(device, pipelines.sky,               nullptr);
+	VulkanContext::destroy_pipeline(pipelines.cull);
+	VulkanContext::destroy_pipeline(pipelines.geometry_static);
+	VulkanContext::destroy_pipeline(pipelines.geometry_static_masked);
+	VulkanContext::destroy_pipeline(pipelines.geometry_animated);
+	VulkanContext::destroy_pipeline(pipelines.sky);
+
+	uniform_buffers.camera.clear();
+	uniform_buffers.sky   .clear();
 
-	uniform_buffers.material.clear();
-	uniform_buffers.sky     .clear();
+	storage_buffers.cull_commands.clear();
+	storage_buffers.cull_stats   .clear();
+	storage_buffers.cull_model   .clear();
+	storage_buffers.cull_draws   .clear();
+	storage_buffers.cull_counts  .clear();
+	storage_buffers.materials.clear();
+
+	if (gpu_driven) {
+		storage_buffers.cull_visibility = VulkanMemory::Buffer();
+
+		depth_pyramid.free();
+	}
 
-	vkDestroyRenderPass(device, render_pass, nullptr);
+	sky_lut.free();
+
+	if (bindless) vkDestroyDescriptorPool(device, descriptor_pool_bindless, nullptr);
+
+	if (visibility) {
+		visibility_buffer.free();
+
+		VulkanContext::destroy_render_pass(render_pass_resolve);
+	}
+
+	VulkanContext::destroy_render_pass(render_pass);
+	VulkanContext::destroy_render_pass(render_pass_load);
 }
 
-void RenderTaskGBuffer::render(int image_index, VkCommandBuffer command_buffer) {
-	VkRenderPassBeginInfo render_pass_begin_info = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-	render_pass_begin_info.renderPass =  render_pass;
-	render_pass_begin_info.framebuffer = render_target.frame_buffer;
-	render_pass_begin_info.renderArea.extent.width  = width;
-	render_pass_begin_info.renderArea.extent.height = height;
-	render_pass_begin_info.clearValueCount = render_target.clear_values.size();
-	render_pass_begin_info.pClearValues    = render_target.clear_values.data();
+void RenderTaskGBuffer::resize(int width, int height) {
+	this->width  = width;
+	this->height = height;
 
-	vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	render_target.resize(width, height, render_pass);
 
-	auto last_texture_handle = -1;
+	if (gpu_driven) {
+		depth_pyramid.resize(width, height, render_target.attachments[GBUFFER_ATTACHMENT_DEPTH].image_view);
+		depth_pyramid_descriptor_update();
+	}
 
-	auto & uniform_buffer_material = uniform_buffers.material[image_index];
-	auto & descriptor_set_material = descriptor_sets.material[image_index];
+	if (visibility) visibility_buffer.resize(width, height, render_target.attachments[GBUFFER_ATTACHMENT_DEPTH].image_view);
+}
 
-	auto aligned_size = Math::round_up(sizeof(MaterialUBO), VulkanContext::get_min_uniform_buffer_alignment());
-	auto total_mesh_count = scene.animated_meshes.size() + scene.meshes.size();
+void RenderTaskGBuffer::depth_pyramid_descriptor_update() {
+	VkDescriptorImageInfo image_info;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	image_info.imageView = depth_pyramid.image_view;
+	image_info.sampler   = depth_pyramid.sampler;
+
+	VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	write_descriptor_set.dstSet = descriptor_sets.depth_pyramid;
+	write_descriptor_set.dstBinding = 0;
+	write_descriptor_set.dstArrayElement = 0;
+	write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write_descriptor_set.descriptorCount = 1;
+	write_descriptor_set.pImageInfo      = &image_info;
+
+	vkUpdateDescriptorSets(VulkanContext::get_device(), 1, &write_descriptor_set, 0, nullptr);
+}
 
-	std::vector<std::byte> buffer_material_ubo(total_mesh_count * aligned_size);
-	std::vector<std::byte> buffer_bones;
+void RenderTaskGBuffer::materials_upload(int image_index) {
+	std::vector<MaterialData> materials(scene.materials.size());
 
-	auto num_unculled_mesh_instances = 0;
-	auto bone_offset = 0;
+	for (int i = 0; i < scene.materials.size(); i++) {
+		materials[i].roughness = scene.materials[i]->roughness;
+		materials[i].metallic  = scene.materials[i]->metallic;
+	}
 
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.geometry_animated);
+	if (materials.size() > 0) VulkanMemory::buffer_copy_direct(storage_buffers.materials[image_index], materials.data(), materials.size() * sizeof(MaterialData));
 
-	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_animated, 2, 1, &descriptor_sets.bones[image_index], 0, nullptr);
+	materials_versions[image_index] = scene.materials_version;
+}
 
-	for (int i = 0; i < scene.animated_meshes.size(); i++) {
-		auto const & mesh_instance = scene.animated_meshes[i];
-		auto const & mesh          = scene.asset_manager.get_animated_mesh(mesh_instance.mesh_handle);
+void RenderTaskGBuffer::cull(int image_index, VkCommandBuffer command_buffer, bool async) {
+	PROFILE_SCOPE("RenderTaskGBuffer::cull");
 
-		GBufferPushConstants push_constants = { };
-		push_constants.world           = mesh_instance.transform.matrix;
-		push_constants.view_projection = scene.camera.get_view_projection();
-		push_constants.bone_offset = bone_offset;
+	cull_async     = async;
+	cull_occlusion = occlusion_culling && !async;
 
-		vkCmdPushConstants(command_buffer, pipeline_layouts.geometry_animated, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GBufferPushConstants), &push_constants);
+	auto const & buffer_stats = storage_buffers.cull_stats[image_index];
 
-		auto ubo = reinterpret_cast<MaterialUBO *>(&buffer_material_ubo[num_unculled_mesh_instances * aligned_size]);
-		ubo->material_roughness = mesh_instance.material->roughness;
-		ubo->material_metallic  = mesh_instance.material->metallic;
+	// The previous Frame that used these Buffers is done, read back its result
+	auto stats = reinterpret_cast<Stats const *>(VulkanMemory::buffer_map(buffer_stats, sizeof(Stats)));
+	cull_stats_gpu.drawn            = stats->draw_count;
+	cull_stats_gpu.drawn_late       = stats->draw_count_late;
+	cull_stats_gpu.culled_frustum   = stats->culled_frustum;
+	cull_stats_gpu.culled_occlusion = stats->culled_occlusion;
+	VulkanMemory::buffer_unmap(buffer_stats);
 
-		u32 offset = num_unculled_mesh_instances * aligned_size;
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_animated, 1, 1, &descriptor_set_material, 1, &offset);
-		num_unculled_mesh_instances++;
+	// Upload Camera and Models
+	CameraUBO camera_ubo = { };
+	for (int i = 0; i < 6; i++) {
+		auto const & plane = scene.camera.frustum.planes[i];
+		camera_ubo.frustum_planes[i] = Vector4(plane.n.x, plane.n.y, plane.n.z, plane.d);
+	}
+	VulkanMemory::buffer_copy_direct(uniform_buffers.camera[image_index], &camera_ubo, sizeof(CameraUBO));
 
-		VkBuffer     vertex_buffers[] = { mesh.vertex_buffer.buffer };
-		VkDeviceSize vertex_offsets[] = { 0 };
-		vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offsets);
+	std::vector<Model> models;
+	models.reserve(cull_model_count);
 
-		vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	for (int group_index = 0; group_index < indirect_groups.size(); group_index++) {
+		auto const & group = indirect_groups[group_index];
+		auto const & batch = scene.mesh_batches[group.batch_index];
+		auto const & mesh  = scene.asset_manager.get_mesh(batch.mesh_handle);
 
-		buffer_bones.resize(buffer_bones.size() + mesh.bones.size() * sizeof(Matrix4));
-		std::memcpy(buffer_bones.data() + bone_offset * sizeof(Matrix4), mesh_instance.bone_transforms.data(), mesh_instance.bone_transforms.size() * sizeof(Matrix4));
+		for (int slot = batch.instance_offset; slot < batch.instance_offset + batch.instance_count; slot++) {
+			auto const & mesh_instance = scene.meshes[scene.mesh_batch_instances[slot]];
 
-		for (int j = 0; j < mesh.sub_meshes.size(); j++) {
-			auto const & sub_mesh = mesh.sub_meshes[j];
+			auto     transform = mesh_instance.transform.matrix;
+			auto abs_transform = Matrix4::abs(transform);
 
-			if (last_texture_handle != sub_mesh.texture_handle) {
-				last_texture_handle  = sub_mesh.texture_handle;
+			for (auto const & sub_mesh : mesh.sub_meshes) {
+				if (sub_mesh.alpha_masked != group.alpha_masked) continue;
 
-				auto const & texture = scene.asset_manager.textures[sub_mesh.texture_handle];
-				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_animated, 0, 1, &texture.descriptor_set, 0, nullptr);
+				auto center = 0.5f * (sub_mesh.aabb.min + sub_mesh.aabb.max);
+				auto extent = 0.5f * (sub_mesh.aabb.max - sub_mesh.aabb.min);
+
+				Model model = { };
+				model.aabb_center = Matrix4::transform_position (    transform, center);
+				model.aabb_extent = Matrix4::transform_direction(abs_transform, extent);
+				model.index_count = sub_mesh.index_count;
+				model.first_index = sub_mesh.index_offset;
+
+				model.instance_index = slot;
+				model.texture_index  = sub_mesh.texture_handle;
+				model.group_index    = group_index;
+				model.group_offset   = group.command_offset;
+
+				if (visibility) {
+					model.geometry_first_vertex = visibility_buffer.mesh_offsets[batch.mesh_handle].first_vertex;
+					model.geometry_first_index  = visibility_buffer.mesh_offsets[batch.mesh_handle].first_index;
+				}
+
+				models.push_back(model);
 			}
+		}
+	}
 
-			vkCmdDrawIndexed(command_buffer, sub_mesh.index_count, 1, sub_mesh.index_offset, 0, 0);
+	if (models.size() > 0) VulkanMemory::buffer_copy_direct(storage_buffers.cull_model[image_index], models.data(), models.size() * sizeof(Model));
+
+	// Stats accumulate over both phases, Counts are cleared per phase
+	vkCmdFillBuffer(command_buffer, buffer_stats.buffer, 0, sizeof(Stats), 0);
+
+	cull_dispatch(image_index, command_buffer, cull_occlusion ? CULL_PHASE_EARLY : CULL_PHASE_FRUSTUM);
+}
+
+void RenderTaskGBuffer::cull_dispatch(int image_index, VkCommandBuffer command_buffer, unsigned phase) {
+	auto const & buffer_commands   = storage_buffers.cull_commands  [image_index];
+	auto const & buffer_stats      = storage_buffers.cull_stats     [image_index];
+	auto const & buffer_draws      = storage_buffers.cull_draws     [image_index];
+	auto const & buffer_counts     = storage_buffers.cull_counts    [image_index];
+	auto const & buffer_visibility = storage_buffers.cull_visibility;
+
+	// The late phase overwrites the output of the early phase, wait until it has been drawn
+	if (phase == CULL_PHASE_LATE) {
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+	}
+
+	vkCmdFillBuffer(command_buffer, buffer_counts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+	// Stats and Counts are cleared by transfers, Stats and Visibility may have been written by a previous phase
+	VkBufferMemoryBarrier barriers_input[3] = { };
+	barriers_input[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barriers_input[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barriers_input[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT    | VK_ACCESS_SHADER_WRITE_BIT;
+	barriers_input[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers_input[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers_input[0].buffer = buffer_stats.buffer;
+	barriers_input[0].offset = 0;
+	barriers_input[0].size   = VK_WHOLE_SIZE;
+
+	barriers_input[1] = barriers_input[0];
+	barriers_input[1].buffer = buffer_counts.buffer;
+
+	barriers_input[2] = barriers_input[0];
+	barriers_input[2].buffer = buffer_visibility.buffer;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, Util::array_element_count(barriers_input), barriers_input, 0, nullptr);
+
+	// Dispatch
+	CullPushConstants push_constants = { };
+	push_constants.view_projection = scene.camera.get_view_projection();
+	push_constants.model_count = cull_model_count;
+	push_constants.phase       = phase;
+
+	if (gpu_driven) {
+		push_constants.pyramid_width     = depth_pyramid.width;
+		push_constants.pyramid_height    = depth_pyramid.height;
+		push_constants.pyramid_mip_count = depth_pyramid.mip_count;
+	}
+
+	VkDescriptorSet descriptor_sets_cull[2] = {
+		descriptor_sets.cull[image_index],
+		descriptor_sets.depth_pyramid
+	};
+
+	vkCmdBindPipeline      (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.cull);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layouts.cull, 0, Util::array_element_count(descriptor_sets_cull), descriptor_sets_cull, 0, nullptr);
+	vkCmdPushConstants     (command_buffer, pipeline_layouts.cull, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &push_constants);
+
+	constexpr int CULL_GROUP_SIZE = 64; // Matches local_size_x in cull.comp
+
+	vkCmdDispatch(command_buffer, (cull_model_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// The Stats are read back on the host once the Frame is done
+	VkBufferMemoryBarrier barrier_stats = barriers_input[0];
+	barrier_stats.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_stats.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier_stats, 0, nullptr);
+
+	// The Commands, Counts and Draws are consumed by the graphics Queue, when culling asynchronously this releases ownership of the Buffers
+	// The matching acquire is recorded at the start of render. Only the compute Queue writes the Buffers, so ownership never needs to be transferred back
+	auto async = cull_async && phase == CULL_PHASE_FRUSTUM;
+
+	VkBufferMemoryBarrier barriers_output[3] = { };
+	barriers_output[0] = barriers_input[0];
+	barriers_output[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers_output[0].dstAccessMask = async ? 0 : VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barriers_output[0].srcQueueFamilyIndex = async ? VulkanContext::get_queue_family_compute()  : VK_QUEUE_FAMILY_IGNORED;
+	barriers_output[0].dstQueueFamilyIndex = async ? VulkanContext::get_queue_family_graphics() : VK_QUEUE_FAMILY_IGNORED;
+	barriers_output[0].buffer = buffer_commands.buffer;
+
+	barriers_output[1] = barriers_output[0];
+	barriers_output[1].buffer = buffer_counts.buffer;
+
+	barriers_output[2] = barriers_output[0];
+	barriers_output[2].dstAccessMask = async ? 0 : VK_ACCESS_SHADER_READ_BIT;
+	barriers_output[2].buffer = buffer_draws.buffer;
+
+	// The Visibility Buffer resolve also reads the Draws
+	auto stage_dst = async ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, stage_dst, 0, 0, nullptr, Util::array_element_count(barriers_output), barriers_output, 0, nullptr);
+}
+
+void RenderTaskGBuffer::textures_write(DescriptorAllocator & descriptor_allocator) {
+	auto device = VulkanContext::get_device();
+
+	auto texture_count = int(scene.asset_manager.textures.size());
+	if (texture_count == textures_written) return;
+
+	if (bindless) {
+		// The array is partially bound, only the elements up to the number of Textures are written
+		std::vector<VkDescriptorImageInfo> image_infos(texture_count - textures_written);
+
+		for (int i = 0; i < image_infos.size(); i++) {
+			auto const & texture = scene.asset_manager.textures[textures_written + i];
+
+			image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			image_infos[i].imageView = texture.image_view;
+			image_infos[i].sampler   = texture.sampler;
 		}
 
-		bone_offset += mesh.bones.size();
+		VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write_descriptor_set.dstSet = descriptor_set_bindless;
+		write_descriptor_set.dstBinding = 1;
+		write_descriptor_set.dstArrayElement = textures_written;
+		write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write_descriptor_set.descriptorCount = image_infos.size();
+		write_descriptor_set.pImageInfo      = image_infos.data();
+
+		vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+	} else for (int i = textures_written; i < texture_count; i++) {
+		auto & texture = scene.asset_manager.textures[i];
+
+		texture.descriptor_set = descriptor_allocator.allocate(descriptor_set_layouts.geometry);
+
+		VkDescriptorImageInfo image_info;
+		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_info.imageView = texture.image_view;
+		image_info.sampler   = texture.sampler;
+
+		VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write_descriptor_set.dstSet = texture.descriptor_set;
+		write_descriptor_set.dstBinding = 1;
+		write_descriptor_set.dstArrayElement = 0;
+		write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write_descriptor_set.descriptorCount = 1;
+		write_descriptor_set.pImageInfo      = &image_info;
+
+		vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
 	}
 
-	if (buffer_bones.size() > 0) VulkanMemory::buffer_copy_direct(scene.asset_manager.storage_buffer_bones[image_index], buffer_bones.data(), buffer_bones.size());
+	textures_written = texture_count;
+}
 
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.geometry_static);
+bool RenderTaskGBuffer::textures_update(DescriptorAllocator & descriptor_allocator) {
+	// The bindless array was sized at init, only recreating the Render Tasks can switch to one Set per Texture
+	if (bindless && int(scene.asset_manager.textures.size()) > bindless_texture_count) {
+		printf("WARNING: Loaded Textures no longer fit in the %i bindless Textures!\n", bindless_texture_count);
+		return false;
+	}
 
-	for (int i = 0; i < scene.meshes.size(); i++) {
-		auto const & mesh_instance = scene.meshes[i];
-		auto const & mesh          = scene.asset_manager.get_mesh(mesh_instance.mesh_handle);
+	textures_write(descriptor_allocator);
 
-		auto     transform = mesh_instance.transform.matrix;
-		auto abs_transform = Matrix4::abs(transform);
+	return true;
+}
 
-		auto first_sub_mesh = true;
+void RenderTaskGBuffer::sky_lut_update(VkCommandBuffer command_buffer) {
+	sky_lut.update(command_buffer, -scene.directional_lights[0].get_direction());
+}
 
-		for (int j = 0; j < mesh.sub_meshes.size(); j++) {
-			auto const & sub_mesh = mesh.sub_meshes[j];
+void RenderTaskGBuffer::render(int image_index, VkCommandBuffer command_buffer) {
+	PROFILE_SCOPE("RenderTaskGBuffer::render");
+
+	// Acquire ownership of the Commands, Counts and Draws written on the compute Queue
+	if (gpu_driven && cull_async) {
+		VkBufferMemoryBarrier barriers_output[3] = { };
+		barriers_output[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barriers_output[0].srcAccessMask = 0;
+		barriers_output[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		barriers_output[0].srcQueueFamilyIndex = VulkanContext::get_queue_family_compute();
+		barriers_output[0].dstQueueFamilyIndex = VulkanContext::get_queue_family_graphics();
+		barriers_output[0].buffer = storage_buffers.cull_commands[image_index].buffer;
+		barriers_output[0].offset = 0;
+		barriers_output[0].size   = VK_WHOLE_SIZE;
+
+		barriers_output[1] = barriers_output[0];
+		barriers_output[1].buffer = storage_buffers.cull_counts[image_index].buffer;
+
+		barriers_output[2] = barriers_output[0];
+		barriers_output[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barriers_output[2].buffer = storage_buffers.cull_draws[image_index].buffer;
+
+		// The source stage matches the stage at which the graphics Queue waits for the compute Queue's Semaphore
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, Util::array_element_count(barriers_output), barriers_output, 0, nullptr);
+	}
 
-			// Transform AABB into world space for culling
-			auto center = 0.5f * (sub_mesh.aabb.min + sub_mesh.aabb.max);
-			auto extent = 0.5f * (sub_mesh.aabb.max - sub_mesh.aabb.min);
+	// Materials rarely change, so their Buffer is only uploaded again after an edit
+	if (materials_versions[image_index] != scene.materials_version) materials_upload(image_index);
 
-			auto new_center = Matrix4::transform_position (    transform, center);
-			auto new_extent = Matrix4::transform_direction(abs_transform, extent);
+	// Upload Instances in MeshBatch order, also read by the Shadow pass
+	std::vector<Instance> instances(scene.meshes.size());
 
-			auto aabb_world_min = new_center - new_extent;
-			auto aabb_world_max = new_center + new_extent;
+	for (int i = 0; i < scene.mesh_batch_instances.size(); i++) {
+		auto const & mesh_instance = scene.meshes[scene.mesh_batch_instances[i]];
 
-			if (scene.camera.frustum.intersect_aabb(aabb_world_min, aabb_world_max) == Frustum::IntersectionType::FULLY_OUTSIDE) continue;
+		instances[i].world          = mesh_instance.transform.matrix;
+		instances[i].material_index = mesh_instance.material->id;
+	}
 
-			// The first unculled Submesh must set the Push Constants, bind Descriptor Sets, and bind Vertex/Index Buffers
-			if (first_sub_mesh) {
-				first_sub_mesh = false;
+	if (instances.size() > 0) VulkanMemory::buffer_copy_direct(scene.asset_manager.storage_buffer_instances[image_index], instances.data(), instances.size() * sizeof(Instance));
 
-				GBufferPushConstants push_constants = { };
-				push_constants.world = transform;
-				push_constants.wvp   = scene.camera.get_view_projection() * transform;
+	// In Visibility Buffer mode static geometry is drawn into the Visibility Buffer, which shares its Depth with the GBuffer
+	auto         frame_buffer = visibility ? visibility_buffer.frame_buffer : render_target.frame_buffer;
+	auto const & clear_values = visibility ? visibility_buffer.clear_values : render_target.clear_values;
 
-				vkCmdPushConstants(command_buffer, pipeline_layouts.geometry_static, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GBufferPushConstants), &push_constants);
+	render_pass_begin(command_buffer, visibility ? visibility_buffer.render_pass : render_pass, frame_buffer, clear_values);
 
-				auto ubo = reinterpret_cast<MaterialUBO *>(&buffer_material_ubo[num_unculled_mesh_instances * aligned_size]);
-				ubo->material_roughness = mesh_instance.material->roughness;
-				ubo->material_metallic  = mesh_instance.material->metallic;
+	draw_list_build(image_index);
 
-				u32 offset = num_unculled_mesh_instances * aligned_size;
-				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_static, 1, 1, &descriptor_set_material, 1, &offset);
-				num_unculled_mesh_instances++;
+	// GPU driven static geometry is drawn before the animated Meshes, which are alpha tested
+	if (gpu_driven) render_indirect(image_index, command_buffer);
 
-				VkBuffer     vertex_buffers[] = { mesh.vertex_buffer.buffer };
-				VkDeviceSize vertex_offsets[] = { 0 };
-				vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offsets);
+	// Animated Meshes are not part of the Visibility Buffer, they are drawn after the resolve
+	draw_list_record(image_index, command_buffer, true, !visibility);
 
-				vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-			}
+	if (gpu_driven && cull_occlusion) {
+		vkCmdEndRenderPass(command_buffer);
 
-			if (last_texture_handle != sub_mesh.texture_handle) {
-				last_texture_handle  = sub_mesh.texture_handle;
+		auto const & depth = render_target.attachments[GBUFFER_ATTACHMENT_DEPTH];
 
-				auto const & texture = scene.asset_manager.textures[sub_mesh.texture_handle];
-				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_static, 0, 1, &texture.descriptor_set, 0, nullptr);
-			}
+		// Depth written by the early phase is downsampled into the Depth Pyramid
+		VkImageMemoryBarrier barrier_depth = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+		barrier_depth.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barrier_depth.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier_depth.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier_depth.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier_depth.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier_depth.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier_depth.image = depth.image;
+		barrier_depth.subresourceRange.aspectMask = get_depth_aspect(depth.format);
+		barrier_depth.subresourceRange.baseMipLevel = 0;
+		barrier_depth.subresourceRange.levelCount   = 1;
+		barrier_depth.subresourceRange.baseArrayLayer = 0;
+		barrier_depth.subresourceRange.layerCount     = 1;
 
-			vkCmdDrawIndexed(command_buffer, sub_mesh.index_count, 1, sub_mesh.index_offset, 0, 0);
-		}
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier_depth);
+
+		depth_pyramid.build(command_buffer);
+
+		cull_dispatch(image_index, command_buffer, CULL_PHASE_LATE);
+
+		// The late phase continues rendering into the same depth buffer
+		barrier_depth.srcAccessMask = 0;
+		barrier_depth.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barrier_depth.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier_depth.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier_depth);
+
+		render_pass_begin(command_buffer, visibility ? visibility_buffer.render_pass_load : render_pass_load, frame_buffer, clear_values);
+		render_indirect(image_index, command_buffer);
+	}
+
+	// The Render Pass is continued by resolve
+	if (visibility) {
+		vkCmdEndRenderPass(command_buffer);
+		return;
 	}
 
-	if (num_unculled_mesh_instances > 0) VulkanMemory::buffer_copy_direct(uniform_buffer_material, buffer_material_ubo.data(), num_unculled_mesh_instances * aligned_size);
+	render_sky(image_index, command_buffer);
+
+	vkCmdEndRenderPass(command_buffer);
+}
+
+void RenderTaskGBuffer::resolve(int image_index, VkCommandBuffer command_buffer) {
+	PROFILE_SCOPE("RenderTaskGBuffer::resolve");
+
+	auto const & depth = render_target.attachments[GBUFFER_ATTACHMENT_DEPTH];
+
+	// The resolve reads the ids, the animated Meshes and the Sky are depth tested against the static geometry
+	VkImageMemoryBarrier barriers[2] = { };
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = visibility_buffer.image;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount   = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount     = 1;
+
+	barriers[1] = barriers[0];
+	barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[1].image = depth.image;
+	barriers[1].subresourceRange.aspectMask = get_depth_aspect(depth.format);
+
+	vkCmdPipelineBarrier(command_buffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		0, 0, nullptr, 0, nullptr, Util::array_element_count(barriers), barriers
+	);
+
+	render_pass_begin(command_buffer, render_pass_resolve, render_target.frame_buffer, render_target.clear_values);
+
+	visibility_buffer.resolve(image_index, command_buffer, scene.camera.get_view_projection(), descriptor_set_bindless);
 
-	// Render Sky
+	draw_list_record(image_index, command_buffer, false, true);
+
+	render_sky(image_index, command_buffer);
+
+	vkCmdEndRenderPass(command_buffer);
+}
+
+void RenderTaskGBuffer::render_sky(int image_index, VkCommandBuffer command_buffer) {
 	auto const & uniform_buffer_sky = uniform_buffers.sky[image_index];
 	auto const & descriptor_set_sky = descriptor_sets.sky[image_index];
 
@@ -685,6 +1261,252 @@ void RenderTaskGBuffer::render(int image_index, VkCommandBuffer command_buffer)
 	VulkanMemory::buffer_copy_direct(uniform_buffer_sky, &sky_ubo, sizeof(sky_ubo));
 
 	vkCmdDraw(command_buffer, 3, 1, 0, 0);
+}
 
-	vkCmdEndRenderPass(command_buffer);
+void RenderTaskGBuffer::render_pass_begin(VkCommandBuffer command_buffer, VkRenderPass pass, VkFramebuffer frame_buffer, std::vector<VkClearValue> const & clear_values) {
+	VkRenderPassBeginInfo render_pass_begin_info = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	render_pass_begin_info.renderPass =  pass;
+	render_pass_begin_info.framebuffer = frame_buffer;
+	render_pass_begin_info.renderArea.extent.width  = width;
+	render_pass_begin_info.renderArea.extent.height = height;
+	render_pass_begin_info.clearValueCount = clear_values.size();
+	render_pass_begin_info.pClearValues    = clear_values.data();
+
+	vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	VulkanContext::set_viewport(command_buffer, width, height);
+}
+
+void RenderTaskGBuffer::render_static_bind(int image_index, VkCommandBuffer command_buffer) {
+	auto const & descriptor_set_material = descriptor_sets.material[image_index];
+
+	// Each Instance stores the id of its Material, which the Fragment Shader looks up in the Materials Buffer
+	// The opaque and alpha masked Pipelines share a Pipeline Layout, so these stay bound when switching between them
+	if (bindless) {
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_static, 0, 1, &descriptor_set_bindless, 0, nullptr);
+	}
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_static, 1, 1, &descriptor_set_material,               0, nullptr);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_static, 2, 1, &descriptor_sets.instanced[image_index], 0, nullptr);
+
+	GBufferStaticPushConstants push_constants = { };
+	push_constants.view_projection = scene.camera.get_view_projection();
+
+	vkCmdPushConstants(command_buffer, pipeline_layouts.geometry_static, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GBufferStaticPushConstants), &push_constants);
+}
+
+void RenderTaskGBuffer::render_indirect(int image_index, VkCommandBuffer command_buffer) {
+	// Static geometry was culled on the GPU, draw all visible Submeshes of each group with a single indirect call
+	auto const & buffer_commands = storage_buffers.cull_commands[image_index];
+	auto const & buffer_counts   = storage_buffers.cull_counts  [image_index];
+
+	render_static_bind(image_index, command_buffer);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.geometry_static);
+
+	auto alpha_masked = false;
+
+	for (int i = 0; i < indirect_groups.size(); i++) {
+		auto const & group = indirect_groups[i];
+		auto const & mesh  = scene.asset_manager.get_mesh(scene.mesh_batches[group.batch_index].mesh_handle);
+
+		// Alpha masked groups come last
+		if (group.alpha_masked && !alpha_masked) {
+			alpha_masked = true;
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.geometry_static_masked);
+		}
+
+		VkBuffer     vertex_buffers[] = { mesh.vertex_buffer.buffer };
+		VkDeviceSize vertex_offsets[] = { 0 };
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offsets);
+
+		vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		vkCmdDrawIndexedIndirectCount(command_buffer,
+			buffer_commands.buffer, group.command_offset * sizeof(IndexedIndirectCommand),
+			buffer_counts  .buffer, i * sizeof(u32),
+			group.command_count, sizeof(IndexedIndirectCommand)
+		);
+	}
+}
+
+void RenderTaskGBuffer::draw_list_build(int image_index) {
+	PROFILE_SCOPE("RenderTaskGBuffer::draw_list_build");
+
+	draw_packets.clear();
+	draw_list   .clear();
+
+	auto const & camera_position = scene.camera.position;
+
+	// Animated Meshes, every instance has its own range of skinned Vertices
+	auto vertex_offset = 0;
+
+	for (int i = 0; i < scene.animated_meshes.size(); i++) {
+		auto const & mesh_instance = scene.animated_meshes[i];
+		auto const & mesh          = scene.asset_manager.get_animated_mesh(mesh_instance.mesh_handle);
+
+		auto depth = Vector3::length(mesh_instance.transform.position - camera_position);
+
+		for (int j = 0; j < mesh.sub_meshes.size(); j++) {
+			auto texture = bindless ? 0 : mesh.sub_meshes[j].texture_handle;
+
+			draw_list.add(DrawList::make_key(DRAW_PIPELINE_ANIMATED, texture, i, depth), draw_packets.size());
+			draw_packets.push_back({ true, i, j, 0, 1, vertex_offset });
+		}
+
+		vertex_offset += mesh.vertex_count;
+	}
+
+	if (gpu_driven) {
+		draw_list.sort();
+		return;
+	}
+
+	// Static geometry is frustum culled on the CPU using the Scene BVH, the visible instances of each Submesh of a MeshBatch become a single instanced draw
+	bvh_visible.clear();
+	scene.bvh.intersect_frustum(scene.camera.frustum, bvh_visible);
+	scene.bvh.sort_by_sub_mesh(bvh_visible);
+
+	std::vector<InstanceDraw> draws;
+	draws.reserve(bvh_visible.size());
+
+	for (int i = 0; i < bvh_visible.size(); ) {
+		auto const & first = scene.bvh.primitives[bvh_visible[i]];
+
+		auto const & batch    = scene.mesh_batches[first.batch_index];
+		auto const & mesh     = scene.asset_manager.get_mesh(batch.mesh_handle);
+		auto const & sub_mesh = mesh.sub_meshes[first.sub_mesh_index];
+
+		auto draw_offset = int(draws.size());
+		auto depth       = INFINITY; // Distance to the closest visible instance
+
+		// Only used by the Visibility Buffer resolve
+		auto first_index   = visibility ? visibility_buffer.mesh_offsets[batch.mesh_handle].first_index + sub_mesh.index_offset : 0u;
+		auto vertex_offset = visibility ? visibility_buffer.mesh_offsets[batch.mesh_handle].first_vertex                         : 0u;
+
+		for (; i < bvh_visible.size(); i++) {
+			auto const & primitive = scene.bvh.primitives[bvh_visible[i]];
+			if (primitive.batch_index != first.batch_index || primitive.sub_mesh_index != first.sub_mesh_index) break;
+
+			draws.push_back({ unsigned(primitive.slot), bindless ? unsigned(sub_mesh.texture_handle) : 0u, first_index, vertex_offset });
+
+			depth = Math::min(depth, Vector3::length(primitive.aabb.get_center() - camera_position));
+		}
+
+		auto draw_count = int(draws.size()) - draw_offset;
+
+		auto pipeline = sub_mesh.alpha_masked ? DRAW_PIPELINE_STATIC_MASKED : DRAW_PIPELINE_STATIC;
+		auto texture  = bindless ? 0 : sub_mesh.texture_handle;
+
+		draw_list.add(DrawList::make_key(pipeline, texture, first.batch_index, depth), draw_packets.size());
+		draw_packets.push_back({ false, first.batch_index, first.sub_mesh_index, draw_offset, draw_count, 0 });
+	}
+
+	if (draws.size() > 0) VulkanMemory::buffer_copy_direct(storage_buffers.cull_draws[image_index], draws.data(), draws.size() * sizeof(InstanceDraw));
+
+	draw_list.sort();
+}
+
+void RenderTaskGBuffer::draw_list_record(int image_index, VkCommandBuffer command_buffer, bool record_static, bool record_animated) {
+	PROFILE_SCOPE("RenderTaskGBuffer::draw_list_record");
+
+	auto const & descriptor_set_material = descriptor_sets.material[image_index];
+
+	// Static and animated Pipeline Layouts are compatible for set 0, so the bindless Textures stay bound for both
+	if (bindless) {
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_animated, 0, 1, &descriptor_set_bindless, 0, nullptr);
+	}
+
+	// State is only changed when it differs from the previous draw, which the sort order makes rare
+	auto last_pipeline       = -1;
+	auto last_mesh           = -1;
+	auto last_texture_handle = -1;
+	auto last_material       = -1;
+
+	for (auto const & packet_sorted : draw_list.packets) {
+		auto const & packet = draw_packets[packet_sorted.index];
+
+		if (packet.animated ? !record_animated : !record_static) continue;
+
+		auto pipeline = int(packet_sorted.key >> 60);
+		if (pipeline != last_pipeline) {
+			last_pipeline = pipeline;
+
+			last_mesh           = -1;
+			last_texture_handle = -1;
+			last_material       = -1;
+
+			if (packet.animated) {
+				vkCmdBindPipeline      (command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.geometry_animated);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_animated, 1, 1, &descriptor_set_material, 0, nullptr);
+			} else {
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline == DRAW_PIPELINE_STATIC_MASKED ? pipelines.geometry_static_masked : pipelines.geometry_static);
+				render_static_bind(image_index, command_buffer);
+			}
+		}
+
+		if (packet.animated) {
+			auto const & mesh_instance = scene.animated_meshes[packet.mesh_index];
+			auto const & mesh          = scene.asset_manager.get_animated_mesh(mesh_instance.mesh_handle);
+			auto const & sub_mesh      = mesh.sub_meshes[packet.sub_mesh_index];
+
+			// The first Submesh of an instance sets the Push Constants and binds Vertex/Index Buffers
+			if (last_mesh != packet.mesh_index) {
+				last_mesh  = packet.mesh_index;
+
+				GBufferPushConstants push_constants = { };
+				push_constants.world           = mesh_instance.transform.matrix;
+				push_constants.view_projection = scene.camera.get_view_projection();
+
+				vkCmdPushConstants(command_buffer, pipeline_layouts.geometry_animated, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GBufferPushConstants), &push_constants);
+
+				VkBuffer     vertex_buffers[] = { scene.asset_manager.storage_buffer_skinned[image_index].buffer };
+				VkDeviceSize vertex_offsets[] = { packet.vertex_offset * sizeof(Mesh::Vertex) };
+				vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offsets);
+
+				vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			}
+
+			if (last_texture_handle != sub_mesh.texture_handle || last_material != mesh_instance.material->id) {
+				if (!bindless && last_texture_handle != sub_mesh.texture_handle) {
+					auto const & texture = scene.asset_manager.textures[sub_mesh.texture_handle];
+					vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_animated, 0, 1, &texture.descriptor_set, 0, nullptr);
+				}
+
+				last_texture_handle = sub_mesh.texture_handle;
+				last_material       = mesh_instance.material->id;
+
+				// Materials are referenced by id, the Materials Buffer is bound once
+				GBufferFragmentPushConstants push_constants_fragment = { };
+				push_constants_fragment.texture_index  = bindless ? sub_mesh.texture_handle : 0;
+				push_constants_fragment.material_index = mesh_instance.material->id;
+
+				vkCmdPushConstants(command_buffer, pipeline_layouts.geometry_animated, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(GBufferPushConstants), sizeof(GBufferFragmentPushConstants), &push_constants_fragment);
+			}
+
+			vkCmdDrawIndexed(command_buffer, sub_mesh.index_count, 1, sub_mesh.index_offset, 0, 0);
+		} else {
+			auto const & batch    = scene.mesh_batches[packet.mesh_index];
+			auto const & mesh     = scene.asset_manager.get_mesh(batch.mesh_handle);
+			auto const & sub_mesh = mesh.sub_meshes[packet.sub_mesh_index];
+
+			if (last_mesh != packet.mesh_index) {
+				last_mesh  = packet.mesh_index;
+
+				VkBuffer     vertex_buffers[] = { mesh.vertex_buffer.buffer };
+				VkDeviceSize vertex_offsets[] = { 0 };
+				vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offsets);
+
+				vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			}
+
+			if (!bindless && last_texture_handle != sub_mesh.texture_handle) {
+				last_texture_handle  = sub_mesh.texture_handle;
+
+				auto const & texture = scene.asset_manager.textures[sub_mesh.texture_handle];
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.geometry_static, 0, 1, &texture.descriptor_set, 0, nullptr);
+			}
+
+			// gl_InstanceIndex starts at first_instance, which is the first Draw of this Submesh
+			vkCmdDrawIndexed(command_buffer, sub_mesh.index_count, packet.instance_count, sub_mesh.index_offset, 0, packet.instance_offset);
+		}
+	}
 }
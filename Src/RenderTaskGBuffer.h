@@ -1,8 +1,14 @@
 #pragma once
 #include "VulkanMemory.h"
+#include "DescriptorAllocator.h"
 
 #include "Scene.h"
 #include "RenderTarget.h"
+#include "DepthPyramid.h"
+#include "SkyLUT.h"
+#include "VisibilityBuffer.h"
+#include "DrawList.h"
+#include "GBufferLayout.h"
 
 struct RenderTaskGBuffer {
 private:
@@ -11,12 +17,15 @@ private:
 
 	Scene & scene;
 
+	GBufferLayout layout;
+
 	struct {
 		VkDescriptorSetLayout cull;
 		VkDescriptorSetLayout geometry;
 		VkDescriptorSetLayout material;
-		VkDescriptorSetLayout bones;
 		VkDescriptorSetLayout sky;
+		VkDescriptorSetLayout instanced;
+		VkDescriptorSetLayout depth_pyramid;
 	} descriptor_set_layouts;
 
 	struct {
@@ -29,13 +38,13 @@ private:
 	struct {
 		VkPipeline cull;
 		VkPipeline geometry_static;
+		VkPipeline geometry_static_masked; // Alpha tested
 		VkPipeline geometry_animated;
 		VkPipeline sky;
 	} pipelines;
 
 	struct {
 		std::vector<VulkanMemory::Buffer> camera;
-		std::vector<VulkanMemory::Buffer> material;
 		std::vector<VulkanMemory::Buffer> sky;
 	} uniform_buffers;
 
@@ -43,29 +52,143 @@ private:
 		std::vector<VulkanMemory::Buffer> cull_commands;
 		std::vector<VulkanMemory::Buffer> cull_stats;
 		std::vector<VulkanMemory::Buffer> cull_model;
+		std::vector<VulkanMemory::Buffer> cull_draws; // Written on the CPU when not GPU driven
+		std::vector<VulkanMemory::Buffer> cull_counts;
+		std::vector<VulkanMemory::Buffer> materials; // Indexed by Material id
+
+		VulkanMemory::Buffer cull_visibility; // Only in GPU driven mode, shared by all Frames
 	} storage_buffers;
 
+	std::vector<u32> materials_versions; // Scene::materials_version at the last upload of each Materials Buffer
+
 	struct {
 		std::vector<VkDescriptorSet> cull;
 		std::vector<VkDescriptorSet> material;
-		std::vector<VkDescriptorSet> bones;
 		std::vector<VkDescriptorSet> sky;
+		std::vector<VkDescriptorSet> instanced;
+
+		VkDescriptorSet depth_pyramid;
 	} descriptor_sets;
 
+	int  cull_model_count; // One Model per static Submesh instance
+	bool cull_async = false; // True if the last cull was recorded on the compute Queue, the graphics Queue then has to acquire its results
+
+	// All opaque or all alpha masked static Submesh instances of a MeshBatch (and thus its Vertex and Index Buffers) are drawn by a single indirect draw call
+	struct IndirectGroup {
+		int  batch_index;
+		bool alpha_masked;
+
+		int command_offset; // First Command of the group in the cull_commands Buffer
+		int command_count;  // Maximum number of Commands, the actual count is written by the cull Shader
+	};
+	std::vector<IndirectGroup> indirect_groups; // All opaque groups come before all alpha masked groups
+
+	// In GPU driven mode static geometry is culled and drawn without any per draw work on the CPU
+	bool gpu_driven;
+
+	// Two phase occlusion culling, what was visible last Frame is drawn first and used to build the Depth Pyramid
+	// Everything else is then tested against the Pyramid and drawn in a second Render Pass if it became visible
+	DepthPyramid depth_pyramid;
+
+	bool cull_occlusion = false; // Value of occlusion_culling when the last cull was recorded
+
+	SkyLUT sky_lut;
+
+	// In Visibility Buffer mode static geometry only writes ids and depth, the resolve then fills the GBuffer
+	// Animated Meshes and the Sky are drawn afterwards into the resolved GBuffer, using render_pass_resolve
+	bool             visibility;
+	VisibilityBuffer visibility_buffer;
+
+	// Draws recorded on the CPU, sorted by state through the DrawList. Static geometry is only included if not GPU driven
+	struct DrawPacket {
+		bool animated;
+		int  mesh_index;     // MeshBatch for static, AnimatedMeshInstance for animated draws
+		int  sub_mesh_index;
+
+		int instance_offset; // First InstanceDraw, only used by static draws
+		int instance_count;
+		int vertex_offset;   // First skinned Vertex, only used by animated draws
+	};
+	std::vector<DrawPacket> draw_packets;
+	DrawList                draw_list;
+
+	std::vector<int> bvh_visible; // Primitives of the Scene BVH that passed frustum culling
+
+	// In bindless mode all Textures live in a single Descriptor Set and are indexed per draw using a Push Constant
+	bool bindless;
+	int  bindless_texture_count;
+
+	VkDescriptorPool descriptor_pool_bindless;
+	VkDescriptorSet  descriptor_set_bindless;
+
+	int textures_written; // Textures of the AssetManager that have a Descriptor, Textures after these were loaded after init
+
+	void textures_write(DescriptorAllocator & descriptor_allocator);
+
 	RenderTarget render_target;
 	VkRenderPass render_pass;
+	VkRenderPass render_pass_load;    // Continues where render_pass left off, used by the late occlusion culling phase
+	VkRenderPass render_pass_resolve; // Keeps the Depth of the Visibility pass, the colour attachments are fully overwritten by the resolve
+
+	void cull_dispatch(int image_index, VkCommandBuffer command_buffer, unsigned phase);
+
+	void render_pass_begin(VkCommandBuffer command_buffer, VkRenderPass pass, VkFramebuffer frame_buffer, std::vector<VkClearValue> const & clear_values);
+
+	// Opaque static geometry is drawn first, without discard so that early depth testing stays enabled
+	void render_static_bind(int image_index, VkCommandBuffer command_buffer);
+	void render_indirect   (int image_index, VkCommandBuffer command_buffer);
+
+	void draw_list_build (int image_index);
+	void draw_list_record(int image_index, VkCommandBuffer command_buffer, bool record_static, bool record_animated);
+
+	void render_sky(int image_index, VkCommandBuffer command_buffer);
+
+	void depth_pyramid_descriptor_update();
+
+	void materials_upload(int image_index);
 
 public:
+	static constexpr int MAX_BINDLESS_TEXTURES = 1024;
+
+	bool occlusion_culling = true;
+
+	// Result of the GPU culling passes, read back once the Frame is done
+	struct {
+		int drawn;
+		int drawn_late; // Drawn after being found visible by the late occlusion culling phase
+		int culled_frustum;
+		int culled_occlusion;
+	} cull_stats_gpu = { };
+
 	RenderTaskGBuffer(Scene & scene) : scene(scene) { }
 
-	void init(VkDescriptorPool descriptor_pool, int width, int height, int swapchain_image_count);
+	// Visibility Buffer mode is only used if supported by the Device and the Scene, otherwise this falls back to a regular GBuffer pass
+	void init(DescriptorAllocator & descriptor_allocator, int width, int height, int swapchain_image_count, GBufferLayout layout, bool visibility);
 	void free();
 
+	void resize(int width, int height); // Only recreates size dependent resources
+
+	// Frustum culls all static Submeshes on the GPU and compacts the visible ones into indirect Commands, only used in GPU driven mode
+	// With occlusion culling this is the early phase, the late phase is recorded by render. If async the Command Buffer belongs to the compute Queue
+	void cull  (int image_index, VkCommandBuffer command_buffer, bool async);
 	void render(int image_index, VkCommandBuffer command_buffer);
 
-	uint32_t get_num_descriptor_sets(uint32_t swapchain_image_count) {
-		return swapchain_image_count * 4 + scene.asset_manager.textures.size();
-	}
+	// Only in Visibility Buffer mode, writes the GBuffer from the Visibility Buffer and then draws the animated Meshes and the Sky
+	void resolve(int image_index, VkCommandBuffer command_buffer);
+
+	// Writes the Descriptors of Textures loaded after init, their Sets come from the long-lived allocator
+	// The Device must be idle. Returns false if the Texture cannot be used until the Render Tasks are recreated
+	bool textures_update(DescriptorAllocator & descriptor_allocator);
+
+	// Recomputes the Sky LUTs if the Sun moved, must be recorded outside of a Render Pass before render
+	void sky_lut_update(VkCommandBuffer command_buffer);
 
 	RenderTarget const & get_render_target() { return render_target; }
+
+	bool is_gpu_driven() const { return gpu_driven; }
+
+	bool is_visibility_buffer() const { return visibility; }
+
+	// The late occlusion culling phase depends on this Frame's depth, so occlusion culling keeps both phases on the graphics Queue
+	bool can_cull_async() const { return gpu_driven && !occlusion_culling; }
 };
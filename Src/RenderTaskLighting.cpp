@@ -6,6 +6,7 @@
 #include "Matrix4.h"
 
 #include "Util.h"
+#include "Profiler.h"
 
 namespace IcoSphere {
 	static Vector3 vertices[] = { Vector3(0.000000f, -1.000000f, 0.000000f), Vector3(0.425323f, -0.850654f, 0.309011f), Vector3(-0.162456f, -0.850654f, 0.499995f), Vector3(0.723607f, -0.447220f, 0.525725f), Vector3(0.425323f, -0.850654f, 0.309011f), Vector3(0.850648f, -0.525736f, 0.000000f), Vector3(0.000000f, -1.000000f, 0.000000f), Vector3(-0.162456f, -0.850654f, 0.499995f), Vector3(-0.525730f, -0.850652f, 0.000000f), Vector3(0.000000f, -1.000000f, 0.000000f), Vector3(-0.525730f, -0.850652f, 0.000000f), Vector3(-0.162456f, -0.850654f, -0.499995f), Vector3(0.000000f, -1.000000f, 0.000000f), Vector3(-0.162456f, -0.850654f, -0.499995f), Vector3(0.425323f, -0.850654f, -0.309011f), Vector3(0.723607f, -0.447220f, 0.525725f), Vector3(0.850648f, -0.525736f, 0.000000f), Vector3(0.951058f, 0.000000f, 0.309013f), Vector3(-0.276388f, -0.447220f, 0.850649f), Vector3(0.262869f, -0.525738f, 0.809012f), Vector3(0.000000f, 0.000000f, 1.000000f), Vector3(-0.894426f, -0.447216f, 0.000000f), Vector3(-0.688189f, -0.525736f, 0.499997f), Vector3(-0.951058f, 0.000000f, 0.309013f), Vector3(-0.276388f, -0.447220f, -0.850649f), Vector3(-0.688189f, -0.525736f, -0.499997f), Vector3(-0.587786f, 0.000000f, -0.809017f), Vector3(0.723607f, -0.447220f, -0.525725f), Vector3(0.262869f, -0.525738f, -0.809012f), Vector3(0.587786f, 0.000000f, -0.809017f), Vector3(0.723607f, -0.447220f, 0.525725f), Vector3(0.951058f, 0.000000f, 0.309013f), Vector3(0.587786f, 0.000000f, 0.809017f), Vector3(-0.276388f, -0.447220f, 0.850649f), Vector3(0.000000f, 0.000000f, 1.000000f), Vector3(-0.587786f, 0.000000f, 0.809017f), Vector3(-0.894426f, -0.447216f, 0.000000f), Vector3(-0.951058f, 0.000000f, 0.309013f), Vector3(-0.951058f, 0.000000f, -0.309013f), Vector3(-0.276388f, -0.447220f, -0.850649f), Vector3(-0.587786f, 0.000000f, -0.809017f), Vector3(0.000000f, 0.000000f, -1.000000f), Vector3(0.723607f, -0.447220f, -0.525725f), Vector3(0.587786f, 0.000000f, -0.809017f), Vector3(0.951058f, 0.000000f, -0.309013f), Vector3(0.276388f, 0.447220f, 0.850649f), Vector3(0.688189f, 0.525736f, 0.499997f), Vector3(0.162456f, 0.850654f, 0.499995f), Vector3(-0.723607f, 0.447220f, 0.525725f), Vector3(-0.262869f, 0.525738f, 0.809012f), Vector3(-0.425323f, 0.850654f, 0.309011f), Vector3(-0.723607f, 0.447220f, -0.525725f), Vector3(-0.850648f, 0.525736f, 0.000000f), Vector3(-0.425323f, 0.850654f, -0.309011f), Vector3(0.276388f, 0.447220f, -0.850649f), Vector3(-0.262869f, 0.525738f, -0.809012f), Vector3(0.162456f, 0.850654f, -0.499995f), Vector3(0.894426f, 0.447216f, 0.000000f), Vector3(0.688189f, 0.525736f, -0.499997f), Vector3(0.525730f, 0.850652f, 0.000000f), Vector3(0.525730f, 0.850652f, 0.000000f), Vector3(0.162456f, 0.850654f, -0.499995f), Vector3(0.000000f, 1.000000f, 0.000000f), Vector3(0.525730f, 0.850652f, 0.000000f), Vector3(0.688189f, 0.525736f, -0.499997f), Vector3(0.162456f, 0.850654f, -0.499995f), Vector3(0.688189f, 0.525736f, -0.499997f), Vector3(0.276388f, 0.447220f, -0.850649f), Vector3(0.162456f, 0.850654f, -0.499995f), Vector3(0.162456f, 0.850654f, -0.499995f), Vector3(-0.425323f, 0.850654f, -0.309011f), Vector3(0.000000f, 1.000000f, 0.000000f), Vector3(0.162456f, 0.850654f, -0.499995f), Vector3(-0.262869f, 0.525738f, -0.809012f), Vector3(-0.425323f, 0.850654f, -0.309011f), Vector3(-0.262869f, 0.525738f, -0.809012f), Vector3(-0.723607f, 0.447220f, -0.525725f), Vector3(-0.425323f, 0.850654f, -0.309011f), Vector3(-0.425323f, 0.850654f, -0.309011f), Vector3(-0.425323f, 0.850654f, 0.309011f), Vector3(0.000000f, 1.000000f, 0.000000f), Vector3(-0.425323f, 0.850654f, -0.309011f), Vector3(-0.850648f, 0.525736f, 0.000000f), Vector3(-0.425323f, 0.850654f, 0.309011f), Vector3(-0.850648f, 0.525736f, 0.000000f), Vector3(-0.723607f, 0.447220f, 0.525725f), Vector3(-0.425323f, 0.850654f, 0.309011f), Vector3(-0.425323f, 0.850654f, 0.309011f), Vector3(0.162456f, 0.850654f, 0.499995f), Vector3(0.000000f, 1.000000f, 0.000000f), Vector3(-0.425323f, 0.850654f, 0.309011f), Vector3(-0.262869f, 0.525738f, 0.809012f), Vector3(0.162456f, 0.850654f, 0.499995f), Vector3(-0.262869f, 0.525738f, 0.809012f), Vector3(0.276388f, 0.447220f, 0.850649f), Vector3(0.162456f, 0.850654f, 0.499995f), Vector3(0.162456f, 0.850654f, 0.499995f), Vector3(0.525730f, 0.850652f, 0.000000f), Vector3(0.000000f, 1.000000f, 0.000000f), Vector3(0.162456f, 0.850654f, 0.499995f), Vector3(0.688189f, 0.525736f, 0.499997f), Vector3(0.525730f, 0.850652f, 0.000000f), Vector3(0.688189f, 0.525736f, 0.499997f), Vector3(0.894426f, 0.447216f, 0.000000f), Vector3(0.525730f, 0.850652f, 0.000000f), Vector3(0.951058f, 0.000000f, -0.309013f), Vector3(0.688189f, 0.525736f, -0.499997f), Vector3(0.894426f, 0.447216f, 0.000000f), Vector3(0.951058f, 0.000000f, -0.309013f), Vector3(0.587786f, 0.000000f, -0.809017f), Vector3(0.688189f, 0.525736f, -0.499997f), Vector3(0.587786f, 0.000000f, -0.809017f), Vector3(0.276388f, 0.447220f, -0.850649f), Vector3(0.688189f, 0.525736f, -0.499997f), Vector3(0.000000f, 0.000000f, -1.000000f), Vector3(-0.262869f, 0.525738f, -0.809012f), Vector3(0.276388f, 0.447220f, -0.850649f), Vector3(0.000000f, 0.000000f, -1.000000f), Vector3(-0.587786f, 0.000000f, -0.809017f), Vector3(-0.262869f, 0.525738f, -0.809012f), Vector3(-0.587786f, 0.000000f, -0.809017f), Vector3(-0.723607f, 0.447220f, -0.525725f), Vector3(-0.262869f, 0.525738f, -0.809012f), Vector3(-0.951058f, 0.000000f, -0.309013f), Vector3(-0.850648f, 0.525736f, 0.000000f), Vector3(-0.723607f, 0.447220f, -0.525725f), Vector3(-0.951058f, 0.000000f, -0.309013f), Vector3(-0.951058f, 0.000000f, 0.309013f), Vector3(-0.850648f, 0.525736f, 0.000000f), Vector3(-0.951058f, 0.000000f, 0.309013f), Vector3(-0.723607f, 0.447220f, 0.525725f), Vector3(-0.850648f, 0.525736f, 0.000000f), Vector3(-0.587786f, 0.000000f, 0.809017f), Vector3(-0.262869f, 0.525738f, 0.809012f), Vector3(-0.723607f, 0.447220f, 0.525725f), Vector3(-0.587786f, 0.000000f, 0.809017f), Vector3(0.000000f, 0.000000f, 1.000000f), Vector3(-0.262869f, 0.525738f, 0.809012f), Vector3(0.000000f, 0.000000f, 1.000000f), Vector3(0.276388f, 0.447220f, 0.850649f), Vector3(-0.262869f, 0.525738f, 0.809012f), Vector3(0.587786f, 0.000000f, 0.809017f), Vector3(0.688189f, 0.525736f, 0.499997f), Vector3(0.276388f, 0.447220f, 0.850649f), Vector3(0.587786f, 0.000000f, 0.809017f), Vector3(0.951058f, 0.000000f, 0.309013f), Vector3(0.688189f, 0.525736f, 0.499997f), Vector3(0.951058f, 0.000000f, 0.309013f), Vector3(0.894426f, 0.447216f, 0.000000f), Vector3(0.688189f, 0.525736f, 0.499997f), Vector3(0.587786f, 0.000000f, -0.809017f), Vector3(0.000000f, 0.000000f, -1.000000f), Vector3(0.276388f, 0.447220f, -0.850649f), Vector3(0.587786f, 0.000000f, -0.809017f), Vector3(0.262869f, -0.525738f, -0.809012f), Vector3(0.000000f, 0.000000f, -1.000000f), Vector3(0.262869f, -0.525738f, -0.809012f), Vector3(-0.276388f, -0.447220f, -0.850649f), Vector3(0.000000f, 0.000000f, -1.000000f), Vector3(-0.587786f, 0.000000f, -0.809017f), Vector3(-0.951058f, 0.000000f, -0.309013f), Vector3(-0.723607f, 0.447220f, -0.525725f), Vector3(-0.587786f, 0.000000f, -0.809017f), Vector3(-0.688189f, -0.525736f, -0.499997f), Vector3(-0.951058f, 0.000000f, -0.309013f), Vector3(-0.688189f, -0.525736f, -0.499997f), Vector3(-0.894426f, -0.447216f, 0.000000f), Vector3(-0.951058f, 0.000000f, -0.309013f), Vector3(-0.951058f, 0.000000f, 0.309013f), Vector3(-0.587786f, 0.000000f, 0.809017f), Vector3(-0.723607f, 0.447220f, 0.525725f), Vector3(-0.951058f, 0.000000f, 0.309013f), Vector3(-0.688189f, -0.525736f, 0.499997f), Vector3(-0.587786f, 0.000000f, 0.809017f), Vector3(-0.688189f, -0.525736f, 0.499997f), Vector3(-0.276388f, -0.447220f, 0.850649f), Vector3(-0.587786f, 0.000000f, 0.809017f), Vector3(0.000000f, 0.000000f, 1.000000f), Vector3(0.587786f, 0.000000f, 0.809017f), Vector3(0.276388f, 0.447220f, 0.850649f), Vector3(0.000000f, 0.000000f, 1.000000f), Vector3(0.262869f, -0.525738f, 0.809012f), Vector3(0.587786f, 0.000000f, 0.809017f), Vector3(0.262869f, -0.525738f, 0.809012f), Vector3(0.723607f, -0.447220f, 0.525725f), Vector3(0.587786f, 0.000000f, 0.809017f), Vector3(0.951058f, 0.000000f, 0.309013f), Vector3(0.951058f, 0.000000f, -0.309013f), Vector3(0.894426f, 0.447216f, 0.000000f), Vector3(0.951058f, 0.000000f, 0.309013f), Vector3(0.850648f, -0.525736f, 0.000000f), Vector3(0.951058f, 0.000000f, -0.309013f), Vector3(0.850648f, -0.525736f, 0.000000f), Vector3(0.723607f, -0.447220f, -0.525725f), Vector3(0.951058f, 0.000000f, -0.309013f), Vector3(0.425323f, -0.850654f, -0.309011f), Vector3(0.262869f, -0.525738f, -0.809012f), Vector3(0.723607f, -0.447220f, -0.525725f), Vector3(0.425323f, -0.850654f, -0.309011f), Vector3(-0.162456f, -0.850654f, -0.499995f), Vector3(0.262869f, -0.525738f, -0.809012f), Vector3(-0.162456f, -0.850654f, -0.499995f), Vector3(-0.276388f, -0.447220f, -0.850649f), Vector3(0.262869f, -0.525738f, -0.809012f), Vector3(-0.162456f, -0.850654f, -0.499995f), Vector3(-0.688189f, -0.525736f, -0.499997f), Vector3(-0.276388f, -0.447220f, -0.850649f), Vector3(-0.162456f, -0.850654f, -0.499995f), Vector3(-0.525730f, -0.850652f, 0.000000f), Vector3(-0.688189f, -0.525736f, -0.499997f), Vector3(-0.525730f, -0.850652f, 0.000000f), Vector3(-0.894426f, -0.447216f, 0.000000f), Vector3(-0.688189f, -0.525736f, -0.499997f), Vector3(-0.525730f, -0.850652f, 0.000000f), Vector3(-0.688189f, -0.525736f, 0.499997f), Vector3(-0.894426f, -0.447216f, 0.000000f), Vector3(-0.525730f, -0.850652f, 0.000000f), Vector3(-0.162456f, -0.850654f, 0.499995f), Vector3(-0.688189f, -0.525736f, 0.499997f), Vector3(-0.162456f, -0.850654f, 0.499995f), Vector3(-0.276388f, -0.447220f, 0.850649f), Vector3(-0.688189f, -0.525736f, 0.499997f), Vector3(0.850648f, -0.525736f, 0.000000f), Vector3(0.425323f, -0.850654f, -0.309011f), Vector3(0.723607f, -0.447220f, -0.525725f), Vector3(0.850648f, -0.525736f, 0.000000f), Vector3(0.425323f, -0.850654f, 0.309011f), Vector3(0.425323f, -0.850654f, -0.309011f), Vector3(0.425323f, -0.850654f, 0.309011f), Vector3(0.000000f, -1.000000f, 0.000000f), Vector3(0.425323f, -0.850654f, -0.309011f), Vector3(-0.162456f, -0.850654f, 0.499995f), Vector3(0.262869f, -0.525738f, 0.809012f), Vector3(-0.276388f, -0.447220f, 0.850649f), Vector3(-0.162456f, -0.850654f, 0.499995f), Vector3(0.425323f, -0.850654f, 0.309011f), Vector3(0.262869f, -0.525738f, 0.809012f), Vector3(0.425323f, -0.850654f, 0.309011f), Vector3(0.723607f, -0.447220f, 0.525725f), Vector3(0.262869f, -0.525738f, 0.809012f), };
@@ -74,26 +75,45 @@ void RenderTaskLighting::LightPass::free() {
 	auto device = VulkanContext::get_device();
 
 	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-	vkDestroyPipeline      (device, pipeline,        nullptr);
+
+	for (auto pipeline : pipelines) {
+		VulkanContext::destroy_pipeline(pipeline);
+	}
+	pipelines.clear();
 
 	uniform_buffers.clear();
 }
 
-RenderTaskLighting::LightPass RenderTaskLighting::create_light_pass(
-	VkDescriptorPool descriptor_pool,
-	int width, int height, int swapchain_image_count,
+void RenderTaskLighting::LightPass::set_input(DescriptorUpdateTemplate const & update_template_input, RenderTarget const & render_target_input) {
+	InputDescriptors descriptors;
+	descriptors.albedo = { render_target_input.sampler, render_target_input.attachments[GBUFFER_ATTACHMENT_ALBEDO].image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	descriptors.normal = { render_target_input.sampler, render_target_input.attachments[GBUFFER_ATTACHMENT_NORMAL].image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	descriptors.depth  = { render_target_input.sampler, render_target_input.attachments[GBUFFER_ATTACHMENT_DEPTH].image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	// The standard layout has no separate material attachment, the Descriptor still has to be valid so it points to the Normal attachment
+	auto const & attachment_material = render_target_input.attachments.size() > GBUFFER_ATTACHMENT_MATERIAL ? render_target_input.attachments[GBUFFER_ATTACHMENT_MATERIAL] : render_target_input.attachments[GBUFFER_ATTACHMENT_NORMAL];
+	descriptors.material = { render_target_input.sampler, attachment_material.image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	for (auto descriptor_set : descriptor_sets) {
+		update_template_input.update(descriptor_set, &descriptors);
+	}
+}
+
+void RenderTaskLighting::init_light_pass(
+	LightPass & light_pass,
+	DescriptorAllocator & descriptor_allocator,
+	int swapchain_image_count,
 	RenderTarget const & render_target_input,
 	std::vector<VkVertexInputBindingDescription>   const & vertex_bindings,
 	std::vector<VkVertexInputAttributeDescription> const & vertex_attributes,
 	std::string const & filename_shader_vertex,
 	std::string const & filename_shader_fragment,
+	std::vector<std::vector<VulkanContext::PipelineDetails::SpecializationConstant>> const & permutations,
 	size_t push_constants_size,
 	size_t ubo_size
 ) {
 	auto device = VulkanContext::get_device();
 
-	LightPass light_pass;
-
 	// Create Pipeline Layout
 	std::vector<VkPushConstantRange> push_constants(1);
 	push_constants[0].offset = 0;
@@ -108,12 +128,10 @@ RenderTaskLighting::LightPass RenderTaskLighting::create_light_pass(
 
 	light_pass.pipeline_layout = VulkanContext::create_pipeline_layout(pipeline_layout_details);
 
-	// Create Pipeline
+	// Create Pipelines
 	VulkanContext::PipelineDetails pipeline_details;
 	pipeline_details.vertex_bindings   = vertex_bindings;
 	pipeline_details.vertex_attributes = vertex_attributes;
-	pipeline_details.width  = width;
-	pipeline_details.height = height;
 	pipeline_details.cull_mode = VK_CULL_MODE_NONE;
 	pipeline_details.blends = { VulkanContext::PipelineDetails::BLEND_ADDITIVE };
 	pipeline_details.shaders = {
@@ -125,7 +143,13 @@ RenderTaskLighting::LightPass RenderTaskLighting::create_light_pass(
 	pipeline_details.pipeline_layout = light_pass.pipeline_layout;
 	pipeline_details.render_pass     = render_pass;
 
-	light_pass.pipeline = VulkanContext::create_pipeline(pipeline_details);
+	light_pass.pipelines.resize(permutations.size());
+
+	for (int i = 0; i < permutations.size(); i++) {
+		pipeline_details.specialization_constants = permutations[i];
+
+		VulkanContext::create_pipeline_deferred(pipeline_details, &light_pass.pipelines[i]);
+	}
 
 	// Create Uniform Buffers
 	light_pass.uniform_buffers.reserve(swapchain_image_count);
@@ -140,85 +164,33 @@ RenderTaskLighting::LightPass RenderTaskLighting::create_light_pass(
 	}
 
 	// Allocate and update Descriptor Sets
-	std::vector<VkDescriptorSetLayout> layouts(swapchain_image_count, descriptor_set_layouts.light);
-
-	VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-	alloc_info.descriptorPool = descriptor_pool;
-	alloc_info.descriptorSetCount = layouts.size();
-	alloc_info.pSetLayouts        = layouts.data();
-
 	light_pass.descriptor_sets.resize(swapchain_image_count);
-	VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, light_pass.descriptor_sets.data()));
 
 	for (int i = 0; i < light_pass.descriptor_sets.size(); i++) {
-		auto & descriptor_set = light_pass.descriptor_sets[i];
-
-		VkWriteDescriptorSet write_descriptor_sets[4] = { };
-
-		// Write Descriptor for Albedo target
-		VkDescriptorImageInfo descriptor_image_albedo = { };
-		descriptor_image_albedo.sampler     = render_target_input.sampler;
-		descriptor_image_albedo.imageView   = render_target_input.attachments[0].image_view;
-		descriptor_image_albedo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		write_descriptor_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write_descriptor_sets[0].dstSet = descriptor_set;
-		write_descriptor_sets[0].dstBinding = 0;
-		write_descriptor_sets[0].dstArrayElement = 0;
-		write_descriptor_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		write_descriptor_sets[0].descriptorCount = 1;
-		write_descriptor_sets[0].pImageInfo = &descriptor_image_albedo;
-
-		// Write Descriptor for Normal target
-		VkDescriptorImageInfo descriptor_image_normal = { };
-		descriptor_image_normal.sampler     = render_target_input.sampler;
-		descriptor_image_normal.imageView   = render_target_input.attachments[1].image_view;
-		descriptor_image_normal.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		write_descriptor_sets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write_descriptor_sets[1].dstSet = descriptor_set;
-		write_descriptor_sets[1].dstBinding = 1;
-		write_descriptor_sets[1].dstArrayElement = 0;
-		write_descriptor_sets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		write_descriptor_sets[1].descriptorCount = 1;
-		write_descriptor_sets[1].pImageInfo = &descriptor_image_normal;
-
-		// Write Descriptor for Depth target
-		VkDescriptorImageInfo descriptor_image_depth = { };
-		descriptor_image_depth.sampler     = render_target_input.sampler;
-		descriptor_image_depth.imageView   = render_target_input.attachments[2].image_view;
-		descriptor_image_depth.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-		write_descriptor_sets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write_descriptor_sets[2].dstSet = descriptor_set;
-		write_descriptor_sets[2].dstBinding = 2;
-		write_descriptor_sets[2].dstArrayElement = 0;
-		write_descriptor_sets[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		write_descriptor_sets[2].descriptorCount = 1;
-		write_descriptor_sets[2].pImageInfo = &descriptor_image_depth;
+		light_pass.descriptor_sets[i] = descriptor_allocator.allocate(descriptor_set_layouts.light);
 
 		VkDescriptorBufferInfo descriptor_ubo = { };
 		descriptor_ubo.buffer = light_pass.uniform_buffers[i].buffer;
 		descriptor_ubo.offset = 0;
 		descriptor_ubo.range = ubo_size;
 
-		write_descriptor_sets[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write_descriptor_sets[3].dstSet = descriptor_set;
-		write_descriptor_sets[3].dstBinding = 3;
-		write_descriptor_sets[3].dstArrayElement = 0;
-		write_descriptor_sets[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write_descriptor_set.dstSet = light_pass.descriptor_sets[i];
+		write_descriptor_set.dstBinding = 3;
+		write_descriptor_set.dstArrayElement = 0;
+		write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		if (ubo_size > 0) {
-			write_descriptor_sets[3].descriptorCount = 1;
-			write_descriptor_sets[3].pBufferInfo     = &descriptor_ubo;
+			write_descriptor_set.descriptorCount = 1;
+			write_descriptor_set.pBufferInfo     = &descriptor_ubo;
 		}
 
-		vkUpdateDescriptorSets(device, Util::array_element_count(write_descriptor_sets), write_descriptor_sets, 0, nullptr);
+		vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
 	}
 
-	return light_pass;
+	light_pass.set_input(update_template_input, render_target_input);
 }
 
-void RenderTaskLighting::init(VkDescriptorPool descriptor_pool, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input) {
+void RenderTaskLighting::init(DescriptorAllocator & descriptor_allocator, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input, GBufferLayout layout) {
 	auto device = VulkanContext::get_device();
 
 	this->width  = width;
@@ -226,7 +198,7 @@ void RenderTaskLighting::init(VkDescriptorPool descriptor_pool, int width, int h
 
 	{
 		// Create Descriptor Set Layout
-		VkDescriptorSetLayoutBinding layout_bindings[4] = { };
+		VkDescriptorSetLayoutBinding layout_bindings[5] = { };
 
 		// Albedo Sampler
 		layout_bindings[0].binding = 0;
@@ -256,11 +228,26 @@ void RenderTaskLighting::init(VkDescriptorPool descriptor_pool, int width, int h
 		layout_bindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 		layout_bindings[3].pImmutableSamplers = nullptr;
 
+		// Material Sampler
+		layout_bindings[4].binding = 4;
+		layout_bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		layout_bindings[4].descriptorCount = 1;
+		layout_bindings[4].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		layout_bindings[4].pImmutableSamplers = nullptr;
+
 		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
 		layout_create_info.bindingCount = Util::array_element_count(layout_bindings);
 		layout_create_info.pBindings    = layout_bindings;
 
 		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.light));
+
+		// The GBuffer inputs are written with a single template update, the Uniform Buffer is written separately
+		update_template_input.init(descriptor_set_layouts.light, {
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(LightPass::InputDescriptors, albedo) },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(LightPass::InputDescriptors, normal) },
+			{ 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(LightPass::InputDescriptors, depth) },
+			{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(LightPass::InputDescriptors, material) }
+		});
 	}
 
 	{
@@ -281,58 +268,66 @@ void RenderTaskLighting::init(VkDescriptorPool descriptor_pool, int width, int h
 		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.shadow));
 	}
 
-	render_target.add_attachment(width, height, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VulkanContext::create_clear_value_colour()); // HDR lighting
+	auto formats = GBufferFormats::get(layout);
+
+	render_target.add_attachment(width, height, formats.lighting, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VulkanContext::create_clear_value_colour()); // HDR lighting
 
 	render_pass = VulkanContext::create_render_pass(render_target.get_attachment_descriptions());
 	render_target.init(width, height, render_pass);
 
-	light_pass_directional = create_light_pass(
-		descriptor_pool,
-		width, height,
+	// Shader constant 0 is SHADOW_PCF_RANGE, constant 1 is GBUFFER_COMPACT
+	auto compact = u32(layout == GBufferLayout::COMPACT);
+
+	std::vector<std::vector<VulkanContext::PipelineDetails::SpecializationConstant>> permutations_directional;
+	for (int range = 0; range <= SHADOW_PCF_RANGE_MAX; range++) {
+		permutations_directional.push_back({ { 0, u32(range) }, { 1, compact } });
+	}
+
+	init_light_pass(
+		light_pass_directional,
+		descriptor_allocator,
 		swapchain_image_count,
 		render_target_input,
 		{ },
 		{ },
 		"Shaders/light_directional.vert.spv",
 		"Shaders/light_directional.frag.spv",
+		permutations_directional,
 		0,
 		sizeof(DirectionalLightUBO)
 	);
 
-	light_pass_point = create_light_pass(
-		descriptor_pool,
-		width, height,
+	init_light_pass(
+		light_pass_point,
+		descriptor_allocator,
 		swapchain_image_count,
 		render_target_input,
 		{ { 0, sizeof(Vector3), VK_VERTEX_INPUT_RATE_VERTEX } },
 		{ { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 } },
 		"Shaders/light_point.vert.spv",
 		"Shaders/light_point.frag.spv",
+		{ { { 1, compact } } },
 		sizeof(PointLightPushConstants),
 		sizeof(PointLightUBO)
 	);
 
-	light_pass_spot = create_light_pass(
-		descriptor_pool,
-		width, height,
+	init_light_pass(
+		light_pass_spot,
+		descriptor_allocator,
 		swapchain_image_count,
 		render_target_input,
 		{ { 0, sizeof(Vector3), VK_VERTEX_INPUT_RATE_VERTEX } },
 		{ { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 } },
 		"Shaders/light_spot.vert.spv",
 		"Shaders/light_spot.frag.spv",
+		{ { { 1, compact } } },
 		sizeof(PointLightPushConstants),
 		sizeof(SpotLightUBO)
 	);
 
 	// Allocate and update Descriptor Sets
 	for (auto & directional_light : scene.directional_lights) {
-		VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-		alloc_info.descriptorPool = descriptor_pool;
-		alloc_info.descriptorSetCount = 1;
-		alloc_info.pSetLayouts        = &descriptor_set_layouts.shadow;
-
-		VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, &directional_light.shadow_map.descriptor_set));
+		directional_light.shadow_map.descriptor_set = descriptor_allocator.allocate(descriptor_set_layouts.shadow);
 
 		VkDescriptorImageInfo image_info;
 		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -361,12 +356,27 @@ void RenderTaskLighting::free() {
 	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.light,  nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.shadow, nullptr);
 
+	update_template_input.free();
+
 	render_target.free();
 
-	vkDestroyRenderPass(device, render_pass, nullptr);
+	VulkanContext::destroy_render_pass(render_pass);
+}
+
+void RenderTaskLighting::resize(int width, int height, RenderTarget const & render_target_input) {
+	this->width  = width;
+	this->height = height;
+
+	render_target.resize(width, height, render_pass);
+
+	light_pass_directional.set_input(update_template_input, render_target_input);
+	light_pass_point      .set_input(update_template_input, render_target_input);
+	light_pass_spot       .set_input(update_template_input, render_target_input);
 }
 
 void RenderTaskLighting::render(int image_index, VkCommandBuffer command_buffer) {
+	PROFILE_SCOPE("RenderTaskLighting::render");
+
 	// Begin Light Render Pass
 	VkRenderPassBeginInfo renderpass_begin_info = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
 	renderpass_begin_info.renderPass  = render_pass;
@@ -376,13 +386,14 @@ void RenderTaskLighting::render(int image_index, VkCommandBuffer command_buffer)
 	renderpass_begin_info.pClearValues    = render_target.clear_values.data();
 
 	vkCmdBeginRenderPass(command_buffer, &renderpass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	VulkanContext::set_viewport(command_buffer, width, height);
 
 	// Render Directional Lights
 	if (scene.directional_lights.size() > 0) {
 		auto & uniform_buffer = light_pass_directional.uniform_buffers[image_index];
 		auto & descriptor_set = light_pass_directional.descriptor_sets[image_index];
 
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, light_pass_directional.pipeline);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, light_pass_directional.pipelines[Math::clamp(shadow_pcf_range, 0, SHADOW_PCF_RANGE_MAX)]);
 
 		// Upload Uniform Buffer
 		auto aligned_size = Math::round_up(sizeof(DirectionalLightUBO), VulkanContext::get_min_uniform_buffer_alignment());
@@ -414,10 +425,12 @@ void RenderTaskLighting::render(int image_index, VkCommandBuffer command_buffer)
 
 	// Render Point Lights
 	if (scene.point_lights.size() > 0) {
+		PROFILE_SCOPE("Point Lights");
+
 		auto & uniform_buffer = light_pass_point.uniform_buffers[image_index];
 		auto & descriptor_set = light_pass_point.descriptor_sets[image_index];
 
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, light_pass_point.pipeline);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, light_pass_point.pipelines[0]);
 
 		// Upload Uniform Buffer
 		auto aligned_size = Math::round_up(sizeof(PointLightUBO), VulkanContext::get_min_uniform_buffer_alignment());
@@ -431,13 +444,18 @@ void RenderTaskLighting::render(int image_index, VkCommandBuffer command_buffer)
 
 		vkCmdBindIndexBuffer(command_buffer, point_light_sphere.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
+		light_spheres.clear();
+		for (auto const & point_light : scene.point_lights) light_spheres.add(point_light.position, point_light.radius);
+
+		scene.camera.frustum.cull_spheres(light_spheres, light_visible);
+
 		int num_unculled_lights = 0;
 
 		// For each Point Light render a sphere with the appropriate radius and position
 		for (int i = 0; i < scene.point_lights.size(); i++) {
 			auto const & point_light = scene.point_lights[i];
 
-			if (scene.camera.frustum.intersect_sphere(point_light.position, point_light.radius) == Frustum::IntersectionType::FULLY_OUTSIDE) continue;
+			if (!Frustum::is_visible(light_visible, i)) continue;
 
 			// Upload UBO
 			auto ubo = reinterpret_cast<PointLightUBO *>(&buf[num_unculled_lights * aligned_size]);
@@ -468,10 +486,12 @@ void RenderTaskLighting::render(int image_index, VkCommandBuffer command_buffer)
 
 	// Render Spot Lights
 	if (scene.spot_lights.size() > 0) {
+		PROFILE_SCOPE("Spot Lights");
+
 		auto & uniform_buffer = light_pass_spot.uniform_buffers[image_index];
 		auto & descriptor_set = light_pass_spot.descriptor_sets[image_index];
 
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, light_pass_spot.pipeline);
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, light_pass_spot.pipelines[0]);
 
 		// Upload Uniform Buffer
 		auto aligned_size = Math::round_up(sizeof(SpotLightUBO), VulkanContext::get_min_uniform_buffer_alignment());
@@ -485,13 +505,18 @@ void RenderTaskLighting::render(int image_index, VkCommandBuffer command_buffer)
 
 		vkCmdBindIndexBuffer(command_buffer, point_light_sphere.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
+		light_spheres.clear();
+		for (auto const & spot_light : scene.spot_lights) light_spheres.add(spot_light.position, spot_light.radius);
+
+		scene.camera.frustum.cull_spheres(light_spheres, light_visible);
+
 		int num_unculled_lights = 0;
 
 		// For each Spot Light render a sphere with the appropriate radius and position
 		for (int i = 0; i < scene.spot_lights.size(); i++) {
 			auto const & spot_light = scene.spot_lights[i];
 
-			if (scene.camera.frustum.intersect_sphere(spot_light.position, spot_light.radius) == Frustum::IntersectionType::FULLY_OUTSIDE) continue;
+			if (!Frustum::is_visible(light_visible, i)) continue;
 
 			auto ubo = reinterpret_cast<SpotLightUBO *>(&buf[num_unculled_lights * aligned_size]);
 			ubo->spot_light.colour    = spot_light.colour;
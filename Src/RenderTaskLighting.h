@@ -2,10 +2,13 @@
 #include <vector>
 #include <string>
 
+#include "VulkanContext.h"
 #include "VulkanMemory.h"
+#include "DescriptorAllocator.h"
 
 #include "Scene.h"
 #include "RenderTarget.h"
+#include "GBufferLayout.h"
 
 struct RenderTaskLighting {
 private:
@@ -24,12 +27,19 @@ private:
 	} point_light_sphere;
 
 	struct LightPass {
-		VkPipelineLayout pipeline_layout;
-		VkPipeline       pipeline;
+		VkPipelineLayout        pipeline_layout;
+		std::vector<VkPipeline> pipelines; // One per permutation of Specialization Constants
 
 		std::vector<VkDescriptorSet>      descriptor_sets;
 		std::vector<VulkanMemory::Buffer> uniform_buffers;
 
+		struct InputDescriptors {
+			VkDescriptorImageInfo albedo;
+			VkDescriptorImageInfo normal;
+			VkDescriptorImageInfo depth;
+			VkDescriptorImageInfo material;
+		};
+		void set_input(DescriptorUpdateTemplate const & update_template_input, RenderTarget const & render_target_input); // Updates the GBuffer Descriptors, needed whenever the GBuffer is resized
 		void free();
 	};
 
@@ -38,6 +48,8 @@ private:
 		VkDescriptorSetLayout shadow;
 	} descriptor_set_layouts;
 
+	DescriptorUpdateTemplate update_template_input;
+
 	RenderTarget render_target;
 	VkRenderPass render_pass;
 
@@ -45,14 +57,21 @@ private:
 	LightPass light_pass_point;
 	LightPass light_pass_spot;
 
-	LightPass create_light_pass(
-		VkDescriptorPool descriptor_pool,
-		int width, int height, int swapchain_image_count,
+	// Bounding spheres of the Point and Spot Lights, culled in batches against the Camera Frustum
+	Frustum::SpheresSoA light_spheres;
+	std::vector<u64>    light_visible;
+
+	// Pipeline creation is deferred, so the LightPass is initialized in place
+	void init_light_pass(
+		LightPass & light_pass,
+		DescriptorAllocator & descriptor_allocator,
+		int swapchain_image_count,
 		RenderTarget const & render_target_input,
 		std::vector<VkVertexInputBindingDescription>   const & vertex_bindings,
 		std::vector<VkVertexInputAttributeDescription> const & vertex_attributes,
 		std::string const & filename_shader_vertex,
 		std::string const & filename_shader_fragment,
+		std::vector<std::vector<VulkanContext::PipelineDetails::SpecializationConstant>> const & permutations,
 		size_t push_constants_size,
 		size_t ubo_size
 	);
@@ -60,16 +79,18 @@ private:
 public:
 	int num_culled_lights = 0;
 
+	// Every PCF range has its own Pipeline, so switching at runtime is free
+	static constexpr int SHADOW_PCF_RANGE_MAX = 3;
+	int shadow_pcf_range = 1;
+
 	RenderTaskLighting(Scene & scene) : scene(scene) { }
 
-	void init(VkDescriptorPool descriptor_pool, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input);
+	void init(DescriptorAllocator & descriptor_allocator, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input, GBufferLayout layout);
 	void free();
 
-	void render(int image_index, VkCommandBuffer command_buffer);
+	void resize(int width, int height, RenderTarget const & render_target_input); // Only recreates size dependent resources
 
-	uint32_t get_num_descriptor_sets(uint32_t swapchain_image_count) {
-		return swapchain_image_count * 3 + scene.directional_lights.size();
-	}
+	void render(int image_index, VkCommandBuffer command_buffer);
 
 	RenderTarget const & get_render_target() { return render_target; }
 };
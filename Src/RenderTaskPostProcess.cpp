@@ -8,6 +8,7 @@
 #include "VulkanContext.h"
 
 #include "Util.h"
+#include "Profiler.h"
 
 struct GizmoPushConstants {
 	alignas(16) Matrix4 wvp;
@@ -29,12 +30,15 @@ RenderTaskPostProcess::~RenderTaskPostProcess() {
 	ImGui::DestroyContext();
 }
 
-void RenderTaskPostProcess::init(VkDescriptorPool descriptor_pool, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input, GLFWwindow * window) {
+void RenderTaskPostProcess::init(DescriptorAllocator & descriptor_allocator, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input, GLFWwindow * window) {
 	auto device = VulkanContext::get_device();
 
 	this->width  = width;
 	this->height = height;
 
+	// Without a window there is no GUI and the output is read back instead of presented
+	enable_gui = window != nullptr;
+
 	// Create Descriptor Set Layout
 	VkDescriptorSetLayoutBinding layout_bindings[1] = { };
 
@@ -61,7 +65,7 @@ void RenderTaskPostProcess::init(VkDescriptorPool descriptor_pool, int width, in
 	attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[0].finalLayout   = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[0].finalLayout   = enable_gui ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
 	attachments[1].format = VulkanContext::get_supported_depth_format();
 	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -92,8 +96,6 @@ void RenderTaskPostProcess::init(VkDescriptorPool descriptor_pool, int width, in
 
 	// Create Pipelines
 	VulkanContext::PipelineDetails pipeline_details;
-	pipeline_details.width  = width;
-	pipeline_details.height = height;
 	pipeline_details.cull_mode = VK_CULL_MODE_NONE;
 	pipeline_details.blends = { VulkanContext::PipelineDetails::BLEND_NONE };
 	pipeline_details.shaders = {
@@ -105,7 +107,13 @@ void RenderTaskPostProcess::init(VkDescriptorPool descriptor_pool, int width, in
 	pipeline_details.pipeline_layout = pipeline_layouts.tonemap;
 	pipeline_details.render_pass     = render_pass;
 
-	pipelines.tonemap = VulkanContext::create_pipeline(pipeline_details);
+	// Shader constant 0 selects the Tonemap operator
+	for (int i = 0; i < Util::array_element_count(pipelines.tonemap); i++) {
+		pipeline_details.specialization_constants = { { 0, u32(i) } };
+
+		VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.tonemap[i]);
+	}
+	pipeline_details.specialization_constants.clear();
 
 	std::vector<VkVertexInputBindingDescription> gizmo_vertex_bindings(1);
 	gizmo_vertex_bindings[0].binding = 0;
@@ -129,39 +137,18 @@ void RenderTaskPostProcess::init(VkDescriptorPool descriptor_pool, int width, in
 	pipeline_details.enable_depth_write = true;
 	pipeline_details.pipeline_layout = pipeline_layouts.gizmo;
 
-	pipelines.gizmo = VulkanContext::create_pipeline(pipeline_details);
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.gizmo);
 
 	// Allocate and update Descriptor Sets
-	std::vector<VkDescriptorSetLayout> layouts(swapchain_image_count, descriptor_set_layout);
-
-	VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-	alloc_info.descriptorPool = descriptor_pool;
-	alloc_info.descriptorSetCount = layouts.size();
-	alloc_info.pSetLayouts        = layouts.data();
-
 	descriptor_sets.resize(swapchain_image_count);
-	VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets.data()));
-
-	for (int i = 0; i < descriptor_sets.size(); i++) {
-		auto & descriptor_set = descriptor_sets[i];
-
-		VkWriteDescriptorSet write_descriptor_sets[1] = { };
 
-		VkDescriptorImageInfo descriptor_image_colour = { };
-		descriptor_image_colour.sampler     = render_target_input.sampler;
-		descriptor_image_colour.imageView   = render_target_input.attachments[0].image_view;
-		descriptor_image_colour.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	for (auto & descriptor_set : descriptor_sets) {
+		descriptor_set = descriptor_allocator.allocate(descriptor_set_layout);
+	}
 
-		write_descriptor_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write_descriptor_sets[0].dstSet = descriptor_set;
-		write_descriptor_sets[0].dstBinding = 0;
-		write_descriptor_sets[0].dstArrayElement = 0;
-		write_descriptor_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		write_descriptor_sets[0].descriptorCount = 1;
-		write_descriptor_sets[0].pImageInfo = &descriptor_image_colour;
+	set_input(render_target_input);
 
-		vkUpdateDescriptorSets(device, Util::array_element_count(write_descriptor_sets), write_descriptor_sets, 0, nullptr);
-	}
+	if (!enable_gui) return;
 
 	// Init GUI
 	ImGui_ImplGlfw_InitForVulkan(window, true);
@@ -193,7 +180,7 @@ void RenderTaskPostProcess::init(VkDescriptorPool descriptor_pool, int width, in
 	init_info.Device         = device;
 	init_info.QueueFamily = VulkanContext::get_queue_family_graphics();
 	init_info.Queue       = VulkanContext::get_queue_graphics();
-	init_info.PipelineCache = nullptr;
+	init_info.PipelineCache = VulkanContext::get_pipeline_cache();
 	init_info.DescriptorPool = descriptor_pool_gui;
 	init_info.Allocator = nullptr;
 	init_info.MinImageCount = 2;
@@ -216,10 +203,14 @@ void RenderTaskPostProcess::free() {
 	vkDestroyPipelineLayout(device, pipeline_layouts.tonemap, nullptr);
 	vkDestroyPipelineLayout(device, pipeline_layouts.gizmo,   nullptr);
 
-	vkDestroyPipeline(device, pipelines.tonemap, nullptr);
-	vkDestroyPipeline(device, pipelines.gizmo,   nullptr);
+	for (auto pipeline : pipelines.tonemap) {
+		VulkanContext::destroy_pipeline(pipeline);
+	}
+	VulkanContext::destroy_pipeline(pipelines.gizmo);
 
-	vkDestroyRenderPass(device, render_pass, nullptr);
+	VulkanContext::destroy_render_pass(render_pass);
+
+	if (!enable_gui) return;
 
 	vkDestroyDescriptorPool(device, descriptor_pool_gui, nullptr);
 
@@ -227,7 +218,41 @@ void RenderTaskPostProcess::free() {
 	ImGui_ImplGlfw_Shutdown();
 }
 
+void RenderTaskPostProcess::resize(int width, int height, RenderTarget const & render_target_input) {
+	this->width  = width;
+	this->height = height;
+
+	set_input(render_target_input);
+}
+
+void RenderTaskPostProcess::set_input(RenderTarget const & render_target_input) {
+	auto device = VulkanContext::get_device();
+
+	for (int i = 0; i < descriptor_sets.size(); i++) {
+		auto & descriptor_set = descriptor_sets[i];
+
+		VkWriteDescriptorSet write_descriptor_sets[1] = { };
+
+		VkDescriptorImageInfo descriptor_image_colour = { };
+		descriptor_image_colour.sampler     = render_target_input.sampler;
+		descriptor_image_colour.imageView   = render_target_input.attachments[0].image_view;
+		descriptor_image_colour.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		write_descriptor_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_descriptor_sets[0].dstSet = descriptor_set;
+		write_descriptor_sets[0].dstBinding = 0;
+		write_descriptor_sets[0].dstArrayElement = 0;
+		write_descriptor_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write_descriptor_sets[0].descriptorCount = 1;
+		write_descriptor_sets[0].pImageInfo = &descriptor_image_colour;
+
+		vkUpdateDescriptorSets(device, Util::array_element_count(write_descriptor_sets), write_descriptor_sets, 0, nullptr);
+	}
+}
+
 void RenderTaskPostProcess::render(int image_index, VkCommandBuffer command_buffer, VkFramebuffer frame_buffer) {
+	PROFILE_SCOPE("RenderTaskPostProcess::render");
+
 	VkClearValue clear[2] = { };
 	clear[0].color        = { 0.0f, 0.0f, 0.0f, 0.0f };
 	clear[1].depthStencil = { 1.0f, 0 };
@@ -240,9 +265,10 @@ void RenderTaskPostProcess::render(int image_index, VkCommandBuffer command_buff
 	renderpass_begin_info.pClearValues    = clear;
 
 	vkCmdBeginRenderPass(command_buffer, &renderpass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	VulkanContext::set_viewport(command_buffer, width, height);
 
 	// Render tonemapped image
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.tonemap);
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.tonemap[int(tonemap)]);
 
 	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.tonemap, 0, 1, &descriptor_sets[image_index], 0, nullptr);
 	vkCmdDraw(command_buffer, 3, 1, 0, 0);
@@ -278,7 +304,7 @@ void RenderTaskPostProcess::render(int image_index, VkCommandBuffer command_buff
 	//}
 
 	// Render GUI
-	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), command_buffer);
+	if (enable_gui) ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), command_buffer);
 
 	vkCmdEndRenderPass(command_buffer);
 }
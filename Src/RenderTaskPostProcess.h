@@ -4,6 +4,8 @@
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 
+#include "DescriptorAllocator.h"
+
 #include "Scene.h"
 #include "Gizmo.h"
 
@@ -25,13 +27,24 @@ private:
 	} pipeline_layouts;
 
 	struct {
-		VkPipeline tonemap;
+		VkPipeline tonemap[3]; // One per Tonemap operator
 		VkPipeline gizmo;
 	} pipelines;
 
 	VkRenderPass render_pass;
 
+	bool enable_gui;
+
+	void set_input(RenderTarget const & render_target_input);
+
 public:
+	// Matches the TONEMAP_* defines in post_process.frag
+	enum struct Tonemap {
+		NONE,
+		REINHARD,
+		ACES
+	} tonemap = Tonemap::ACES;
+
 	Gizmo gizmo_position;
 	Gizmo gizmo_rotation;
 //	Gizmo gizmo_scale;
@@ -39,14 +52,12 @@ public:
 	RenderTaskPostProcess(Scene & scene);
 	~RenderTaskPostProcess();
 
-	void init(VkDescriptorPool descriptor_pool, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input, GLFWwindow * window);
+	void init(DescriptorAllocator & descriptor_allocator, int width, int height, int swapchain_image_count, RenderTarget const & render_target_input, GLFWwindow * window); // No GUI is rendered if window is nullptr
 	void free();
 
-	void render(int image_index, VkCommandBuffer command_buffer, VkFramebuffer frame_buffer);
+	void resize(int width, int height, RenderTarget const & render_target_input); // Only updates size dependent state, the Render Pass and Pipelines are kept
 
-	uint32_t get_num_descriptor_sets(uint32_t swapchain_image_count) {
-		return swapchain_image_count;
-	}
+	void render(int image_index, VkCommandBuffer command_buffer, VkFramebuffer frame_buffer);
 
 	VkRenderPass get_render_pass() { return render_pass; }
 };
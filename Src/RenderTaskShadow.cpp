@@ -5,23 +5,19 @@
 
 #include "Scene.h"
 
+#include "Profiler.h"
+
+// Same layout as the push constants of shadow_static.vert and shadow_animated.vert
 struct ShadowPushConstants {
-	alignas(16) Matrix4 wvp;
-	alignas(4)  int bone_offset;
+	alignas(16) Matrix4 light_matrix; // Animated Meshes have their world matrix baked in
 };
 
-void RenderTaskShadow::init(VkDescriptorPool descriptor_pool, int swapchain_image_count) {
+void RenderTaskShadow::init(DescriptorAllocator & descriptor_allocator, int swapchain_image_count) {
 	auto device = VulkanContext::get_device();
 
 	auto depth_format = VulkanContext::get_supported_depth_format();
 
-	// Create Descriptor Set Layout
-	VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-	layout_create_info.bindingCount = 0;
-	layout_create_info.pBindings    = nullptr;
-
-	VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.shadow_static));
-
+	// Create Descriptor Set Layout, Instances of static Meshes use a single Storage Buffer
 	VkDescriptorSetLayoutBinding bindings[1] = { };
 	bindings[0].binding = 0;
 	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
@@ -29,10 +25,11 @@ void RenderTaskShadow::init(VkDescriptorPool descriptor_pool, int swapchain_imag
 	bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	bindings[0].pImmutableSamplers = nullptr;
 
+	VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
 	layout_create_info.bindingCount = Util::array_element_count(bindings);
 	layout_create_info.pBindings    = bindings;
 
-	VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.shadow_animated));
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.shadow_static));
 
 	// Create Render Pass
 	VkAttachmentDescription depth_attachment = { };
@@ -69,16 +66,10 @@ void RenderTaskShadow::init(VkDescriptorPool descriptor_pool, int swapchain_imag
 
 	pipeline_layouts.shadow_static = VulkanContext::create_pipeline_layout(pipeline_layout_details);
 
-	pipeline_layout_details.descriptor_set_layouts = { descriptor_set_layouts.shadow_static, descriptor_set_layouts.shadow_animated };
-
-	pipeline_layouts.shadow_animated = VulkanContext::create_pipeline_layout(pipeline_layout_details);
-
 	// Create Pipeline
 	VulkanContext::PipelineDetails pipeline_details;
 	pipeline_details.vertex_bindings   = Mesh::Vertex::get_binding_descriptions();
 	pipeline_details.vertex_attributes = Mesh::Vertex::get_attribute_descriptions();
-	pipeline_details.width  = SHADOW_MAP_WIDTH;
-	pipeline_details.height = SHADOW_MAP_HEIGHT;
 	pipeline_details.cull_mode = VK_CULL_MODE_BACK_BIT;
 	pipeline_details.blends = { VulkanContext::PipelineDetails::BLEND_NONE };
 	pipeline_details.shaders = { { "Shaders/shadow_static.vert.spv", VK_SHADER_STAGE_VERTEX_BIT } }; // NOTE: no Fragment Shader, we only care about depth
@@ -86,39 +77,23 @@ void RenderTaskShadow::init(VkDescriptorPool descriptor_pool, int swapchain_imag
 	pipeline_details.pipeline_layout = pipeline_layouts.shadow_static;
 	pipeline_details.render_pass     = render_pass;
 
-	pipelines.shadow_static = VulkanContext::create_pipeline(pipeline_details);
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.shadow_static);
 
-	pipeline_details.vertex_bindings   = AnimatedMesh::Vertex::get_binding_descriptions();
-	pipeline_details.vertex_attributes = AnimatedMesh::Vertex::get_attribute_descriptions();
+	// Animated Meshes are drawn from their skinned Vertices, which use the same layout as static ones. The Instances are not used
 	pipeline_details.shaders = { { "Shaders/shadow_animated.vert.spv", VK_SHADER_STAGE_VERTEX_BIT } }; // NOTE: no Fragment Shader, we only care about depth
-	pipeline_details.pipeline_layout = pipeline_layouts.shadow_animated;
 
-	pipelines.shadow_animated = VulkanContext::create_pipeline(pipeline_details);
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.shadow_animated);
 
 	// Allocate and update Descriptor Sets
-	auto total_bone_count = 0;
-
-	for (auto const & mesh_instance : scene.animated_meshes) {
-		total_bone_count += scene.asset_manager.get_animated_mesh(mesh_instance.mesh_handle).bones.size();
-	}
-
-	std::vector<VkDescriptorSetLayout> layouts(swapchain_image_count, descriptor_set_layouts.shadow_animated);
+	descriptor_sets.instances.resize(swapchain_image_count);
 
-	VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-	alloc_info.descriptorPool = descriptor_pool;
-	alloc_info.descriptorSetCount = layouts.size();
-	alloc_info.pSetLayouts        = layouts.data();
-
-	descriptor_sets.bones.resize(swapchain_image_count);
-	VK_CHECK(vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets.bones.data()));
-
-	for (int i = 0; i < descriptor_sets.bones.size(); i++) {
-		auto descriptor_set = descriptor_sets.bones[i];
+	for (int i = 0; i < descriptor_sets.instances.size(); i++) {
+		auto descriptor_set = descriptor_sets.instances[i] = descriptor_allocator.allocate(descriptor_set_layouts.shadow_static);
 
 		VkDescriptorBufferInfo buffer_info = { };
-		buffer_info.buffer = scene.asset_manager.storage_buffer_bones[i].buffer;
+		buffer_info.buffer = scene.asset_manager.storage_buffer_instances[i].buffer;
 		buffer_info.offset = 0;
-		buffer_info.range  = total_bone_count * sizeof(Matrix4);
+		buffer_info.range  = VK_WHOLE_SIZE;
 
 		VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
 		write_descriptor_set.dstSet = descriptor_set;
@@ -135,16 +110,14 @@ void RenderTaskShadow::init(VkDescriptorPool descriptor_pool, int swapchain_imag
 void RenderTaskShadow::free() {
 	auto device = VulkanContext::get_device();
 
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.shadow_static,   nullptr);
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.shadow_animated, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.shadow_static, nullptr);
 
-	vkDestroyPipelineLayout(device, pipeline_layouts.shadow_static,   nullptr);
-	vkDestroyPipelineLayout(device, pipeline_layouts.shadow_animated, nullptr);
+	vkDestroyPipelineLayout(device, pipeline_layouts.shadow_static, nullptr);
 
-	vkDestroyPipeline(device, pipelines.shadow_static,   nullptr);
-	vkDestroyPipeline(device, pipelines.shadow_animated, nullptr);
+	VulkanContext::destroy_pipeline(pipelines.shadow_static);
+	VulkanContext::destroy_pipeline(pipelines.shadow_animated);
 
-	vkDestroyRenderPass(device, render_pass, nullptr);
+	VulkanContext::destroy_render_pass(render_pass);
 
 	for (auto & directional_light : scene.directional_lights) {
 		directional_light.shadow_map.render_target.free();
@@ -152,6 +125,8 @@ void RenderTaskShadow::free() {
 }
 
 void RenderTaskShadow::render(int image_index, VkCommandBuffer command_buffer) {
+	PROFILE_SCOPE("RenderTaskShadow::render");
+
 	for (auto const & directional_light : scene.directional_lights) {
 		VkRenderPassBeginInfo render_pass_begin_info = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
 		render_pass_begin_info.renderPass  = render_pass;
@@ -162,12 +137,15 @@ void RenderTaskShadow::render(int image_index, VkCommandBuffer command_buffer) {
 		render_pass_begin_info.pClearValues    = directional_light.shadow_map.render_target.clear_values.data();
 
 		vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+		VulkanContext::set_viewport(command_buffer, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT);
 
 		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadow_animated);
 
-		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.shadow_animated, 1, 1, &descriptor_sets.bones[image_index], 0, nullptr);
+		// The static and animated Pipelines share a Pipeline Layout, so the Instances stay bound for both
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layouts.shadow_static, 0, 1, &descriptor_sets.instances[image_index], 0, nullptr);
 
-		int bone_offset = 0;
+		// Every animated Mesh instance has its own range of skinned Vertices
+		int vertex_offset = 0;
 
 		for (int i = 0; i < scene.animated_meshes.size(); i++) {
 			auto const & mesh_instance = scene.animated_meshes[i];
@@ -176,15 +154,15 @@ void RenderTaskShadow::render(int image_index, VkCommandBuffer command_buffer) {
 			auto const & transform = mesh_instance.transform.matrix;
 
 			ShadowPushConstants push_constants = { };
-			push_constants.wvp = scene.directional_lights[0].get_light_matrix() * transform;
-			push_constants.bone_offset = bone_offset;
+			push_constants.light_matrix = scene.directional_lights[0].get_light_matrix() * transform;
 
-			bone_offset += mesh.bones.size();
+			vkCmdPushConstants(command_buffer, pipeline_layouts.shadow_static, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPushConstants), &push_constants);
 
-			vkCmdPushConstants(command_buffer, pipeline_layouts.shadow_animated, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPushConstants), &push_constants);
+			VkBuffer vertex_buffers[] = { scene.asset_manager.storage_buffer_skinned[image_index].buffer };
+			VkDeviceSize offsets[] = { vertex_offset * sizeof(Mesh::Vertex) };
+
+			vertex_offset += mesh.vertex_count;
 
-			VkBuffer vertex_buffers[] = { mesh.vertex_buffer.buffer };
-			VkDeviceSize offsets[] = { 0 };
 			vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
 
 			vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
@@ -198,28 +176,51 @@ void RenderTaskShadow::render(int image_index, VkCommandBuffer command_buffer) {
 
 		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadow_static);
 
-		for (int i = 0; i < scene.meshes.size(); i++) {
-			auto const & mesh_instance = scene.meshes[i];
-			auto const & mesh = scene.asset_manager.get_mesh(mesh_instance.mesh_handle);
+		// Static Meshes only need the light matrix, the world matrix of each instance comes from the Instances Buffer
+		ShadowPushConstants push_constants = { };
+		push_constants.light_matrix = scene.directional_lights[0].get_light_matrix();
 
-			auto const & transform = mesh_instance.transform.matrix;
+		vkCmdPushConstants(command_buffer, pipeline_layouts.shadow_static, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPushConstants), &push_constants);
 
-			ShadowPushConstants push_constants = { };
-			push_constants.wvp = scene.directional_lights[0].get_light_matrix() * transform;
+		// Only instances inside the light's frustum are drawn, found using the Scene BVH
+		Frustum light_frustum;
+		light_frustum.from_matrix(push_constants.light_matrix);
 
-			vkCmdPushConstants(command_buffer, pipeline_layouts.shadow_static, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ShadowPushConstants), &push_constants);
+		bvh_visible.clear();
+		scene.bvh.intersect_frustum(light_frustum, bvh_visible);
+		scene.bvh.sort_by_sub_mesh(bvh_visible);
 
-			VkBuffer     vertex_buffers[] = { mesh.vertex_buffer.buffer };
-			VkDeviceSize vertex_offsets[] = { 0 };
-			vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offsets);
+		auto last_batch_index = -1;
 
-			vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		for (int i = 0; i < bvh_visible.size(); ) {
+			auto const & first = scene.bvh.primitives[bvh_visible[i]];
 
-			for (int j = 0; j < mesh.sub_meshes.size(); j++) {
-				auto const & sub_mesh = mesh.sub_meshes[j];
+			auto const & batch    = scene.mesh_batches[first.batch_index];
+			auto const & mesh     = scene.asset_manager.get_mesh(batch.mesh_handle);
+			auto const & sub_mesh = mesh.sub_meshes[first.sub_mesh_index];
 
-				vkCmdDrawIndexed(command_buffer, sub_mesh.index_count, 1, sub_mesh.index_offset, 0, 0);
+			if (last_batch_index != first.batch_index) {
+				last_batch_index  = first.batch_index;
+
+				VkBuffer     vertex_buffers[] = { mesh.vertex_buffer.buffer };
+				VkDeviceSize vertex_offsets[] = { 0 };
+				vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, vertex_offsets);
+
+				vkCmdBindIndexBuffer(command_buffer, mesh.index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 			}
+
+			// Instances are indexed directly by slot, so every run of consecutive visible slots is a single instanced draw
+			auto slot_first = first.slot;
+			auto slot_count = 0;
+
+			for (; i < bvh_visible.size(); i++) {
+				auto const & primitive = scene.bvh.primitives[bvh_visible[i]];
+				if (primitive.batch_index != first.batch_index || primitive.sub_mesh_index != first.sub_mesh_index || primitive.slot != slot_first + slot_count) break;
+
+				slot_count++;
+			}
+
+			vkCmdDrawIndexed(command_buffer, sub_mesh.index_count, slot_count, sub_mesh.index_offset, 0, slot_first);
 		}
 
 		vkCmdEndRenderPass(command_buffer);
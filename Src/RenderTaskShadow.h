@@ -1,6 +1,8 @@
 #pragma once
 #include <vulkan/vulkan.h>
 
+#include "DescriptorAllocator.h"
+
 #include "Scene.h"
 
 struct RenderTaskShadow {
@@ -12,12 +14,10 @@ private:
 
 	struct {
 		VkDescriptorSetLayout shadow_static;
-		VkDescriptorSetLayout shadow_animated;
 	} descriptor_set_layouts;
 
 	struct {
-		VkPipelineLayout shadow_static;
-		VkPipelineLayout shadow_animated;
+		VkPipelineLayout shadow_static; // Also used by the animated Pipeline
 	} pipeline_layouts;
 
 	struct {
@@ -26,20 +26,18 @@ private:
 	} pipelines;
 
 	struct {
-		std::vector<VkDescriptorSet> bones;
+		std::vector<VkDescriptorSet> instances;
 	} descriptor_sets;
 
 	VkRenderPass render_pass;
 
+	std::vector<int> bvh_visible; // Primitives of the Scene BVH inside the light's frustum
+
 public:
 	RenderTaskShadow(Scene & scene) : scene(scene) { }
 
-	void init(VkDescriptorPool descriptor_pool, int swapchain_image_count);
+	void init(DescriptorAllocator & descriptor_allocator, int swapchain_image_count);
 	void free();
 
-	uint32_t get_num_descriptor_sets(uint32_t swapchain_image_count) {
-		return swapchain_image_count;
-	}
-
 	void render(int image_index, VkCommandBuffer command_buffer);
 };
@@ -0,0 +1,247 @@
+#include "RenderTaskSkinning.h"
+
+#include "VulkanCheck.h"
+#include "VulkanContext.h"
+
+#include "Math.h"
+#include "Util.h"
+#include "Profiler.h"
+
+struct SkinningPushConstants {
+	alignas(4) int bone_offset;
+	alignas(4) int vertex_offset;
+	alignas(4) int vertex_count;
+};
+
+static constexpr int SKINNING_GROUP_SIZE = 64; // Matches local_size in skinning.comp
+
+void RenderTaskSkinning::init(DescriptorAllocator & descriptor_allocator, int swapchain_image_count) {
+	auto device = VulkanContext::get_device();
+
+	// Create Descriptor Set Layouts
+	{
+		VkDescriptorSetLayoutBinding layout_bindings[2] = { };
+		layout_bindings[0].binding = 0;
+		layout_bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings[0].descriptorCount = 1;
+		layout_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		layout_bindings[1].binding = 1;
+		layout_bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings[1].descriptorCount = 1;
+		layout_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layout_create_info.bindingCount = Util::array_element_count(layout_bindings);
+		layout_create_info.pBindings    = layout_bindings;
+
+		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.frame));
+	}
+
+	{
+		VkDescriptorSetLayoutBinding layout_bindings[1] = { };
+		layout_bindings[0].binding = 0;
+		layout_bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings[0].descriptorCount = 1;
+		layout_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layout_create_info.bindingCount = Util::array_element_count(layout_bindings);
+		layout_create_info.pBindings    = layout_bindings;
+
+		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layouts.vertices));
+	}
+
+	// Create Pipeline
+	VulkanContext::PipelineLayoutDetails pipeline_layout_details;
+	pipeline_layout_details.descriptor_set_layouts = { descriptor_set_layouts.frame, descriptor_set_layouts.vertices };
+	pipeline_layout_details.push_constants = { { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants) } };
+
+	pipeline_layout = VulkanContext::create_pipeline_layout(pipeline_layout_details);
+
+	VulkanContext::PipelineDetails pipeline_details;
+	pipeline_details.shaders = { { "Shaders/skinning.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT } };
+	pipeline_details.specialization_constants = { { 0, VK_FALSE } }; // BONES_COMPACT
+	pipeline_details.pipeline_layout = pipeline_layout;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.full);
+
+	pipeline_details.specialization_constants[0].value = VK_TRUE;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipelines.compact);
+
+	// Create Storage Buffers, every animated Mesh instance has its own range of Bones and skinned Vertices
+	auto total_bone_count   = 0;
+	auto total_vertex_count = 0;
+
+	for (auto const & mesh_instance : scene.animated_meshes) {
+		auto const & mesh = scene.asset_manager.get_animated_mesh(mesh_instance.mesh_handle);
+
+		total_bone_count   += mesh.bones.size();
+		total_vertex_count += mesh.vertex_count;
+	}
+
+	// Vulkan does not allow empty Buffers, the Bone Buffers are large enough for either palette format
+	auto size_bones    = Math::max(total_bone_count,   1) * sizeof(Matrix4);
+	auto size_vertices = Math::max(total_vertex_count, 1) * sizeof(Mesh::Vertex);
+
+	scene.asset_manager.storage_buffer_bones  .reserve(swapchain_image_count);
+	scene.asset_manager.storage_buffer_skinned.reserve(swapchain_image_count);
+
+	for (int i = 0; i < swapchain_image_count; i++) {
+		scene.asset_manager.storage_buffer_bones.push_back(VulkanMemory::Buffer(size_bones,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		));
+
+		scene.asset_manager.storage_buffer_skinned.push_back(VulkanMemory::Buffer(size_vertices,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		));
+	}
+
+	bones_mapped.resize(swapchain_image_count);
+	for (int i = 0; i < swapchain_image_count; i++) {
+		bones_mapped[i] = reinterpret_cast<float *>(VulkanMemory::buffer_map(scene.asset_manager.storage_buffer_bones[i], size_bones));
+	}
+
+	// Nothing has been skinned yet, no instance can match this version
+	pose_versions.resize(swapchain_image_count);
+	for (auto & versions : pose_versions) {
+		versions.clear();
+		versions.resize(scene.animated_meshes.size(), u32(-1));
+	}
+
+	// Allocate and update Descriptor Sets, the Frame Set is allocated per Frame in render
+	descriptor_sets.vertices.resize(scene.asset_manager.animated_meshes.size());
+
+	for (int i = 0; i < descriptor_sets.vertices.size(); i++) {
+		auto descriptor_set = descriptor_sets.vertices[i] = descriptor_allocator.allocate(descriptor_set_layouts.vertices);
+
+		VkDescriptorBufferInfo buffer_info = { scene.asset_manager.animated_meshes[i].vertex_buffer.buffer, 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write_descriptor_set.dstSet = descriptor_set;
+		write_descriptor_set.dstBinding = 0;
+		write_descriptor_set.dstArrayElement = 0;
+		write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write_descriptor_set.descriptorCount = 1;
+		write_descriptor_set.pBufferInfo     = &buffer_info;
+
+		vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+	}
+}
+
+void RenderTaskSkinning::free() {
+	auto device = VulkanContext::get_device();
+
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.frame,    nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layouts.vertices, nullptr);
+
+	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+
+	VulkanContext::destroy_pipeline(pipelines.full);
+	VulkanContext::destroy_pipeline(pipelines.compact);
+
+	for (int i = 0; i < bones_mapped.size(); i++) {
+		VulkanMemory::buffer_unmap(scene.asset_manager.storage_buffer_bones[i]);
+	}
+	bones_mapped.clear();
+}
+
+// Most Frames skin nothing, so the Set is only allocated and written when a pose changed
+VkDescriptorSet RenderTaskSkinning::descriptor_set_frame_create(DescriptorAllocator & descriptor_allocator_transient, int image_index) {
+	auto descriptor_set = descriptor_allocator_transient.allocate(descriptor_set_layouts.frame);
+
+	VkDescriptorBufferInfo buffer_info_bones    = { scene.asset_manager.storage_buffer_bones  [image_index].buffer, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo buffer_info_vertices = { scene.asset_manager.storage_buffer_skinned[image_index].buffer, 0, VK_WHOLE_SIZE };
+
+	VkWriteDescriptorSet write_descriptor_sets[2] = { };
+	write_descriptor_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_sets[0].dstSet = descriptor_set;
+	write_descriptor_sets[0].dstBinding = 0;
+	write_descriptor_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write_descriptor_sets[0].descriptorCount = 1;
+	write_descriptor_sets[0].pBufferInfo     = &buffer_info_bones;
+
+	write_descriptor_sets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_sets[1].dstSet = descriptor_set;
+	write_descriptor_sets[1].dstBinding = 1;
+	write_descriptor_sets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write_descriptor_sets[1].descriptorCount = 1;
+	write_descriptor_sets[1].pBufferInfo     = &buffer_info_vertices;
+
+	vkUpdateDescriptorSets(VulkanContext::get_device(), Util::array_element_count(write_descriptor_sets), write_descriptor_sets, 0, nullptr);
+
+	return descriptor_set;
+}
+
+void RenderTaskSkinning::render(int image_index, VkCommandBuffer command_buffer, DescriptorAllocator & descriptor_allocator_transient) {
+	PROFILE_SCOPE("RenderTaskSkinning::render");
+
+	auto & versions = pose_versions[image_index];
+
+	// Bone matrices are row major, so the compact palette is simply the first three rows of each matrix
+	auto bone_rows = compact_bones ? 3 : 4;
+	auto bone_size = bone_rows * 4;
+
+	auto bones = bones_mapped[image_index];
+
+	bone_bytes_uploaded = 0;
+
+	bool skinned_any = false;
+
+	auto bone_offset   = 0;
+	auto vertex_offset = 0;
+
+	for (int i = 0; i < scene.animated_meshes.size(); i++) {
+		auto const & mesh_instance = scene.animated_meshes[i];
+		auto const & mesh          = scene.asset_manager.get_animated_mesh(mesh_instance.mesh_handle);
+
+		if (versions[i] != mesh_instance.pose_version) {
+			versions[i] = mesh_instance.pose_version;
+
+			if (!skinned_any) {
+				skinned_any = true;
+
+				auto descriptor_set_frame = descriptor_set_frame_create(descriptor_allocator_transient, image_index);
+
+				vkCmdBindPipeline      (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compact_bones ? pipelines.compact : pipelines.full);
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set_frame, 0, nullptr);
+			}
+
+			// Written straight into the mapped Buffer
+			for (int b = 0; b < mesh_instance.bone_transforms.size(); b++) {
+				std::memcpy(bones + (bone_offset + b) * bone_size, mesh_instance.bone_transforms[b].cells, bone_size * sizeof(float));
+			}
+			bone_bytes_uploaded += mesh_instance.bone_transforms.size() * bone_size * sizeof(float);
+
+			SkinningPushConstants push_constants = { };
+			push_constants.bone_offset   = bone_offset;
+			push_constants.vertex_offset = vertex_offset;
+			push_constants.vertex_count  = mesh.vertex_count;
+
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 1, 1, &descriptor_sets.vertices[mesh_instance.mesh_handle], 0, nullptr);
+			vkCmdPushConstants     (command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants), &push_constants);
+
+			vkCmdDispatch(command_buffer, (mesh.vertex_count + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE, 1, 1);
+		}
+
+		bone_offset   += mesh.bones.size();
+		vertex_offset += mesh.vertex_count;
+	}
+
+	if (!skinned_any) return;
+
+	// The GBuffer and Shadow passes read the skinned Vertices as Vertex attributes
+	VkBufferMemoryBarrier barrier = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = scene.asset_manager.storage_buffer_skinned[image_index].buffer;
+	barrier.offset = 0;
+	barrier.size   = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.h"
+
+#include "Scene.h"
+
+// Skins the Vertices of all animated Mesh instances once per Frame in a compute Shader, the GBuffer and Shadow passes then draw them as static Vertices
+// Instances whose pose did not change since the Buffer of a Swapchain Image was last written are not skinned again
+struct RenderTaskSkinning {
+private:
+	Scene & scene;
+
+	struct {
+		VkDescriptorSetLayout frame;    // Bones and skinned Vertices
+		VkDescriptorSetLayout vertices; // Vertices of an AnimatedMesh
+	} descriptor_set_layouts;
+
+	VkPipelineLayout pipeline_layout;
+
+	struct {
+		VkPipeline full;
+		VkPipeline compact;
+	} pipelines;
+
+	struct {
+		std::vector<VkDescriptorSet> vertices; // Indexed by AnimatedMeshHandle
+	} descriptor_sets;
+
+	std::vector<float *> bones_mapped; // Per Swapchain Image, the Bone Buffers stay mapped for the lifetime of the task
+
+	std::vector<std::vector<u32>> pose_versions; // Per Swapchain Image, AnimatedMeshInstance::pose_version when each instance was last skinned
+
+	VkDescriptorSet descriptor_set_frame_create(DescriptorAllocator & descriptor_allocator_transient, int image_index);
+
+public:
+	// Bone matrices are affine, so the compact palette drops their constant bottom row (48 instead of 64 bytes per Bone)
+	// The palette is rewritten for every instance that is skinned, so this can be changed at any time
+	bool compact_bones = true;
+
+	size_t bone_bytes_uploaded = 0; // Size of the Bone palettes written in the last Frame
+
+	RenderTaskSkinning(Scene & scene) : scene(scene) { }
+
+	void init(DescriptorAllocator & descriptor_allocator, int swapchain_image_count);
+	void free();
+
+	// Must be recorded outside of a Render Pass, before the GBuffer and Shadow passes
+	// The Bones and skinned Vertices are bound with a Set from the transient allocator of the current Frame in flight
+	void render(int image_index, VkCommandBuffer command_buffer, DescriptorAllocator & descriptor_allocator_transient);
+};
@@ -1,5 +1,7 @@
 #include "Renderer.h"
 
+#include <algorithm>
+
 #include <Imgui/imgui.h>
 #include <Imgui/imgui_impl_glfw.h>
 #include <Imgui/imgui_impl_vulkan.h>
@@ -7,93 +9,223 @@
 #include "VulkanCheck.h"
 #include "VulkanContext.h"
 
+#include "Math.h"
 #include "Vector2.h"
 #include "Vector3.h"
 #include "Matrix4.h"
 
 #include "Input.h"
 #include "Util.h"
+#include "Profiler.h"
 
-Renderer::Renderer(GLFWwindow * window, u32 width, u32 height) :
-	scene(width, height),
+Renderer::Renderer(GLFWwindow * window, u32 width, u32 height, std::string const & scene_name, FramePacing const & frame_pacing, GBufferLayout gbuffer_layout, bool visibility_buffer) :
+	scene(width, height, scene_name),
+	render_task_skinning    (scene),
 	render_task_gbuffer     (scene),
 	render_task_shadow      (scene),
 	render_task_lighting    (scene),
 	render_task_post_process(scene)
 {
-	auto device = VulkanContext::get_device();
-
 	this->width  = width;
 	this->height = height;
 
 	this->window = window;
 
-	swapchain_create();
+	this->frame_pacing = frame_pacing;
+	this->frame_pacing.frames_in_flight = Math::clamp(frame_pacing.frames_in_flight, 1, MAX_FRAMES_IN_FLIGHT);
 
-	VkSemaphoreCreateInfo semaphore_create_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	this->gbuffer_layout   = gbuffer_layout;
+	gbuffer_layout_pending = gbuffer_layout;
 
-	VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-	fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	this->visibility_buffer   = visibility_buffer;
+	visibility_buffer_pending = visibility_buffer;
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &semaphores_image_available[i]));
-		VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &semaphores_render_done    [i]));
+	descriptor_allocator.init();
 
-		VK_CHECK(vkCreateFence(device, &fence_create_info, nullptr, &fences[i]));
-	}
+	swapchain_create();
+	sync_create();
+
+	frame_pacing_pending = this->frame_pacing;
 }
 
 Renderer::~Renderer() {
-	auto device = VulkanContext::get_device();
-
 	swapchain_destroy();
+	sync_destroy();
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		vkDestroySemaphore(device, semaphores_image_available[i], nullptr);
-		vkDestroySemaphore(device, semaphores_render_done    [i], nullptr);
+	descriptor_allocator.free();
 
-		vkDestroyFence(device, fences[i], nullptr);
-	}
+	if (window) vkDestroySwapchainKHR(VulkanContext::get_device(), swapchain, nullptr);
 }
 
 void Renderer::swapchain_create() {
-	swapchain = VulkanContext::create_swapchain(width, height);
+	swapchain_images_create();
+	render_tasks_create();
+	frame_buffers_create();
+}
 
+void Renderer::swapchain_destroy() {
+	frame_buffers_destroy();
+	render_tasks_destroy();
+	swapchain_images_destroy();
+}
+
+void Renderer::swapchain_recreate() {
+	PROFILE_SCOPE("Renderer::swapchain_recreate");
+
+	auto time_start = Clock::now();
+
+	// Wait until all Frames in flight are done, only the present Queue is waited on before the old Swapchain is destroyed
+	for (int i = 0; i < frame_timeline_values.size(); i++) {
+		wait_for_frame(i);
+	}
+
+	auto image_count = swapchain_views.size();
+
+	frame_buffers_destroy();
+	swapchain_images_destroy();
+	swapchain_images_create();
+
+	if (swapchain_views.size() == image_count) {
+		// Only the render targets and the Descriptors that refer to them depend on the size
+		render_task_gbuffer     .resize(width, height);
+		render_task_lighting    .resize(width, height, render_task_gbuffer .get_render_target());
+		render_task_post_process.resize(width, height, render_task_lighting.get_render_target());
+	} else {
+		// Per Image resources depend on the number of Swapchain Images, these need to be rebuilt entirely
+		render_tasks_destroy();
+		render_tasks_create();
+	}
+
+	frame_buffers_create();
+
+	printf("Recreated SwapChain (%ux%u) in %.2f ms\n", width, height, std::chrono::duration<float, std::milli>(Clock::now() - time_start).count());
+}
+
+void Renderer::swapchain_images_create() {
 	auto device = VulkanContext::get_device();
 
-	// Create Swapchain and its Image Views
-	u32                  swapchain_image_count;                   vkGetSwapchainImagesKHR(device, swapchain, &swapchain_image_count, nullptr);
-	std::vector<VkImage> swapchain_images(swapchain_image_count); vkGetSwapchainImagesKHR(device, swapchain, &swapchain_image_count, swapchain_images.data());
+	u32                  swapchain_image_count;
+	std::vector<VkImage> swapchain_images;
 
-	swapchain_views .resize(swapchain_image_count);
-	fences_in_flight.resize(swapchain_image_count, nullptr);
+	if (window) {
+		// Create Swapchain and its Image Views, the previous Swapchain (if any) is retired
+		auto old_swapchain = swapchain;
+
+		swapchain = VulkanContext::create_swapchain(width, height, frame_pacing.present_mode, old_swapchain);
+
+		// The Frame fences do not cover presentation, Images of the old Swapchain may still be queued for present.
+		// Presents have no fence that signals when they are done, so only an idle present Queue makes destroying it safe
+		if (old_swapchain != VK_NULL_HANDLE) {
+			VK_CHECK(vkQueueWaitIdle(VulkanContext::get_queue_present()));
+
+			vkDestroySwapchainKHR(device, old_swapchain, nullptr);
+		}
+
+		vkGetSwapchainImagesKHR(device, swapchain, &swapchain_image_count, nullptr);
+		swapchain_images.resize(swapchain_image_count);
+		vkGetSwapchainImagesKHR(device, swapchain, &swapchain_image_count, swapchain_images.data());
+	} else {
+		// Create offscreen Images that take the place of the Swapchain
+		swapchain_image_count = HEADLESS_IMAGE_COUNT;
+		swapchain_images.resize(swapchain_image_count);
+
+		offscreen_images       .resize(swapchain_image_count);
+		offscreen_images_memory.resize(swapchain_image_count);
+
+		for (int i = 0; i < swapchain_image_count; i++) {
+			VulkanMemory::create_image(
+				width, height, 1,
+				VulkanContext::FORMAT.format,
+				VK_IMAGE_TILING_OPTIMAL,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				offscreen_images[i], offscreen_images_memory[i]
+			);
+
+			swapchain_images[i] = offscreen_images[i];
+		}
+	}
+
+	swapchain_views      .resize(swapchain_image_count);
+	image_timeline_values.clear();
+	image_timeline_values.resize(swapchain_image_count, 0);
 
 	for (int i = 0; i < swapchain_image_count; i++) {
 		swapchain_views[i] = VulkanMemory::create_image_view(swapchain_images[i], 1, VulkanContext::FORMAT.format, VK_IMAGE_ASPECT_COLOR_BIT);
 	}
+}
+
+void Renderer::swapchain_images_destroy() {
+	auto device = VulkanContext::get_device();
+
+	for (int i = 0; i < swapchain_views.size(); i++) {
+		vkDestroyImageView(device, swapchain_views[i], nullptr);
+	}
+
+	// NOTE: the Swapchain itself is kept alive, so that it can be passed as old Swapchain when recreating
+	if (window == nullptr) {
+		for (int i = 0; i < offscreen_images.size(); i++) {
+			vkDestroyImage(device, offscreen_images       [i], nullptr);
+			vkFreeMemory  (device, offscreen_images_memory[i], nullptr);
+		}
+	}
+}
+
+void Renderer::render_tasks_create() {
+	auto device = VulkanContext::get_device();
+
+	render_task_skinning    .init(descriptor_allocator, swapchain_views.size());
+	render_task_gbuffer     .init(descriptor_allocator, width, height, swapchain_views.size(), gbuffer_layout, visibility_buffer);
+	render_task_shadow      .init(descriptor_allocator, swapchain_views.size());
+	render_task_lighting    .init(descriptor_allocator, width, height, swapchain_views.size(), render_task_gbuffer .get_render_target(), gbuffer_layout);
+	render_task_post_process.init(descriptor_allocator, width, height, swapchain_views.size(), render_task_lighting.get_render_target(), window);
+
+	// The Render Tasks only queue their Pipelines, create them all at once
+	VulkanContext::compile_pipelines();
+
+	// Create Command Buffers
+	command_buffers.resize(swapchain_views.size());
+
+	VkCommandBufferAllocateInfo command_buffer_alloc_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	command_buffer_alloc_info.commandPool = VulkanContext::get_command_pool();
+	command_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_alloc_info.commandBufferCount = command_buffers.size();
+
+	VK_CHECK(vkAllocateCommandBuffers(device, &command_buffer_alloc_info, command_buffers.data()));
+
+	command_buffers_compute.resize(swapchain_views.size());
+	command_buffer_alloc_info.commandPool = VulkanContext::get_command_pool_compute();
+
+	VK_CHECK(vkAllocateCommandBuffers(device, &command_buffer_alloc_info, command_buffers_compute.data()));
+
+	gpu_profiler        .init(swapchain_views.size());
+	gpu_profiler_compute.init(swapchain_views.size());
+}
+
+void Renderer::render_tasks_destroy() {
+	auto device       = VulkanContext::get_device();
+	auto command_pool = VulkanContext::get_command_pool();
 
-	// Create Descriptor Pool
-	VkDescriptorPoolSize descriptor_pool_sizes[] = {
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1024 },
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1024 }
-	};
+	render_task_skinning    .free();
+	render_task_gbuffer     .free();
+	render_task_shadow      .free();
+	render_task_lighting    .free();
+	render_task_post_process.free();
+
+	scene.asset_manager.storage_buffer_bones    .clear();
+	scene.asset_manager.storage_buffer_skinned  .clear();
+	scene.asset_manager.storage_buffer_instances.clear();
 
-	VkDescriptorPoolCreateInfo pool_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-	pool_create_info.poolSizeCount = Util::array_element_count(descriptor_pool_sizes);
-	pool_create_info.pPoolSizes    = descriptor_pool_sizes;
-	pool_create_info.maxSets =
-		render_task_gbuffer     .get_num_descriptor_sets(swapchain_views.size()) +
-		render_task_shadow      .get_num_descriptor_sets(swapchain_views.size()) +
-		render_task_lighting    .get_num_descriptor_sets(swapchain_views.size()) +
-		render_task_post_process.get_num_descriptor_sets(swapchain_views.size());
+	descriptor_allocator.reset();
 
-	VK_CHECK(vkCreateDescriptorPool(device, &pool_create_info, nullptr, &descriptor_pool));
+	vkFreeCommandBuffers(device, command_pool,                              command_buffers        .size(), command_buffers        .data());
+	vkFreeCommandBuffers(device, VulkanContext::get_command_pool_compute(), command_buffers_compute.size(), command_buffers_compute.data());
 
-	render_task_gbuffer     .init(descriptor_pool, width, height, swapchain_views.size());
-	render_task_shadow      .init(descriptor_pool, swapchain_views.size());
-	render_task_lighting    .init(descriptor_pool, width, height, swapchain_views.size(), render_task_gbuffer .get_render_target());
-	render_task_post_process.init(descriptor_pool, width, height, swapchain_views.size(), render_task_lighting.get_render_target(), window);
+	gpu_profiler        .free();
+	gpu_profiler_compute.free();
+}
 
+void Renderer::frame_buffers_create() {
 	auto depth_format = VulkanContext::get_supported_depth_format();
 
 	// Create Depth Buffer
@@ -114,48 +246,183 @@ void Renderer::swapchain_create() {
 	for (int i = 0; i < swapchain_views.size(); i++) {
 		frame_buffers[i] = VulkanContext::create_frame_buffer(width, height, render_task_post_process.get_render_pass(), { swapchain_views[i], depth_image_view });
 	}
+}
 
-	// Create Command Buffers
-	command_buffers.resize(swapchain_views.size());
+void Renderer::frame_buffers_destroy() {
+	auto device = VulkanContext::get_device();
 
-	VkCommandBufferAllocateInfo command_buffer_alloc_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
-	command_buffer_alloc_info.commandPool = VulkanContext::get_command_pool();
-	command_buffer_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	command_buffer_alloc_info.commandBufferCount = command_buffers.size();
+	vkDestroyImage    (device, depth_image,        nullptr);
+	vkDestroyImageView(device, depth_image_view,   nullptr);
+	vkFreeMemory      (device, depth_image_memory, nullptr);
 
-	VK_CHECK(vkAllocateCommandBuffers(device, &command_buffer_alloc_info, command_buffers.data()));
+	for (int i = 0; i < frame_buffers.size(); i++) {
+		vkDestroyFramebuffer(device, frame_buffers[i], nullptr);
+	}
 }
 
-void Renderer::swapchain_destroy() {
-	auto device       = VulkanContext::get_device();
-	auto command_pool = VulkanContext::get_command_pool();
+void Renderer::sync_create() {
+	auto device = VulkanContext::get_device();
 
-	render_task_gbuffer     .free();
-	render_task_shadow      .free();
-	render_task_lighting    .free();
-	render_task_post_process.free();
+	int frames_in_flight = frame_pacing.frames_in_flight;
 
-	scene.asset_manager.storage_buffer_bones.clear();
+	semaphores_image_available.resize(frames_in_flight);
+	semaphores_render_done    .resize(frames_in_flight);
 
-	vkDestroyImage    (device, depth_image,        nullptr);
-	vkDestroyImageView(device, depth_image_view,   nullptr);
-	vkFreeMemory      (device, depth_image_memory, nullptr);
+	frame_timeline_values.clear();
+	frame_timeline_values.resize(frames_in_flight, 0);
 
-	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+	latency.time_submit.clear();
+	latency.time_submit.resize(frames_in_flight);
 
-	vkFreeCommandBuffers(device, command_pool, command_buffers.size(), command_buffers.data());
+	descriptor_allocators_transient.resize(frames_in_flight);
+	for (auto & allocator : descriptor_allocators_transient) {
+		allocator.init(64);
+	}
 
-	for (int i = 0; i < swapchain_views.size(); i++) {
-		vkDestroyFramebuffer(device, frame_buffers[i], nullptr);
-		vkDestroyImageView  (device, swapchain_views[i], nullptr);
+	VkSemaphoreCreateInfo semaphore_create_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+	for (int i = 0; i < frames_in_flight; i++) {
+		VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &semaphores_image_available[i]));
+		VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &semaphores_render_done    [i]));
+	}
+
+	VkSemaphoreTypeCreateInfo semaphore_type_create_info = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphore_type_create_info.initialValue  = 0;
+
+	semaphore_create_info.pNext = &semaphore_type_create_info;
+
+	VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &timeline_compute));
+	timeline_compute_value = 0;
+
+	current_frame = 0;
+}
+
+void Renderer::sync_destroy() {
+	auto device = VulkanContext::get_device();
+
+	for (int i = 0; i < semaphores_image_available.size(); i++) {
+		vkDestroySemaphore(device, semaphores_image_available[i], nullptr);
+		vkDestroySemaphore(device, semaphores_render_done    [i], nullptr);
+	}
+
+	vkDestroySemaphore(device, timeline_compute, nullptr);
+
+	for (auto & allocator : descriptor_allocators_transient) {
+		allocator.free();
+	}
+
+	// NOTE: image_timeline_values remain valid, the Context's timeline Semaphore outlives the Frames in flight
+}
+
+void Renderer::set_frame_pacing(FramePacing const & frame_pacing) {
+	auto frames_in_flight = Math::clamp(frame_pacing.frames_in_flight, 1, MAX_FRAMES_IN_FLIGHT);
+
+	bool needs_sync_recreate      = frames_in_flight != this->frame_pacing.frames_in_flight;
+	bool needs_swapchain_recreate = window && frame_pacing.present_mode != this->frame_pacing.present_mode;
+
+	// Semaphores may still be in use by the presentation engine, this is rare enough to just wait for the whole Device
+	if (needs_sync_recreate) {
+		VK_CHECK(vkDeviceWaitIdle(VulkanContext::get_device()));
+		sync_destroy();
+	}
+
+	this->frame_pacing = frame_pacing;
+	this->frame_pacing.frames_in_flight = frames_in_flight;
+
+	if (needs_sync_recreate) sync_create();
+	if (needs_swapchain_recreate) swapchain_recreate(); // Updates the Present Mode if the requested one is not supported
+
+	frame_pacing_pending = this->frame_pacing;
+}
+
+void Renderer::set_gbuffer_layout(GBufferLayout gbuffer_layout) {
+	if (gbuffer_layout == this->gbuffer_layout) return;
+
+	this->gbuffer_layout   = gbuffer_layout;
+	gbuffer_layout_pending = gbuffer_layout;
+
+	// Every Render Task that touches the GBuffer or the HDR target depends on the formats, recreating them all is simplest
+	render_tasks_recreate();
+
+	printf("Switched to %s GBuffer layout (%u bytes/pixel)\n", gbuffer_layout_name(gbuffer_layout), GBufferFormats::get(gbuffer_layout).get_bytes_per_pixel());
+}
+
+void Renderer::set_visibility_buffer(bool visibility_buffer) {
+	if (visibility_buffer == this->visibility_buffer) return;
+
+	this->visibility_buffer   = visibility_buffer;
+	visibility_buffer_pending = visibility_buffer;
+
+	render_tasks_recreate();
+
+	printf("Switched Visibility Buffer %s\n", render_task_gbuffer.is_visibility_buffer() ? "on" : "off");
+}
+
+void Renderer::render_tasks_recreate() {
+	VK_CHECK(vkDeviceWaitIdle(VulkanContext::get_device()));
+
+	frame_buffers_destroy();
+	render_tasks_destroy();
+	render_tasks_create();
+	frame_buffers_create();
+}
+
+void Renderer::wait_for_frame(int frame) {
+	VulkanContext::timeline_wait(frame_timeline_values[frame]);
+
+	// The GPU is done with this Frame, so its transient Descriptor Sets can be recycled
+	descriptor_allocators_transient[frame].reset();
+
+	// If the value was already reached before we started waiting, this overestimates the latency
+	auto & time_submit = latency.time_submit[frame];
+	if (time_submit != Clock::time_point()) {
+		float submit_to_done = std::chrono::duration<float, std::milli>(Clock::now() - time_submit).count();
+		latency.submit_to_done += LATENCY_SMOOTHING * (submit_to_done - latency.submit_to_done);
+
+		time_submit = Clock::time_point();
 	}
+}
+
+void Renderer::resolve_gpu_timings(int image_index) {
+	GPUProfiler::FrameResult gpu_result;
+	if (!gpu_profiler.resolve(image_index, gpu_result)) return;
+
+	// The compute Queue finished before the graphics Queue could, since the graphics Queue waited on it
+	GPUProfiler::FrameResult gpu_result_compute;
+	if (gpu_profiler_compute.resolve(image_index, gpu_result_compute)) {
+		gpu_result.passes.insert(gpu_result.passes.end(), gpu_result_compute.passes.begin(), gpu_result_compute.passes.end());
+	}
+
+	if (record_gpu_timings) gpu_timings_history.push_back(gpu_result);
 
-	vkDestroySwapchainKHR(device, swapchain, nullptr);
+	gpu_timings = std::move(gpu_result);
+}
+
+void Renderer::begin_frame() {
+	if (frame_pacing_needs_update) {
+		set_frame_pacing(frame_pacing_pending);
+		frame_pacing_needs_update = false;
+	}
+
+	set_gbuffer_layout(gbuffer_layout_pending);
+	set_visibility_buffer(visibility_buffer_pending);
+
+	if (frame_pacing.wait_to_start) {
+		PROFILE_SCOPE("Wait to Start");
+		wait_for_frame(current_frame);
+	}
+
+	latency.time_input_sample = Clock::now();
 }
 
 void Renderer::update(float delta) {
+	PROFILE_SCOPE("Renderer::update");
+
 	scene.update(delta);
 
+	if (Input::is_key_pressed(GLFW_KEY_F9)) Profiler::capture(PROFILE_HOTKEY_FRAME_COUNT);
+
 	//int mouse_x, mouse_y; Input::get_mouse_pos(&mouse_x, &mouse_y);
 	//if (render_task_post_process.gizmo_position.intersects_mouse(scene.camera, mouse_x, mouse_y)) {
 	//	printf("test");
@@ -194,6 +461,10 @@ void Renderer::update(float delta) {
 	}
 
 	// Update GUI
+	if (window == nullptr) return;
+
+	PROFILE_SCOPE("GUI");
+
 	ImGui_ImplVulkan_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
 	ImGui::NewFrame();
@@ -204,6 +475,63 @@ void Renderer::update(float delta) {
 	ImGui::Text("Min:   %.2f ms", 1000.0f * timing.frame_min);
 	ImGui::Text("Max:   %.2f ms", 1000.0f * timing.frame_max);
 	ImGui::Text("FPS:   %d", timing.fps);
+
+	ImGui::Text("GPU:   %.2f ms", gpu_timings.total_ms);
+	for (auto const & pass : gpu_timings.passes) {
+		ImGui::Text(" %-12s %.2f ms", pass.name, pass.time_ms);
+	}
+
+	if (VulkanContext::has_async_compute()) {
+		ImGui::Checkbox("Async Compute", &async_compute);
+	} else {
+		ImGui::Text("Async Compute: unsupported");
+	}
+	ImGui::End();
+
+	ImGui::Begin("Frame Pacing");
+
+	// The Combo items are in the same order as the VkPresentModeKHR values
+	int present_mode = int(frame_pacing_pending.present_mode);
+
+	bool changed = false;
+	changed |= ImGui::SliderInt("Frames in Flight", &frame_pacing_pending.frames_in_flight, 1, MAX_FRAMES_IN_FLIGHT);
+	changed |= ImGui::Combo    ("Present Mode",     &present_mode, "Immediate\0Mailbox\0FIFO\0FIFO Relaxed\0");
+	changed |= ImGui::Checkbox ("Wait to Start",    &frame_pacing_pending.wait_to_start);
+
+	frame_pacing_pending.present_mode = VkPresentModeKHR(present_mode);
+
+	if (changed) frame_pacing_needs_update = true;
+
+	ImGui::Text("Input to Submit: %.2f ms", latency.input_to_submit);
+	ImGui::Text("Submit to Done:  %.2f ms", latency.submit_to_done);
+	ImGui::Text("Total Latency:   %.2f ms", latency.input_to_submit + latency.submit_to_done);
+	ImGui::End();
+
+	// Both settings select between prebuilt Pipeline permutations, no Pipelines are created at runtime
+	ImGui::Begin("Shaders");
+
+	int tonemap = int(render_task_post_process.tonemap);
+
+	ImGui::SliderInt("Shadow PCF Range", &render_task_lighting.shadow_pcf_range, 0, RenderTaskLighting::SHADOW_PCF_RANGE_MAX);
+	ImGui::Combo    ("Tonemap",          &tonemap, "None\0Reinhard\0ACES\0");
+
+	render_task_post_process.tonemap = RenderTaskPostProcess::Tonemap(tonemap);
+
+	ImGui::End();
+
+	// Switching layouts recreates all Render Tasks, compare the GBuffer and Lighting GPU timings before and after
+	ImGui::Begin("GBuffer");
+
+	int layout = int(gbuffer_layout_pending);
+	ImGui::Combo("Layout", &layout, "Standard\0Compact\0");
+	gbuffer_layout_pending = GBufferLayout(layout);
+
+	ImGui::Text("Bytes/Pixel: %u (excluding Depth)", GBufferFormats::get(gbuffer_layout).get_bytes_per_pixel());
+
+	ImGui::Checkbox("Visibility Buffer", &visibility_buffer_pending);
+	if (visibility_buffer && !render_task_gbuffer.is_visibility_buffer()) {
+		ImGui::Text("Not supported, using the GBuffer");
+	}
 	ImGui::End();
 
 	static AnimatedMeshInstance * selected_animated_mesh = nullptr;
@@ -214,8 +542,18 @@ void Renderer::update(float delta) {
 	auto dir = scene.directional_lights[0].get_direction();
 	ImGui::Text("Sun: %f, %f, %f", dir.x, dir.y, dir.z);
 	ImGui::Text("Culled Lights %i/%i", render_task_lighting.num_culled_lights, scene.point_lights.size() + scene.spot_lights.size());
+	if (render_task_gbuffer.is_gpu_driven()) {
+		auto const & stats = render_task_gbuffer.cull_stats_gpu;
+
+		ImGui::Checkbox("Occlusion Culling", &render_task_gbuffer.occlusion_culling);
+		ImGui::Text("GPU Drawn Submeshes %i (Late %i)", stats.drawn, stats.drawn_late);
+		ImGui::Text("GPU Culled Submeshes %i (Frustum %i, Occlusion %i)", stats.culled_frustum + stats.culled_occlusion, stats.culled_frustum, stats.culled_occlusion);
+	}
 
-	if (ImGui::Button("Animation")) {
+	ImGui::Checkbox("Compact Bone Palette", &render_task_skinning.compact_bones);
+	ImGui::Text("Bone Upload: %zu bytes", render_task_skinning.bone_bytes_uploaded);
+
+	if (scene.animated_meshes.size() > 2 && ImGui::Button("Animation")) {
 		auto & anim_mesh = scene.animated_meshes[2];
 
 		if (anim_mesh.is_playing()) {
@@ -232,10 +570,16 @@ void Renderer::update(float delta) {
 		}
 	}
 
-	for (auto & mesh : scene.meshes) {
-		if (ImGui::Button(mesh.name.c_str())) {
-			selected_mesh = &mesh;
-			selected_animated_mesh = nullptr;
+	// Only the visible buttons are submitted, Scenes can contain many instances
+	ImGuiListClipper clipper(scene.meshes.size());
+	while (clipper.Step()) {
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+			auto & mesh = scene.meshes[i];
+
+			if (ImGui::Button(mesh.name.c_str())) {
+				selected_mesh = &mesh;
+				selected_animated_mesh = nullptr;
+			}
 		}
 	}
 
@@ -246,8 +590,30 @@ void Renderer::update(float delta) {
 		ImGui::SliderFloat ("Scale",   &selected_animated_mesh->transform.scale, 0.0f, 10.0f);
 
 		ImGui::Text("Material:");
-		ImGui::SliderFloat("Roughness", &selected_animated_mesh->material->roughness, 0.0f, 1.0f);
-		ImGui::SliderFloat("Metallic",  &selected_animated_mesh->material->metallic,  0.0f, 1.0f);
+		bool material_changed = false;
+		material_changed |= ImGui::SliderFloat("Roughness", &selected_animated_mesh->material->roughness, 0.0f, 1.0f);
+		material_changed |= ImGui::SliderFloat("Metallic",  &selected_animated_mesh->material->metallic,  0.0f, 1.0f);
+
+		if (material_changed) scene.materials_version++;
+
+		// Replaces the Texture of all Submeshes of the Mesh, the Texture is loaded after init so its Descriptors are written here
+		static char texture_filename[256] = "";
+		ImGui::InputText("Texture", texture_filename, sizeof(texture_filename));
+
+		if (ImGui::Button("Load Texture")) {
+			// Frames in flight may still use the Descriptors that are about to be written
+			VK_CHECK(vkDeviceWaitIdle(VulkanContext::get_device()));
+
+			auto texture_handle = scene.asset_manager.load_texture(texture_filename);
+
+			if (render_task_gbuffer.textures_update(descriptor_allocator)) {
+				auto & mesh = scene.asset_manager.get_animated_mesh(selected_animated_mesh->mesh_handle);
+
+				for (auto & sub_mesh : mesh.sub_meshes) {
+					sub_mesh.texture_handle = texture_handle;
+				}
+			}
+		}
 
 		ImGui::Text("Animation:");
 	} else if (selected_mesh) {
@@ -257,8 +623,11 @@ void Renderer::update(float delta) {
 		ImGui::SliderFloat ("Scale",   &selected_mesh->transform.scale, 0.0f, 10.0f);
 
 		ImGui::Text("Material:");
-		ImGui::SliderFloat("Roughness", &selected_mesh->material->roughness, 0.0f, 1.0f);
-		ImGui::SliderFloat("Metallic",  &selected_mesh->material->metallic,  0.0f, 1.0f);
+		bool material_changed = false;
+		material_changed |= ImGui::SliderFloat("Roughness", &selected_mesh->material->roughness, 0.0f, 1.0f);
+		material_changed |= ImGui::SliderFloat("Metallic",  &selected_mesh->material->metallic,  0.0f, 1.0f);
+
+		if (material_changed) scene.materials_version++;
 	}
 
 	ImGui::End();
@@ -266,57 +635,168 @@ void Renderer::update(float delta) {
 }
 
 void Renderer::render() {
+	PROFILE_SCOPE("Renderer::render");
+
 	auto device         = VulkanContext::get_device();
 	auto queue_graphics = VulkanContext::get_queue_graphics();
+	auto queue_compute  = VulkanContext::get_queue_compute();
 	auto queue_present  = VulkanContext::get_queue_present();
 
 	auto semaphore_image_available = semaphores_image_available[current_frame];
 	auto semaphore_render_done     = semaphores_render_done    [current_frame];
 
-	auto fence = fences[current_frame];
+	// Wait until previous Frame is done, in case we did not already wait before sampling input
+	if (!frame_pacing.wait_to_start) {
+		PROFILE_SCOPE("Wait for Frame");
+		wait_for_frame(current_frame);
+	}
+
+	u32 image_index;
+	if (window) {
+		PROFILE_SCOPE("Acquire");
+		VK_CHECK(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, semaphore_image_available, VK_NULL_HANDLE, &image_index));
+	} else {
+		image_index = frame_number % swapchain_views.size();
+	}
+
+	// Wait until the Image is no longer in use, before its Command Buffer gets rerecorded
+	VulkanContext::timeline_wait(image_timeline_values[image_index]);
+
+	// The previous Frame that used this Image has finished, read back its GPU timings
+	resolve_gpu_timings(image_index);
+
+	// Culling on the GPU is only needed when its results are drawn indirectly, the async path and the graphics Queue's wait on it are skipped otherwise
+	bool cull  = render_task_gbuffer.is_gpu_driven();
+	bool async = cull && render_task_gbuffer.can_cull_async() && async_compute && VulkanContext::has_async_compute();
+
+	VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+
+	// Record and submit compute Command Buffer, its passes overlap with the Shadow and GBuffer passes on the graphics Queue
+	if (async) {
+		auto & command_buffer_compute = command_buffers_compute[image_index];
+
+		VK_CHECK(vkBeginCommandBuffer(command_buffer_compute, &command_buffer_begin_info));
 
-	// Wait until previous Frame is done
-	VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+		gpu_profiler_compute.begin(command_buffer_compute, image_index, frame_number);
 
-	u32 image_index; VK_CHECK(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, semaphore_image_available, VK_NULL_HANDLE, &image_index));
+		render_task_gbuffer.cull(image_index, command_buffer_compute, true); gpu_profiler_compute.timestamp(command_buffer_compute, image_index, "Cull (Async)");
+
+		VK_CHECK(vkEndCommandBuffer(command_buffer_compute));
+
+		timeline_compute_value++;
+
+		VkTimelineSemaphoreSubmitInfo timeline_submit_info = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+		timeline_submit_info.signalSemaphoreValueCount = 1;
+		timeline_submit_info.pSignalSemaphoreValues    = &timeline_compute_value;
+
+		VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+		submit_info.pNext = &timeline_submit_info;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers    = &command_buffer_compute;
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores    = &timeline_compute;
+
+		VK_CHECK(vkQueueSubmit(queue_compute, 1, &submit_info, VK_NULL_HANDLE));
+	}
 
 	// Recrod Command buffer
 	auto & command_buffer = command_buffers[image_index];
 	auto & frame_buffer   = frame_buffers  [image_index];
 
-	VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
 	VK_CHECK(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info));
 
-	render_task_gbuffer     .render(image_index, command_buffer);
-	render_task_shadow      .render(image_index, command_buffer);
-	render_task_lighting    .render(image_index, command_buffer);
-	render_task_post_process.render(image_index, command_buffer, frame_buffer);
+	gpu_profiler.begin(command_buffer, image_index, frame_number);
+
+	if (cull && !async) {
+		render_task_gbuffer.cull(image_index, command_buffer, false); gpu_profiler.timestamp(command_buffer, image_index, "Cull");
+	}
+
+	render_task_skinning    .render(image_index, command_buffer, descriptor_allocators_transient[current_frame]); gpu_profiler.timestamp(command_buffer, image_index, "Skinning");
+	render_task_gbuffer     .sky_lut_update(command_buffer);                    gpu_profiler.timestamp(command_buffer, image_index, "Sky LUT");
+	render_task_gbuffer     .render(image_index, command_buffer);               gpu_profiler.timestamp(command_buffer, image_index, "GBuffer");
+
+	// The Visibility Buffer resolve writes the GBuffer, the GBuffer timing above then only covers the ids and depth of static geometry
+	// The Resolve timestamp is always written, so that the profiler has the same columns in both modes. Without a Visibility Buffer it measures (close to) zero
+	if (render_task_gbuffer.is_visibility_buffer()) {
+		render_task_gbuffer.resolve(image_index, command_buffer);
+	}
+	gpu_profiler.timestamp(command_buffer, image_index, "Resolve");
+	render_task_shadow      .render(image_index, command_buffer);               gpu_profiler.timestamp(command_buffer, image_index, "Shadow");
+	render_task_lighting    .render(image_index, command_buffer);               gpu_profiler.timestamp(command_buffer, image_index, "Lighting");
+	render_task_post_process.render(image_index, command_buffer, frame_buffer); gpu_profiler.timestamp(command_buffer, image_index, "Post Process");
 
 	VK_CHECK(vkEndCommandBuffer(command_buffer));
 
-	// Wait until ready to submit
-	if (fences_in_flight[image_index] != nullptr) {
-		VK_CHECK(vkWaitForFences(device, 1, &fences_in_flight[image_index], VK_TRUE, UINT64_MAX));
+	// Submit Command buffer, values for binary Semaphores are ignored
+	VkSemaphore          wait_semaphores[2];
+	u64                  wait_values    [2];
+	VkPipelineStageFlags wait_stages    [2];
+	u32                  wait_semaphore_count = 0;
+
+	VkSemaphore signal_semaphores[2];
+	u64         signal_values    [2];
+	u32         signal_semaphore_count = 0;
+
+	auto timeline_value = VulkanContext::timeline_next_value();
+
+	signal_semaphores[signal_semaphore_count] = VulkanContext::get_timeline_semaphore();
+	signal_values    [signal_semaphore_count] = timeline_value;
+	signal_semaphore_count++;
+
+	// In headless mode there is nothing to acquire or present, so no need to synchronize with the Swapchain
+	if (window) {
+		wait_semaphores[wait_semaphore_count] = semaphore_image_available;
+		wait_values    [wait_semaphore_count] = 0;
+		wait_stages    [wait_semaphore_count] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		wait_semaphore_count++;
+
+		signal_semaphores[signal_semaphore_count] = semaphore_render_done;
+		signal_values    [signal_semaphore_count] = 0;
+		signal_semaphore_count++;
 	}
-	fences_in_flight[image_index] = fence;
 
-	// Submit Command buffer
-	VkSemaphore          wait_semaphores[] = { semaphore_image_available };
-	VkPipelineStageFlags wait_stages    [] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	// Only the consumers of the compute results wait, everything before them can overlap with the compute Queue
+	if (async) {
+		wait_semaphores[wait_semaphore_count] = timeline_compute;
+		wait_values    [wait_semaphore_count] = timeline_compute_value;
+		wait_stages    [wait_semaphore_count] = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		wait_semaphore_count++;
+	}
 
-	VkSemaphore signal_semaphores[] = { semaphore_render_done };
+	VkTimelineSemaphoreSubmitInfo timeline_submit_info = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+	timeline_submit_info.waitSemaphoreValueCount   = wait_semaphore_count;
+	timeline_submit_info.pWaitSemaphoreValues      = wait_values;
+	timeline_submit_info.signalSemaphoreValueCount = signal_semaphore_count;
+	timeline_submit_info.pSignalSemaphoreValues    = signal_values;
 
 	VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-	submit_info.waitSemaphoreCount = Util::array_element_count(wait_semaphores);
-	submit_info.pWaitSemaphores    = wait_semaphores;
-	submit_info.pWaitDstStageMask  = wait_stages;
+	submit_info.pNext = &timeline_submit_info;
 	submit_info.commandBufferCount = 1;
 	submit_info.pCommandBuffers    = &command_buffers[image_index];
-	submit_info.signalSemaphoreCount = Util::array_element_count(signal_semaphores);
+	submit_info.waitSemaphoreCount = wait_semaphore_count;
+	submit_info.pWaitSemaphores    = wait_semaphores;
+	submit_info.pWaitDstStageMask  = wait_stages;
+	submit_info.signalSemaphoreCount = signal_semaphore_count;
 	submit_info.pSignalSemaphores    = signal_semaphores;
 
-	VK_CHECK(vkResetFences(device, 1, &fence));
-	VK_CHECK(vkQueueSubmit(queue_graphics, 1, &submit_info, fence));
+	VK_CHECK(vkQueueSubmit(queue_graphics, 1, &submit_info, VK_NULL_HANDLE));
+
+	frame_timeline_values[current_frame] = timeline_value;
+	image_timeline_values[image_index]   = timeline_value;
+
+	auto time_submit = Clock::now();
+	latency.time_submit[current_frame] = time_submit;
+
+	float input_to_submit = std::chrono::duration<float, std::milli>(time_submit - latency.time_input_sample).count();
+	latency.input_to_submit += LATENCY_SMOOTHING * (input_to_submit - latency.input_to_submit);
+
+	last_image_index = image_index;
+	frame_number++;
+
+	if (window == nullptr) {
+		current_frame = (current_frame + 1) % frame_pacing.frames_in_flight;
+		return;
+	}
 
 	// Present Swapchain
 	VkSwapchainKHR swapchains[] = { swapchain };
@@ -329,7 +809,11 @@ void Renderer::render() {
 	present_info.pImageIndices  = &image_index;
 	present_info.pResults = nullptr;
 
-	auto result = vkQueuePresentKHR(queue_present, &present_info);
+	VkResult result;
+	{
+		PROFILE_SCOPE("Present");
+		result = vkQueuePresentKHR(queue_present, &present_info);
+	}
 
 	// Check if we need to resize the Swapchain
 	if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR || framebuffer_needs_resize) {
@@ -346,12 +830,7 @@ void Renderer::render() {
 		width  = w;
 		height = h;
 
-		VK_CHECK(vkDeviceWaitIdle(device));
-
-		swapchain_destroy();
-		swapchain_create();
-
-		printf("Recreated SwapChain!\n");
+		swapchain_recreate();
 
 		scene.camera.on_resize(width, height);
 
@@ -360,5 +839,74 @@ void Renderer::render() {
 		VK_CHECK(result);
 	}
 
-	current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+	current_frame = (current_frame + 1) % frame_pacing.frames_in_flight;
+}
+
+void Renderer::flush_gpu_timings() {
+	for (int i = 0; i < swapchain_views.size(); i++) {
+		resolve_gpu_timings(i);
+	}
+
+	std::sort(gpu_timings_history.begin(), gpu_timings_history.end(), [](auto const & a, auto const & b) { return a.frame < b.frame; });
+}
+
+void Renderer::save_frame(std::string const & filename) {
+	if (window) {
+		puts("WARNING: Saving Frames is only supported in headless mode!");
+		return;
+	}
+
+	auto device = VulkanContext::get_device();
+
+	VulkanContext::timeline_wait(image_timeline_values[last_image_index]);
+
+	// Copy Image into host visible Buffer, the Post Process Render Pass leaves it in TRANSFER_SRC layout
+	auto readback_buffer = VulkanMemory::Buffer(
+		width * height * 4,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+	);
+
+	auto command_buffer = VulkanMemory::command_buffer_single_use_begin();
+
+	VkBufferImageCopy region = { };
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount     = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { width, height, 1 };
+
+	vkCmdCopyImageToBuffer(command_buffer, offscreen_images[last_image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffer.buffer, 1, &region);
+
+	VulkanMemory::command_buffer_single_use_end(command_buffer);
+
+	FILE * file = fopen(filename.c_str(), "wb");
+	if (file == nullptr) {
+		printf("WARNING: Unable to open '%s' for writing!\n", filename.c_str());
+		return;
+	}
+
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+	auto pixels = reinterpret_cast<u8 const *>(VulkanMemory::buffer_map(readback_buffer, width * height * 4));
+
+	// Convert BGRA to RGB
+	std::vector<u8> row(width * 3);
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			auto pixel = pixels + 4 * (x + y * width);
+
+			row[3*x    ] = pixel[2];
+			row[3*x + 1] = pixel[1];
+			row[3*x + 2] = pixel[0];
+		}
+
+		fwrite(row.data(), 1, row.size(), file);
+	}
+
+	VulkanMemory::buffer_unmap(readback_buffer);
+
+	fclose(file);
 }
@@ -1,37 +1,80 @@
 #pragma once
 #include <vector>
+#include <string>
+#include <chrono>
 
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 
-#include "RenderTaskGbuffer.h"
+#include "RenderTaskSkinning.h"
+#include "RenderTaskGBuffer.h"
 #include "RenderTaskShadow.h"
 #include "RenderTaskLighting.h"
 #include "RenderTaskPostProcess.h"
 
+#include "GPUProfiler.h"
+#include "DescriptorAllocator.h"
+
+// Frame pacing trades throughput for latency
+struct FramePacing {
+	int              frames_in_flight = 2;
+	VkPresentModeKHR present_mode     = VK_PRESENT_MODE_MAILBOX_KHR;
+
+	// If enabled, the CPU waits until the GPU is done with the oldest Frame in flight before sampling input,
+	// instead of sampling input first and then blocking right before recording. This reduces latency at the cost of throughput
+	bool wait_to_start = false;
+};
+
 class Renderer {
-	GLFWwindow * window;
+	GLFWwindow * window; // nullptr in headless mode
 
-	VkSwapchainKHR           swapchain;
+	VkSwapchainKHR           swapchain = VK_NULL_HANDLE;
 	std::vector<VkImageView> swapchain_views;
 
+	// In headless mode there is no Swapchain, instead the Renderer cycles through these offscreen Images
+	static constexpr int HEADLESS_IMAGE_COUNT = 3;
+
+	std::vector<VkImage>        offscreen_images;
+	std::vector<VkDeviceMemory> offscreen_images_memory;
+
 	std::vector<VkCommandBuffer> command_buffers;
+	std::vector<VkCommandBuffer> command_buffers_compute; // Allocated from the compute Queue Family, only used with async compute
 	std::vector<VkFramebuffer>   frame_buffers;
 
 	VkImage        depth_image;
 	VkDeviceMemory depth_image_memory;
 	VkImageView    depth_image_view;
 
-	VkDescriptorPool descriptor_pool;
+	DescriptorAllocator descriptor_allocator; // Long-lived Descriptor Sets, reset whenever the Render Tasks are recreated
+
+	static constexpr int PROFILE_HOTKEY_FRAME_COUNT = 10; // Number of Frames captured when pressing F9
+
+	FramePacing frame_pacing;
+	FramePacing frame_pacing_pending; // Changes made through the GUI are applied at the start of the next Frame
+	bool        frame_pacing_needs_update = false;
 
-	static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+	GBufferLayout gbuffer_layout;
+	GBufferLayout gbuffer_layout_pending; // Changes made through the GUI are applied at the start of the next Frame
 
-	VkSemaphore semaphores_image_available[MAX_FRAMES_IN_FLIGHT];
-	VkSemaphore semaphores_render_done    [MAX_FRAMES_IN_FLIGHT];
+	bool visibility_buffer;
+	bool visibility_buffer_pending;
 
-	VkFence              fences[MAX_FRAMES_IN_FLIGHT];
-	std::vector<VkFence> fences_in_flight;
+	// Indexed by current_frame, one per Frame in flight
+	// The Swapchain only supports binary Semaphores, all other synchronization uses timeline Semaphores
+	std::vector<VkSemaphore> semaphores_image_available;
+	std::vector<VkSemaphore> semaphores_render_done;
+	std::vector<u64>         frame_timeline_values; // Value of the Context's timeline Semaphore signaled by the Frame's submission
 
+	std::vector<DescriptorAllocator> descriptor_allocators_transient; // For Descriptor Sets that only live for a single Frame, reset once the Frame is done
+
+	std::vector<u64> image_timeline_values; // Indexed by Swapchain Image, value signaled by the last submission that used the Image
+
+	// Signaled by every compute Queue submission with timeline_compute_value, which is incremented per submission rather than per Frame
+	// The graphics Queue of the same Frame waits for the value of that Frame's submission
+	VkSemaphore timeline_compute;
+	u64         timeline_compute_value = 0;
+
+	RenderTaskSkinning    render_task_skinning;
 	RenderTaskGBuffer     render_task_gbuffer;
 	RenderTaskShadow      render_task_shadow;
 	RenderTaskLighting    render_task_lighting;
@@ -39,6 +82,13 @@ class Renderer {
 
 	int current_frame = 0;
 
+	int frame_number     = 0;
+	u32 last_image_index = 0;
+
+	GPUProfiler              gpu_profiler;
+	GPUProfiler              gpu_profiler_compute; // Timestamps are only comparable within a Queue, so the compute Queue is profiled separately
+	GPUProfiler::FrameResult gpu_timings = { };
+
 	struct {
 		float frame_delta;
 		float frame_avg;
@@ -53,8 +103,41 @@ class Renderer {
 		std::vector<float> frame_times;
 	} timing;
 
+	using Clock = std::chrono::high_resolution_clock;
+
+	static constexpr float LATENCY_SMOOTHING = 0.05f;
+
+	// Latency is measured on the CPU, the end of a Frame is the moment its timeline value is observed to be reached.
+	// Vulkan 1.0 offers no way to query when an Image actually reaches the display, so this approximates submit-to-present
+	struct {
+		Clock::time_point              time_input_sample;
+		std::vector<Clock::time_point> time_submit; // Indexed by current_frame, default constructed if there is no pending submission
+
+		// Exponential moving averages in ms
+		float input_to_submit = 0.0f;
+		float submit_to_done  = 0.0f;
+	} latency;
+
 	void swapchain_create();
 	void swapchain_destroy();
+	void swapchain_recreate(); // Cheap path used when resizing, keeps Pipelines and per Image resources intact
+
+	void swapchain_images_create();
+	void swapchain_images_destroy();
+
+	void render_tasks_create();
+	void render_tasks_destroy();
+	void render_tasks_recreate(); // Waits until the Device is idle
+
+	void frame_buffers_create();
+	void frame_buffers_destroy();
+
+	void sync_create();
+	void sync_destroy();
+
+	void wait_for_frame(int frame);
+
+	void resolve_gpu_timings(int image_index);
 
 public:
 	u32 width;
@@ -64,9 +147,33 @@ public:
 
 	Scene scene;
 
-	Renderer(GLFWwindow * window, u32 width, u32 height);
+	// If enabled (and supported) compute passes are submitted to the compute Queue, where they overlap with rasterization
+	// Toggling this allows measuring the gain, async passes show up in the GPU timings with an "(Async)" suffix
+	bool async_compute = true;
+
+	// If enabled, the GPU timings of every Frame are stored
+	bool                                  record_gpu_timings = false;
+	std::vector<GPUProfiler::FrameResult> gpu_timings_history;
+
+	static constexpr int MAX_FRAMES_IN_FLIGHT = 4;
+
+	Renderer(GLFWwindow * window, u32 width, u32 height, std::string const & scene_name = "default", FramePacing const & frame_pacing = { }, GBufferLayout gbuffer_layout = GBufferLayout::STANDARD, bool visibility_buffer = false);
 	~Renderer();
 
+	void set_frame_pacing(FramePacing const & frame_pacing); // Recreates synchronization objects and the Swapchain only if needed
+	FramePacing const & get_frame_pacing() const { return frame_pacing; }
+
+	void set_gbuffer_layout(GBufferLayout gbuffer_layout); // Recreates all Render Tasks if the layout changed
+	GBufferLayout get_gbuffer_layout() const { return gbuffer_layout; }
+
+	void set_visibility_buffer(bool visibility_buffer); // Recreates all Render Tasks if the mode changed
+	bool is_visibility_buffer() const { return render_task_gbuffer.is_visibility_buffer(); } // False if requested but not supported
+
+	void begin_frame(); // Must be called before sampling input for the next Frame
 	void update(float delta);
 	void render();
+
+	void flush_gpu_timings(); // Device must be idle
+
+	void save_frame(std::string const & filename); // Writes the last rendered Frame as PPM, only available in headless mode
 };
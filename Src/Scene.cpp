@@ -1,8 +1,66 @@
 #include "Scene.h"
 
-Scene::Scene(int width, int height) : camera(DEG_TO_RAD(70.0f), width, height), asset_manager(*this) {
-	Material * material_diffuse = materials.emplace_back(std::make_unique<Material>(0.9f, 0.0f)).get();
+#include <random>
+
+#include "Profiler.h"
+
+Scene::Scene(int width, int height, std::string const & name) : name(name), camera(DEG_TO_RAD(70.0f), width, height), asset_manager(*this) {
+	Material * material_diffuse = add_material(0.9f, 0.0f);
+
+	if (name == "default") {
+		init_default(material_diffuse);
+	} else if (name == "sponza") {
+		meshes.emplace_back("Sponza", asset_manager.load_mesh("Data/Sponza/sponza.obj"), material_diffuse).transform.position = Vector3(0.0f, -7.5f, 0.0f);
+	} else if (name == "cubes") {
+		init_cubes(material_diffuse);
+	} else {
+		printf("ERROR: Unknown Scene '%s'!\n", name.c_str());
+		abort();
+	}
+
+	build_mesh_batches();
+
+	for (auto & mesh : meshes) {
+		mesh.transform.update();
+	}
+	bvh.build(*this);
+
+	directional_lights.push_back({ Vector3(1.0f),
+		Quaternion::axis_angle(Vector3(0.0f, 0.0f, 1.0f), std::tan(1.0f / 10.0f)) *
+		Quaternion::axis_angle(Vector3(1.0f, 0.0f, 0.0f), DEG_TO_RAD(-90.0f))
+	});
+
+	point_lights.push_back({ Vector3(10.0f, 0.0f,  0.0f), Vector3(-6.0f, 0.0f, 0.0f), 16.0f });
+	point_lights.push_back({ Vector3( 0.0f, 0.0f, 10.0f), Vector3(+6.0f, 0.0f, 0.0f), 16.0f });
+
+	constexpr float point_lights_width  = 150.0f;
+	constexpr float point_lights_height =  60.0f;
+
+	// Use a fixed seed and avoid std::uniform_real_distribution, its output is implementation defined
+	std::mt19937 rng(RANDOM_SEED);
 
+	auto rand_float = [&rng](float min = 0.0f, float max = 1.0f) { return min + (max - min) * float(rng()) / float(std::mt19937::max()); };
+
+	for (int i = 0; i < 500; i++) {
+		point_lights.push_back({
+			5.0f + 10.0f * Vector3(rand_float(), rand_float(), rand_float()),
+			Vector3(rand_float(-point_lights_width, point_lights_width), -7.0f, rand_float(-point_lights_height, point_lights_height)),
+			rand_float(0.5f, 10.0f)
+		});
+	}
+
+	spot_lights.push_back({ Vector3(10.0f,  0.0f, 10.0f), Vector3(-4.0f, -7.45f, 10.0f), 20.0f, Vector3(0.0f, 0.0f, 1.0f), DEG_TO_RAD(75.0f), DEG_TO_RAD(90.0f) });
+	spot_lights.push_back({ Vector3( 0.0f, 10.0f,  0.0f), Vector3(+4.0f, -7.45f, 10.0f), 20.0f, Vector3(0.0f, 0.0f, 1.0f), DEG_TO_RAD(40.0f), DEG_TO_RAD(45.0f) });
+}
+
+Material * Scene::add_material(float roughness, float metallic) {
+	auto material = materials.emplace_back(std::make_unique<Material>(roughness, metallic)).get();
+	material->id = materials.size() - 1;
+
+	return material;
+}
+
+void Scene::init_default(Material * material_diffuse) {
 	animated_meshes.emplace_back(*this, "Cowboy",   asset_manager.load_animated_mesh("Data/Cowboy2.fbx"), material_diffuse);
 	animated_meshes.emplace_back(*this, "XNA Dude", asset_manager.load_animated_mesh("Data/xnadude.fbx"), material_diffuse);
 	animated_meshes.emplace_back(*this, "Arm",      asset_manager.load_animated_mesh("Data/test.fbx"),    material_diffuse);
@@ -23,46 +81,77 @@ Scene::Scene(int width, int height) : camera(DEG_TO_RAD(70.0f), width, height),
 	meshes.emplace_back("Cube 1", asset_manager.load_mesh("Data/Cube.obj"),          material_diffuse).transform.position = Vector3( 10.0f,   0.0f, 0.0f);
 	meshes.emplace_back("Cube 2", asset_manager.load_mesh("Data/Cube.obj"),          material_diffuse).transform.position = Vector3(-10.0f,   0.0f, 0.0f);
 	meshes.emplace_back("Sponza", asset_manager.load_mesh("Data/Sponza/sponza.obj"), material_diffuse).transform.position = Vector3(  0.0f,  -7.5f, 0.0f);
+}
 
-	directional_lights.push_back({ Vector3(1.0f),
-		Quaternion::axis_angle(Vector3(0.0f, 0.0f, 1.0f), std::tan(1.0f / 10.0f)) *
-		Quaternion::axis_angle(Vector3(1.0f, 0.0f, 0.0f), DEG_TO_RAD(-90.0f))
-	});
+// Stress test for instancing, many instances of the same Mesh
+void Scene::init_cubes(Material * material_diffuse) {
+	constexpr int   CUBES_PER_SIDE = 100;
+	constexpr float CUBE_SPACING   = 4.0f;
 
-	point_lights.push_back({ Vector3(10.0f, 0.0f,  0.0f), Vector3(-6.0f, 0.0f, 0.0f), 16.0f });
-	point_lights.push_back({ Vector3( 0.0f, 0.0f, 10.0f), Vector3(+6.0f, 0.0f, 0.0f), 16.0f });
+	auto mesh_handle = asset_manager.load_mesh("Data/Cube.obj");
 
-	constexpr float point_lights_width  = 150.0f;
-	constexpr float point_lights_height =  60.0f;
+	meshes.reserve(CUBES_PER_SIDE * CUBES_PER_SIDE);
 
-	auto rand_float = [](float min = 0.0f, float max = 1.0f) { return min + (max - min) * rand() / float(RAND_MAX); };
+	for (int z = 0; z < CUBES_PER_SIDE; z++) {
+		for (int x = 0; x < CUBES_PER_SIDE; x++) {
+			char name[32]; snprintf(name, sizeof(name), "Cube %i", z * CUBES_PER_SIDE + x);
 
-	for (int i = 0; i < 500; i++) {
-		point_lights.push_back({
-			5.0f + 10.0f * Vector3(rand_float(), rand_float(), rand_float()),
-			Vector3(rand_float(-point_lights_width, point_lights_width), -7.0f, rand_float(-point_lights_height, point_lights_height)),
-			rand_float(0.5f, 10.0f)
-		});
+			meshes.emplace_back(name, mesh_handle, material_diffuse).transform.position = Vector3(
+				CUBE_SPACING * (float(x) - 0.5f * float(CUBES_PER_SIDE)),
+				-7.5f,
+				CUBE_SPACING * (float(z) - 0.5f * float(CUBES_PER_SIDE))
+			);
+		}
 	}
+}
 
-	spot_lights.push_back({ Vector3(10.0f,  0.0f, 10.0f), Vector3(-4.0f, -7.45f, 10.0f), 20.0f, Vector3(0.0f, 0.0f, 1.0f), DEG_TO_RAD(75.0f), DEG_TO_RAD(90.0f) });
-	spot_lights.push_back({ Vector3( 0.0f, 10.0f,  0.0f), Vector3(+4.0f, -7.45f, 10.0f), 20.0f, Vector3(0.0f, 0.0f, 1.0f), DEG_TO_RAD(40.0f), DEG_TO_RAD(45.0f) });
+void Scene::build_mesh_batches() {
+	std::vector<int> batch_of_mesh(asset_manager.meshes.size(), -1); // Indexed by MeshHandle
+
+	mesh_batches.clear();
+
+	for (auto const & mesh_instance : meshes) {
+		auto & batch_index = batch_of_mesh[mesh_instance.mesh_handle];
+		if (batch_index == -1) {
+			batch_index = mesh_batches.size();
+			mesh_batches.push_back({ mesh_instance.mesh_handle, 0, 0 });
+		}
+
+		mesh_batches[batch_index].instance_count++;
+	}
+
+	auto instance_offset = 0;
+	for (auto & batch : mesh_batches) {
+		batch.instance_offset = instance_offset;
+		instance_offset += batch.instance_count;
+
+		batch.instance_count = 0; // Counted again below while filling in the instances
+	}
+
+	mesh_batch_instances.resize(meshes.size());
+
+	for (int i = 0; i < meshes.size(); i++) {
+		auto & batch = mesh_batches[batch_of_mesh[meshes[i].mesh_handle]];
+		mesh_batch_instances[batch.instance_offset + batch.instance_count++] = i;
+	}
 }
 
 void Scene::update(float delta) {
+	PROFILE_SCOPE("Scene::update");
+
 	camera.update(delta);
 
-	static float time = 0.0f;
 	time += delta;
 
-	if (animated_meshes.size() > 0) {
+	// Animate the objects of the default Scene
+	if (name == "default") {
 		animated_meshes[0].transform.position.x += delta;
 		animated_meshes[0].transform.rotation = Quaternion::axis_angle(Vector3(0.0f, 1.0f, 0.0f), delta) * animated_meshes[0].transform.rotation;
-	}
 
-	if (meshes.size() > 0) meshes[0].transform.scale = 5.0f + std::sin(time);
-	if (meshes.size() > 1) meshes[1].transform.rotation = Quaternion::axis_angle(Vector3(0.0f, 1.0f, 0.0f), delta) * meshes[1].transform.rotation;
-	if (meshes.size() > 2) meshes[2].transform.rotation = Quaternion::axis_angle(Vector3(0.0f, 1.0f, 0.0f), delta) * meshes[2].transform.rotation;
+		meshes[0].transform.scale = 5.0f + std::sin(time);
+		meshes[1].transform.rotation = Quaternion::axis_angle(Vector3(0.0f, 1.0f, 0.0f), delta) * meshes[1].transform.rotation;
+		meshes[2].transform.rotation = Quaternion::axis_angle(Vector3(0.0f, 1.0f, 0.0f), delta) * meshes[2].transform.rotation;
+	}
 
 	if (directional_lights.size() > 0) directional_lights[0].orientation = Quaternion::axis_angle(Vector3(0.0f, 1.0f, 0.0f), 0.2f * delta) * directional_lights[0].orientation;
 
@@ -74,7 +163,17 @@ void Scene::update(float delta) {
 		animated_mesh.transform.update();
 	}
 
-	for (auto & mesh : meshes) {
-		mesh.transform.update();
+	// Only instances that actually moved need to be refit in the BVH
+	for (int slot = 0; slot < mesh_batch_instances.size(); slot++) {
+		auto & transform = meshes[mesh_batch_instances[slot]].transform;
+
+		auto matrix_prev = transform.matrix;
+		transform.update();
+
+		if (memcmp(&matrix_prev, &transform.matrix, sizeof(Matrix4)) != 0) {
+			bvh.update_slot(*this, slot);
+		}
 	}
+
+	bvh.refit();
 }
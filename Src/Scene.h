@@ -1,27 +1,51 @@
 #pragma once
 #include <vector>
+#include <string>
 
 #include "Camera.h"
 #include "Mesh.h"
 #include "Lights.h"
+#include "SceneBVH.h"
 
 #include "AssetManager.h"
 
 struct Scene {
+private:
+	void init_default(Material * material_diffuse);
+	void init_cubes  (Material * material_diffuse);
+
+	void build_mesh_batches();
+
+	float time = 0.0f;
+
+public:
+	static constexpr u32 RANDOM_SEED = 1337; // Seed used to place the Point Lights, fixed so that runs are reproducible
+
+	std::string name;
+
 	AssetManager asset_manager;
 
 	Camera camera;
 
 	std::vector<std::unique_ptr<Material>> materials;
+	u32 materials_version = 0; // Incremented whenever a Material is edited, the Materials Buffer is only uploaded again after that
+
+	Material * add_material(float roughness, float metallic);
 
 	std::vector<MeshInstance>         meshes;
 	std::vector<AnimatedMeshInstance> animated_meshes;
 
+	// Static Mesh instances grouped by Mesh, the per instance data on the GPU is stored in this order
+	std::vector<MeshBatch> mesh_batches;
+	std::vector<int>       mesh_batch_instances; // Indices into meshes, the instances of each batch are contiguous
+
+	SceneBVH bvh; // Over all static Submesh instances, refit in update
+
 	std::vector<DirectionalLight> directional_lights;
 	std::vector<PointLight>       point_lights;
 	std::vector<SpotLight>        spot_lights;
 
-	Scene(int width, int height);
+	Scene(int width, int height, std::string const & name = "default");
 
 	void update(float delta);
 };
@@ -0,0 +1,193 @@
+#include "SceneBVH.h"
+
+#include <algorithm>
+
+#include "Scene.h"
+
+#include "Profiler.h"
+
+void SceneBVH::build(Scene const & scene) {
+	PROFILE_SCOPE("SceneBVH::build");
+
+	primitives  .clear();
+	slot_offsets.clear();
+
+	// Primitives are created in slot order, the Primitives of an instance are its Submeshes
+	for (int b = 0; b < scene.mesh_batches.size(); b++) {
+		auto const & batch = scene.mesh_batches[b];
+		auto const & mesh  = scene.asset_manager.meshes[batch.mesh_handle];
+
+		for (int slot = batch.instance_offset; slot < batch.instance_offset + batch.instance_count; slot++) {
+			auto const & transform = scene.meshes[scene.mesh_batch_instances[slot]].transform.matrix;
+
+			slot_offsets.push_back(primitives.size());
+
+			for (int j = 0; j < mesh.sub_meshes.size(); j++) {
+				primitives.push_back({ mesh.sub_meshes[j].aabb.transform(transform), b, j, slot });
+			}
+		}
+	}
+
+	slot_offsets.push_back(primitives.size());
+
+	nodes.clear();
+	leaves_dirty.clear();
+
+	if (primitives.size() == 0) return;
+
+	indices.resize(primitives.size());
+	for (int i = 0; i < primitives.size(); i++) indices[i] = i;
+
+	primitive_leaf.resize(primitives.size());
+
+	// A binary tree with at least one Primitive per leaf has less than 2N Nodes, reserving avoids reallocation during the recursion
+	nodes.reserve(2 * primitives.size());
+	nodes.push_back({ });
+	nodes[0].parent = -1;
+
+	build_node(0, 0, primitives.size());
+}
+
+void SceneBVH::build_node(int node_index, int first, int count) {
+	auto & node = nodes[node_index];
+	node.aabb  = calc_bounds(first, count);
+	node.left  = -1;
+	node.first = first;
+	node.count = count;
+
+	if (count <= MAX_PRIMITIVES_PER_LEAF) {
+		for (int i = first; i < first + count; i++) primitive_leaf[indices[i]] = node_index;
+		return;
+	}
+
+	// Split at the median centroid along the axis in which the centroids are spread out the most
+	auto centroid_bounds = AABB::create_empty();
+	for (int i = first; i < first + count; i++) {
+		auto centroid = primitives[indices[i]].aabb.get_center();
+
+		centroid_bounds.min = Vector3::min(centroid_bounds.min, centroid);
+		centroid_bounds.max = Vector3::max(centroid_bounds.max, centroid);
+	}
+
+	auto extent = centroid_bounds.max - centroid_bounds.min;
+
+	auto axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	// All centroids coincide, no split can separate the Primitives
+	if (extent[axis] == 0.0f) {
+		for (int i = first; i < first + count; i++) primitive_leaf[indices[i]] = node_index;
+		return;
+	}
+
+	auto mid = first + count / 2;
+
+	std::nth_element(indices.begin() + first, indices.begin() + mid, indices.begin() + first + count, [this, axis](int a, int b) {
+		return primitives[a].aabb.get_center()[axis] < primitives[b].aabb.get_center()[axis];
+	});
+
+	auto left = int(nodes.size());
+	node.left = left;
+
+	nodes.push_back({ });
+	nodes.push_back({ });
+	nodes[left    ].parent = node_index;
+	nodes[left + 1].parent = node_index;
+
+	build_node(left,     first, mid - first);
+	build_node(left + 1, mid,   first + count - mid);
+}
+
+AABB SceneBVH::calc_bounds(int first, int count) const {
+	auto aabb = AABB::create_empty();
+
+	for (int i = first; i < first + count; i++) {
+		aabb = AABB::merge(aabb, primitives[indices[i]].aabb);
+	}
+
+	return aabb;
+}
+
+void SceneBVH::update_slot(Scene const & scene, int slot) {
+	auto const & transform = scene.meshes[scene.mesh_batch_instances[slot]].transform.matrix;
+
+	for (int p = slot_offsets[slot]; p < slot_offsets[slot + 1]; p++) {
+		auto & primitive = primitives[p];
+
+		auto const & batch = scene.mesh_batches[primitive.batch_index];
+		auto const & mesh  = scene.asset_manager.meshes[batch.mesh_handle];
+
+		primitive.aabb = mesh.sub_meshes[primitive.sub_mesh_index].aabb.transform(transform);
+
+		leaves_dirty.push_back(primitive_leaf[p]);
+	}
+}
+
+void SceneBVH::refit() {
+	PROFILE_SCOPE("SceneBVH::refit");
+
+	// Walk up from every dirty leaf, as soon as the bounds of a Node stay the same its ancestors do too
+	for (auto leaf : leaves_dirty) {
+		nodes[leaf].aabb = calc_bounds(nodes[leaf].first, nodes[leaf].count);
+
+		for (int n = nodes[leaf].parent; n != -1; n = nodes[n].parent) {
+			auto & node = nodes[n];
+
+			auto aabb = AABB::merge(nodes[node.left].aabb, nodes[node.left + 1].aabb);
+			if (aabb.min == node.aabb.min && aabb.max == node.aabb.max) break;
+
+			node.aabb = aabb;
+		}
+	}
+
+	leaves_dirty.clear();
+}
+
+void SceneBVH::intersect_frustum(Frustum const & frustum, std::vector<int> & result) const {
+	if (nodes.size() == 0) return;
+
+	// Median splits keep the tree balanced, so its depth is logarithmic in the Primitive count
+	int stack[64];
+	int stack_size = 0;
+
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0) {
+		auto const & node = nodes[stack[--stack_size]];
+
+		auto intersection = frustum.intersect_aabb(node.aabb.min, node.aabb.max);
+		if (intersection == Frustum::IntersectionType::FULLY_OUTSIDE) continue;
+
+		// Everything below a Node that is fully inside is visible without further tests
+		if (intersection == Frustum::IntersectionType::FULLY_INSIDE) {
+			result.insert(result.end(), indices.begin() + node.first, indices.begin() + node.first + node.count);
+			continue;
+		}
+
+		if (node.left == -1) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				auto const & aabb = primitives[indices[i]].aabb;
+
+				if (node.count == 1 || frustum.intersect_aabb(aabb.min, aabb.max) != Frustum::IntersectionType::FULLY_OUTSIDE) {
+					result.push_back(indices[i]);
+				}
+			}
+		} else {
+			stack[stack_size++] = node.left + 1;
+			stack[stack_size++] = node.left;
+		}
+	}
+}
+
+void SceneBVH::sort_by_sub_mesh(std::vector<int> & primitive_indices) const {
+	std::sort(primitive_indices.begin(), primitive_indices.end(), [this](int a, int b) {
+		auto const & primitive_a = primitives[a];
+		auto const & primitive_b = primitives[b];
+
+		if (primitive_a.batch_index    != primitive_b.batch_index)    return primitive_a.batch_index    < primitive_b.batch_index;
+		if (primitive_a.sub_mesh_index != primitive_b.sub_mesh_index) return primitive_a.sub_mesh_index < primitive_b.sub_mesh_index;
+
+		return primitive_a.slot < primitive_b.slot;
+	});
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+
+#include "AABB.h"
+#include "Frustum.h"
+
+struct Scene;
+
+// Bounding Volume Hierarchy over the world space AABBs of all static Submesh instances, used for culling on the CPU
+// Built once when the Scene is created, after that only the Nodes above instances whose Transform changed are refit
+struct SceneBVH {
+	// A single Submesh of a static Mesh instance, the Primitives of an instance are contiguous
+	struct Primitive {
+		AABB aabb; // World space
+
+		int batch_index;
+		int sub_mesh_index;
+		int slot; // Index into Scene::mesh_batch_instances
+	};
+	std::vector<Primitive> primitives;
+
+	void build(Scene const & scene);
+
+	// Updates the Primitives of an instance after its Transform changed, the Nodes above them are fixed by refit
+	void update_slot(Scene const & scene, int slot);
+	void refit();
+
+	// Appends all Primitives that are not fully outside the Frustum, in no particular order
+	void intersect_frustum(Frustum const & frustum, std::vector<int> & result) const;
+
+	// Orders Primitives by MeshBatch and Submesh, so that each Submesh of a MeshBatch can be drawn with instancing.
+	// Within a Submesh the Primitives are in slot order, which is the order of the Instances on the GPU
+	void sort_by_sub_mesh(std::vector<int> & primitive_indices) const;
+
+private:
+	static constexpr int MAX_PRIMITIVES_PER_LEAF = 4;
+
+	struct Node {
+		AABB aabb;
+
+		int left;   // The right child directly follows the left child, -1 for leaves
+		int parent; // -1 for the root
+
+		int first; // Range of indices covered by the Node, also for internal Nodes
+		int count;
+	};
+	std::vector<Node> nodes;
+
+	std::vector<int> indices;        // Primitive indices, every Node covers a contiguous range
+	std::vector<int> primitive_leaf; // Leaf Node of each Primitive
+	std::vector<int> slot_offsets;   // First Primitive of each instance
+
+	std::vector<int> leaves_dirty;
+
+	void build_node(int node_index, int first, int count);
+
+	AABB calc_bounds(int first, int count) const;
+};
@@ -0,0 +1,238 @@
+#include "SkyLUT.h"
+
+#include <cmath>
+
+#include "VulkanCheck.h"
+#include "VulkanContext.h"
+#include "VulkanMemory.h"
+
+#include "Util.h"
+
+struct SkyViewPushConstants {
+	alignas(16) Vector3 sun_direction;
+};
+
+static constexpr VkFormat SKY_LUT_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+static constexpr int TRANSMITTANCE_GROUP_SIZE = 64; // Matches local_size in sky_transmittance.comp
+static constexpr int SKY_VIEW_GROUP_SIZE      = 8;  // Matches local_size in sky_view.comp
+
+void SkyLUT::init(DescriptorAllocator & descriptor_allocator) {
+	auto device = VulkanContext::get_device();
+
+	// Create Descriptor Set Layouts
+	{
+		VkDescriptorSetLayoutBinding layout_bindings[1] = { };
+		layout_bindings[0].binding = 0;
+		layout_bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		layout_bindings[0].descriptorCount = 1;
+		layout_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layout_create_info.bindingCount = Util::array_element_count(layout_bindings);
+		layout_create_info.pBindings    = layout_bindings;
+
+		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layout_transmittance));
+	}
+
+	{
+		VkDescriptorSetLayoutBinding layout_bindings[2] = { };
+		layout_bindings[0].binding = 0;
+		layout_bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		layout_bindings[0].descriptorCount = 1;
+		layout_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		layout_bindings[1].binding = 1;
+		layout_bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		layout_bindings[1].descriptorCount = 1;
+		layout_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+		layout_create_info.bindingCount = Util::array_element_count(layout_bindings);
+		layout_create_info.pBindings    = layout_bindings;
+
+		VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layout_sky_view));
+	}
+
+	// Create Pipelines
+	VulkanContext::PipelineLayoutDetails pipeline_layout_details;
+	pipeline_layout_details.descriptor_set_layouts = { descriptor_set_layout_transmittance };
+
+	pipeline_layout_transmittance = VulkanContext::create_pipeline_layout(pipeline_layout_details);
+
+	pipeline_layout_details.descriptor_set_layouts = { descriptor_set_layout_sky_view };
+	pipeline_layout_details.push_constants = { { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkyViewPushConstants) } };
+
+	pipeline_layout_sky_view = VulkanContext::create_pipeline_layout(pipeline_layout_details);
+
+	VulkanContext::PipelineDetails pipeline_details;
+	pipeline_details.shaders = { { "Shaders/sky_transmittance.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT } };
+	pipeline_details.pipeline_layout = pipeline_layout_transmittance;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipeline_transmittance);
+
+	pipeline_details.shaders = { { "Shaders/sky_view.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT } };
+	pipeline_details.pipeline_layout = pipeline_layout_sky_view;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipeline_sky_view);
+
+	// Create Sampler, the Shaders map the ends of both axes to texel centers so clamping never blends in the border
+	VkSamplerCreateInfo sampler_create_info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	sampler_create_info.magFilter = VK_FILTER_LINEAR;
+	sampler_create_info.minFilter = VK_FILTER_LINEAR;
+	sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.mipLodBias = 0.0f;
+	sampler_create_info.maxAnisotropy = 1.0f;
+	sampler_create_info.minLod = 0.0f;
+	sampler_create_info.maxLod = 0.0f;
+	sampler_create_info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+
+	VK_CHECK(vkCreateSampler(device, &sampler_create_info, nullptr, &sampler));
+
+	// Create Images
+	transmittance = image_create(TRANSMITTANCE_SIZE, 1);
+	sky_view      = image_create(SKY_VIEW_WIDTH, SKY_VIEW_HEIGHT);
+
+	// Allocate and update Descriptor Sets
+	descriptor_set_transmittance = descriptor_allocator.allocate(descriptor_set_layout_transmittance);
+	descriptor_set_sky_view      = descriptor_allocator.allocate(descriptor_set_layout_sky_view);
+
+	VkDescriptorImageInfo descriptor_transmittance_output = { VK_NULL_HANDLE, transmittance.image_view, VK_IMAGE_LAYOUT_GENERAL };
+	VkDescriptorImageInfo descriptor_transmittance_input  = { sampler,        transmittance.image_view, VK_IMAGE_LAYOUT_GENERAL };
+	VkDescriptorImageInfo descriptor_sky_view_output      = { VK_NULL_HANDLE, sky_view.image_view,      VK_IMAGE_LAYOUT_GENERAL };
+
+	VkWriteDescriptorSet write_descriptor_sets[3] = { };
+	write_descriptor_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_sets[0].dstSet = descriptor_set_transmittance;
+	write_descriptor_sets[0].dstBinding = 0;
+	write_descriptor_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	write_descriptor_sets[0].descriptorCount = 1;
+	write_descriptor_sets[0].pImageInfo      = &descriptor_transmittance_output;
+
+	write_descriptor_sets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_sets[1].dstSet = descriptor_set_sky_view;
+	write_descriptor_sets[1].dstBinding = 0;
+	write_descriptor_sets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write_descriptor_sets[1].descriptorCount = 1;
+	write_descriptor_sets[1].pImageInfo      = &descriptor_transmittance_input;
+
+	write_descriptor_sets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_sets[2].dstSet = descriptor_set_sky_view;
+	write_descriptor_sets[2].dstBinding = 1;
+	write_descriptor_sets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	write_descriptor_sets[2].descriptorCount = 1;
+	write_descriptor_sets[2].pImageInfo      = &descriptor_sky_view_output;
+
+	vkUpdateDescriptorSets(device, Util::array_element_count(write_descriptor_sets), write_descriptor_sets, 0, nullptr);
+
+	valid = false;
+}
+
+void SkyLUT::free() {
+	auto device = VulkanContext::get_device();
+
+	image_destroy(transmittance);
+	image_destroy(sky_view);
+
+	vkDestroySampler(device, sampler, nullptr);
+
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layout_transmittance, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layout_sky_view,      nullptr);
+
+	vkDestroyPipelineLayout(device, pipeline_layout_transmittance, nullptr);
+	vkDestroyPipelineLayout(device, pipeline_layout_sky_view,      nullptr);
+
+	VulkanContext::destroy_pipeline(pipeline_transmittance);
+	VulkanContext::destroy_pipeline(pipeline_sky_view);
+}
+
+SkyLUT::Image SkyLUT::image_create(int width, int height) {
+	Image image;
+
+	VulkanMemory::create_image(width, height, 1, SKY_LUT_FORMAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		image.image, image.memory
+	);
+
+	// The LUTs stay in the general layout, they are both written as storage Image and sampled
+	VulkanMemory::transition_image_layout(image.image, 1, SKY_LUT_FORMAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+	image.image_view = VulkanMemory::create_image_view(image.image, 1, SKY_LUT_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	return image;
+}
+
+void SkyLUT::image_destroy(Image & image) {
+	auto device = VulkanContext::get_device();
+
+	vkDestroyImageView(device, image.image_view, nullptr);
+
+	vkDestroyImage(device, image.image,  nullptr);
+	vkFreeMemory  (device, image.memory, nullptr);
+}
+
+bool SkyLUT::update(VkCommandBuffer command_buffer, Vector3 const & sun_direction) {
+	// A Sun that only rotates around the vertical axis, like the one in the default Scene, never invalidates the LUTs
+	if (valid && std::abs(sun_direction.y - sun_elevation) <= SUN_ELEVATION_THRESHOLD) return false;
+
+	VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER };
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount   = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount     = 1;
+
+	if (!valid) {
+		vkCmdBindPipeline      (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_transmittance);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_transmittance, 0, 1, &descriptor_set_transmittance, 0, nullptr);
+
+		vkCmdDispatch(command_buffer, (TRANSMITTANCE_SIZE + TRANSMITTANCE_GROUP_SIZE - 1) / TRANSMITTANCE_GROUP_SIZE, 1, 1);
+
+		// The sky-view LUT reads the transmittance
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.image = transmittance.image;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	// Previous Frames may still be sampling the sky-view LUT
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.image = sky_view.image;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	SkyViewPushConstants push_constants = { };
+	push_constants.sun_direction = sun_direction;
+
+	vkCmdBindPipeline      (command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_sky_view);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_sky_view, 0, 1, &descriptor_set_sky_view, 0, nullptr);
+	vkCmdPushConstants     (command_buffer, pipeline_layout_sky_view, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkyViewPushConstants), &push_constants);
+
+	vkCmdDispatch(command_buffer,
+		(SKY_VIEW_WIDTH  + SKY_VIEW_GROUP_SIZE - 1) / SKY_VIEW_GROUP_SIZE,
+		(SKY_VIEW_HEIGHT + SKY_VIEW_GROUP_SIZE - 1) / SKY_VIEW_GROUP_SIZE,
+		1
+	);
+
+	// The Sky pass samples the sky-view LUT
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	valid = true;
+	sun_elevation = sun_direction.y;
+
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include "Vector3.h"
+#include "DescriptorAllocator.h"
+
+// Lookup tables of the Sky's scattering model, so that the Sky pass reduces to a single texture fetch per pixel
+// The transmittance only depends on the view direction and is computed once, the sky-view LUT is recomputed whenever the Sun's elevation changes
+struct SkyLUT {
+	// Matches the sizes in sky.h
+	static constexpr int TRANSMITTANCE_SIZE = 256;
+	static constexpr int SKY_VIEW_WIDTH     = 256;
+	static constexpr int SKY_VIEW_HEIGHT    = 128;
+
+	// The sky-view LUT stores azimuths relative to the Sun, so its contents only depend on the Sun's elevation and not on its azimuth
+	// Change in the y component of the Sun direction (about 0.25 degrees near the horizon) before the sky-view LUT is recomputed
+	static constexpr float SUN_ELEVATION_THRESHOLD = 0.004f;
+
+	VkSampler sampler; // Bilinear, for both LUTs
+
+private:
+	struct Image {
+		VkImage        image;
+		VkDeviceMemory memory;
+		VkImageView    image_view;
+	};
+	Image transmittance;
+	Image sky_view;
+
+	VkDescriptorSetLayout descriptor_set_layout_transmittance;
+	VkDescriptorSetLayout descriptor_set_layout_sky_view;
+
+	VkPipelineLayout pipeline_layout_transmittance;
+	VkPipelineLayout pipeline_layout_sky_view;
+
+	VkPipeline pipeline_transmittance;
+	VkPipeline pipeline_sky_view;
+
+	VkDescriptorSet descriptor_set_transmittance;
+	VkDescriptorSet descriptor_set_sky_view;
+
+	bool    valid = false; // False until the first update, the transmittance LUT is built along with the first sky-view LUT
+	float   sun_elevation; // y component of the Sun direction at the last update
+
+	static Image image_create(int width, int height);
+	static void  image_destroy(Image & image);
+
+public:
+	void init(DescriptorAllocator & descriptor_allocator);
+	void free();
+
+	// Recomputes the LUTs only if the Sun's elevation changed beyond SUN_ELEVATION_THRESHOLD since the last update, returns whether anything was recorded
+	bool update(VkCommandBuffer command_buffer, Vector3 const & sun_direction);
+
+	VkImageView get_sky_view() const { return sky_view.image_view; } // Sampled by the Sky pass in VK_IMAGE_LAYOUT_GENERAL
+};
@@ -14,5 +14,7 @@ struct Texture {
 
 	VkDescriptorSet descriptor_set;
 
+	bool alpha_masked; // True if any texel fails the alpha test in geometry.frag
+
 	void generate_mipmaps(int width, int height, int mip_levels);
 };
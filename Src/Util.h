@@ -5,7 +5,13 @@
 
 #include "Types.h"
 
+#ifdef _MSC_VER
 #define FORCEINLINE __forceinline
+#define DEBUG_BREAK() __debugbreak()
+#else
+#define FORCEINLINE __attribute__((always_inline))
+#define DEBUG_BREAK() __builtin_trap()
+#endif
 
 #define PI          3.14159265359f
 #define ONE_OVER_PI 0.31830988618f
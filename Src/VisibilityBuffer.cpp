@@ -0,0 +1,296 @@
+#include "VisibilityBuffer.h"
+
+#include "VulkanCheck.h"
+#include "VulkanContext.h"
+
+#include "Mesh.h"
+
+#include "Math.h"
+#include "Util.h"
+
+struct ResolvePushConstants {
+	alignas(16) Matrix4 view_projection;
+};
+
+int VisibilityBuffer::get_triangle_bits(Scene const & scene) {
+	auto max_triangle_count = 1;
+
+	for (auto const & mesh : scene.asset_manager.meshes) {
+		for (auto const & sub_mesh : mesh.sub_meshes) {
+			max_triangle_count = Math::max(max_triangle_count, sub_mesh.index_count / 3);
+		}
+	}
+
+	auto triangle_bits = 1;
+	while ((1u << triangle_bits) < u32(max_triangle_count)) triangle_bits++;
+
+	return triangle_bits;
+}
+
+bool VisibilityBuffer::is_supported(Scene const & scene, int draw_count) {
+	auto triangle_bits = get_triangle_bits(scene);
+	if (triangle_bits >= 32) return false;
+
+	// Draw indices are offset by one so that zero remains free for pixels that nothing was drawn to
+	return u64(draw_count) < (u64(1) << (32 - triangle_bits));
+}
+
+void VisibilityBuffer::init(DescriptorAllocator & descriptor_allocator, Scene const & scene, InitDetails const & details) {
+	auto device = VulkanContext::get_device();
+
+	width  = details.width;
+	height = details.height;
+
+	sampler = details.sampler;
+
+	triangle_bits = get_triangle_bits(scene);
+
+	// Create Render Passes, Depth is shared with the GBuffer so its layouts match the GBuffer's Render Passes
+	VkAttachmentDescription description_visibility = { };
+	description_visibility.format = FORMAT;
+	description_visibility.samples = VK_SAMPLE_COUNT_1_BIT;
+	description_visibility.loadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	description_visibility.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	description_visibility.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	description_visibility.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	description_visibility.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	description_visibility.finalLayout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	render_pass = VulkanContext::create_render_pass({ description_visibility, details.depth_description });
+
+	auto description_visibility_load = description_visibility;
+	description_visibility_load.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	description_visibility_load.initialLayout = description_visibility.finalLayout;
+
+	auto description_depth_load = details.depth_description;
+	description_depth_load.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	description_depth_load.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	render_pass_load = VulkanContext::create_render_pass({ description_visibility_load, description_depth_load });
+
+	// All zero bits, which the Visibility Image interprets as unsigned integer zero
+	clear_values = { VulkanContext::create_clear_value_colour(), VulkanContext::create_clear_value_depth() };
+
+	image_create(details.depth_view);
+
+	// Copy the Vertices and Indices of all static Meshes into a single Buffer each, so that any triangle can be fetched by the resolve
+	auto vertex_count = 0;
+	auto index_count  = 0;
+
+	mesh_offsets.resize(scene.asset_manager.meshes.size());
+
+	for (int i = 0; i < scene.asset_manager.meshes.size(); i++) {
+		auto const & mesh = scene.asset_manager.meshes[i];
+
+		mesh_offsets[i].first_vertex = vertex_count;
+		mesh_offsets[i].first_index  = index_count;
+
+		vertex_count += mesh.vertex_count;
+		index_count  += mesh.index_count;
+	}
+
+	// Vulkan does not allow empty Buffers
+	storage_buffers.vertices = VulkanMemory::Buffer(Math::max(vertex_count, 1) * sizeof(Mesh::Vertex),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	storage_buffers.indices = VulkanMemory::Buffer(Math::max(index_count, 1) * sizeof(u32),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	{
+		auto command_buffer = VulkanMemory::command_buffer_single_use_begin();
+
+		for (int i = 0; i < scene.asset_manager.meshes.size(); i++) {
+			auto const & mesh = scene.asset_manager.meshes[i];
+
+			if (mesh.vertex_count > 0) {
+				VkBufferCopy region = { 0, mesh_offsets[i].first_vertex * sizeof(Mesh::Vertex), mesh.vertex_count * sizeof(Mesh::Vertex) };
+				vkCmdCopyBuffer(command_buffer, mesh.vertex_buffer.buffer, storage_buffers.vertices.buffer, 1, &region);
+			}
+
+			if (mesh.index_count > 0) {
+				VkBufferCopy region = { 0, mesh_offsets[i].first_index * sizeof(u32), mesh.index_count * sizeof(u32) };
+				vkCmdCopyBuffer(command_buffer, mesh.index_buffer.buffer, storage_buffers.indices.buffer, 1, &region);
+			}
+		}
+
+		VulkanMemory::command_buffer_single_use_end(command_buffer);
+	}
+
+	// Create Descriptor Set Layout
+	VkDescriptorSetLayoutBinding layout_bindings[6] = { };
+	layout_bindings[0].binding = 0;
+	layout_bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layout_bindings[0].descriptorCount = 1;
+	layout_bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	for (int i = 1; i < Util::array_element_count(layout_bindings); i++) {
+		layout_bindings[i].binding = i;
+		layout_bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings[i].descriptorCount = 1;
+		layout_bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_create_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layout_create_info.bindingCount = Util::array_element_count(layout_bindings);
+	layout_create_info.pBindings    = layout_bindings;
+
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layout_create_info, nullptr, &descriptor_set_layout));
+
+	// Create Pipeline, the Textures are bound in set 0 like in the GBuffer Pipelines
+	VulkanContext::PipelineLayoutDetails pipeline_layout_details;
+	pipeline_layout_details.descriptor_set_layouts = { details.descriptor_set_layout_textures, descriptor_set_layout };
+	pipeline_layout_details.push_constants = { { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ResolvePushConstants) } };
+
+	pipeline_layout = VulkanContext::create_pipeline_layout(pipeline_layout_details);
+
+	auto compact = details.gbuffer_layout == GBufferLayout::COMPACT;
+
+	VulkanContext::PipelineDetails pipeline_details;
+	pipeline_details.blends = {
+		VulkanContext::PipelineDetails::BLEND_NONE,
+		VulkanContext::PipelineDetails::BLEND_NONE
+	};
+	if (compact) {
+		pipeline_details.blends.push_back(VulkanContext::PipelineDetails::BLEND_NONE);
+	}
+	pipeline_details.cull_mode = VK_CULL_MODE_NONE;
+	pipeline_details.shaders = {
+		{ "Shaders/sky.vert.spv",                VK_SHADER_STAGE_VERTEX_BIT   },
+		{ "Shaders/visibility_resolve.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT }
+	};
+	pipeline_details.specialization_constants = {
+		{ 1, u32(details.texture_count) }, // TEXTURE_COUNT
+		{ 3, u32(compact) },               // GBUFFER_COMPACT
+		{ 4, u32(triangle_bits) }          // TRIANGLE_BITS
+	};
+	pipeline_details.enable_depth_test  = false;
+	pipeline_details.enable_depth_write = false;
+	pipeline_details.pipeline_layout = pipeline_layout;
+	pipeline_details.render_pass     = details.render_pass_gbuffer;
+
+	VulkanContext::create_pipeline_deferred(pipeline_details, &pipeline);
+
+	// Allocate Descriptor Sets, they are written by descriptor_sets_update once the GBuffer's Buffers exist
+	descriptor_sets.resize(details.swapchain_image_count);
+
+	for (int i = 0; i < descriptor_sets.size(); i++) {
+		descriptor_sets[i] = descriptor_allocator.allocate(descriptor_set_layout);
+	}
+}
+
+void VisibilityBuffer::descriptor_sets_update(std::vector<VkBuffer> const & instances, std::vector<VkBuffer> const & draws, std::vector<VkBuffer> const & materials) {
+	struct {
+		VkDescriptorImageInfo  visibility;
+		VkDescriptorBufferInfo instances;
+		VkDescriptorBufferInfo draws;
+		VkDescriptorBufferInfo materials;
+		VkDescriptorBufferInfo vertices;
+		VkDescriptorBufferInfo indices;
+	} descriptors;
+
+	DescriptorUpdateTemplate update_template;
+	update_template.init(descriptor_set_layout, {
+		{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, offsetof(decltype(descriptors), visibility) },
+		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         offsetof(decltype(descriptors), instances) },
+		{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         offsetof(decltype(descriptors), draws) },
+		{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         offsetof(decltype(descriptors), materials) },
+		{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         offsetof(decltype(descriptors), vertices) },
+		{ 5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         offsetof(decltype(descriptors), indices) }
+	});
+
+	for (int i = 0; i < descriptor_sets.size(); i++) {
+		descriptors.visibility = { sampler, image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		descriptors.instances  = { instances[i],                       0, VK_WHOLE_SIZE };
+		descriptors.draws      = { draws[i],                           0, VK_WHOLE_SIZE };
+		descriptors.materials  = { materials[i],                       0, VK_WHOLE_SIZE };
+		descriptors.vertices   = { storage_buffers.vertices.buffer, 0, VK_WHOLE_SIZE };
+		descriptors.indices    = { storage_buffers.indices .buffer, 0, VK_WHOLE_SIZE };
+
+		update_template.update(descriptor_sets[i], &descriptors);
+	}
+
+	update_template.free();
+}
+
+void VisibilityBuffer::free() {
+	auto device = VulkanContext::get_device();
+
+	image_destroy();
+
+	storage_buffers.vertices = VulkanMemory::Buffer();
+	storage_buffers.indices  = VulkanMemory::Buffer();
+
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
+	vkDestroyPipelineLayout     (device, pipeline_layout,       nullptr);
+
+	VulkanContext::destroy_pipeline(pipeline);
+
+	VulkanContext::destroy_render_pass(render_pass);
+	VulkanContext::destroy_render_pass(render_pass_load);
+}
+
+void VisibilityBuffer::resize(int width, int height, VkImageView depth_view) {
+	this->width  = width;
+	this->height = height;
+
+	image_destroy();
+	image_create(depth_view);
+
+	descriptor_update_image();
+}
+
+void VisibilityBuffer::image_create(VkImageView depth_view) {
+	VulkanMemory::create_image(width, height, 1, FORMAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		image, memory
+	);
+
+	image_view = VulkanMemory::create_image_view(image, 1, FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	frame_buffer = VulkanContext::create_frame_buffer(width, height, render_pass, { image_view, depth_view });
+}
+
+void VisibilityBuffer::image_destroy() {
+	auto device = VulkanContext::get_device();
+
+	vkDestroyFramebuffer(device, frame_buffer, nullptr);
+
+	vkDestroyImageView(device, image_view, nullptr);
+
+	vkDestroyImage(device, image,  nullptr);
+	vkFreeMemory  (device, memory, nullptr);
+}
+
+void VisibilityBuffer::descriptor_update_image() {
+	VkDescriptorImageInfo image_info = { sampler, image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+	for (auto descriptor_set : descriptor_sets) {
+		VkWriteDescriptorSet write_descriptor_set = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write_descriptor_set.dstSet = descriptor_set;
+		write_descriptor_set.dstBinding = 0;
+		write_descriptor_set.dstArrayElement = 0;
+		write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write_descriptor_set.descriptorCount = 1;
+		write_descriptor_set.pImageInfo      = &image_info;
+
+		vkUpdateDescriptorSets(VulkanContext::get_device(), 1, &write_descriptor_set, 0, nullptr);
+	}
+}
+
+void VisibilityBuffer::resolve(int image_index, VkCommandBuffer command_buffer, Matrix4 const & view_projection, VkDescriptorSet descriptor_set_textures) {
+	ResolvePushConstants push_constants = { };
+	push_constants.view_projection = view_projection;
+
+	vkCmdBindPipeline      (command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set_textures,      0, nullptr);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 1, 1, &descriptor_sets[image_index], 0, nullptr);
+	vkCmdPushConstants     (command_buffer, pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ResolvePushConstants), &push_constants);
+
+	vkCmdDraw(command_buffer, 3, 1, 0, 0);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanMemory.h"
+#include "DescriptorAllocator.h"
+
+#include "Matrix4.h"
+#include "Scene.h"
+#include "GBufferLayout.h"
+
+// Static geometry is rasterized into a single 32 bit id per pixel: the Draw in the high bits, the triangle within the Draw in the low bits
+// A full screen resolve then fetches the Vertices of the visible triangle from a shared Geometry Buffer and writes the GBuffer,
+// so Textures and Materials are evaluated exactly once per pixel regardless of overdraw
+struct VisibilityBuffer {
+	static constexpr VkFormat FORMAT = VK_FORMAT_R32_UINT;
+
+	VkImage        image;
+	VkDeviceMemory memory;
+	VkImageView    image_view;
+
+	VkRenderPass render_pass;      // Visibility + Depth, both cleared
+	VkRenderPass render_pass_load; // Continues where render_pass left off, used by the late occlusion culling phase
+
+	VkFramebuffer frame_buffer;
+
+	std::vector<VkClearValue> clear_values;
+
+	// Position of every Mesh in the shared Geometry Buffers, indexed by MeshHandle
+	struct MeshOffset {
+		u32 first_vertex;
+		u32 first_index;
+	};
+	std::vector<MeshOffset> mesh_offsets;
+
+	int triangle_bits; // Number of low bits that store the triangle, the remaining bits store the Draw index + 1. Zero means nothing was drawn
+
+private:
+	int width;
+	int height;
+
+	struct {
+		VulkanMemory::Buffer vertices; // Vertices of all static Meshes
+		VulkanMemory::Buffer indices;  // Indices of all static Meshes, relative to the first Vertex of their Mesh
+	} storage_buffers;
+
+	VkDescriptorSetLayout descriptor_set_layout;
+	VkPipelineLayout      pipeline_layout;
+	VkPipeline            pipeline;
+
+	std::vector<VkDescriptorSet> descriptor_sets; // One per Swapchain Image
+
+	VkSampler sampler; // Owned by the GBuffer Render Target
+
+	void image_create(VkImageView depth_view);
+	void image_destroy();
+
+	void descriptor_update_image();
+
+public:
+	// Number of triangle bits needed for the largest static Submesh of the Scene
+	static int get_triangle_bits(Scene const & scene);
+
+	// The ids have to fit in 32 bits, which limits the number of Draws for a given number of triangle bits
+	static bool is_supported(Scene const & scene, int draw_count);
+
+	struct InitDetails {
+		int width;
+		int height;
+		int swapchain_image_count;
+
+		VkAttachmentDescription depth_description; // Of the GBuffer, the Visibility pass renders into the same Depth Buffer
+		VkImageView             depth_view;
+		VkSampler               sampler;
+
+		VkRenderPass          render_pass_gbuffer; // The resolve Pipeline writes the GBuffer colour attachments
+		GBufferLayout         gbuffer_layout;
+		VkDescriptorSetLayout descriptor_set_layout_textures;
+		int                   texture_count;
+	};
+
+	void init(DescriptorAllocator & descriptor_allocator, Scene const & scene, InitDetails const & details);
+	void free();
+
+	// Instances, Draws and Materials as read by the resolve, one Buffer of each per Swapchain Image
+	void descriptor_sets_update(std::vector<VkBuffer> const & instances, std::vector<VkBuffer> const & draws, std::vector<VkBuffer> const & materials);
+
+	void resize(int width, int height, VkImageView depth_view); // Only recreates size dependent resources
+
+	// Writes every pixel of the GBuffer colour attachments, must be recorded inside a Render Pass compatible with render_pass_gbuffer
+	// The Visibility Image must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL and visible to Fragment Shaders
+	void resolve(int image_index, VkCommandBuffer command_buffer, Matrix4 const & view_projection, VkDescriptorSet descriptor_set_textures);
+};
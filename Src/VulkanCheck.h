@@ -3,6 +3,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include "Util.h"
+
 #define VK_CHECK(result) check_vulkan_call(result, __FILE__, __LINE__);
 
 inline char const * vulkan_error_string(VkResult error) {
@@ -54,6 +56,6 @@ inline void check_vulkan_call(VkResult result, const char * file, int line) {
 	if (result != VK_SUCCESS) {
 		printf("Vulkan call at %s line %i failed with error: %s!\n", file, line, vulkan_error_string(result));
 
-		__debugbreak();
+		DEBUG_BREAK();
 	}
 }
@@ -1,6 +1,15 @@
 #include "VulkanContext.h"
 
+#include <string.h>
+#include <stddef.h>
+
 #include <set>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
 
 #include "VulkanCheck.h"
 #include "VulkanMemory.h"
@@ -15,7 +24,9 @@ static VkPhysicalDevice physical_device;
 
 static VkDevice device;
 
-static VkSurfaceKHR surface;
+static VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+static bool headless;
 
 static u32 queue_family_graphics;
 static u32 queue_family_compute;
@@ -26,9 +37,66 @@ static VkQueue queue_compute;
 static VkQueue queue_present;
 
 static VkCommandPool command_pool;
+static VkCommandPool command_pool_compute;
 
 static size_t min_uniform_buffer_alignment;
 
+static float timestamp_period;
+static u32   timestamp_valid_bits; // Of the graphics Queue Family
+
+// Signaled by every submission to the graphics Queue, with strictly increasing values
+static VkSemaphore timeline_semaphore;
+static u64         timeline_value = 0; // Last value handed out by timeline_next_value
+
+static bool bindless_supported = false;
+static u32  bindless_max_textures = 0;
+
+static bool draw_indirect_count_supported = false;
+
+static bool visibility_buffer_supported = false;
+
+// Pipeline Cache, persisted to disk between runs
+static constexpr char const * PIPELINE_CACHE_FILENAME = "pipeline_cache.bin";
+static constexpr u32          PIPELINE_CACHE_MAGIC    = 0x43505652; // "RVPC"
+
+// Prepended to the data returned by vkGetPipelineCacheData, so that caches from other devices or drivers are rejected
+struct PipelineCacheFileHeader {
+	u32 magic;
+	u32 vendor_id;
+	u32 device_id;
+	u32 driver_version;
+	u8  uuid[VK_UUID_SIZE];
+	u64 data_size;
+};
+
+static VkPipelineCache pipeline_cache;
+static bool            pipeline_cache_warm = false;
+
+// Shader Modules are shared between Pipelines and live until the Context is destroyed
+static std::unordered_map<std::string, VkShaderModule> shader_modules;
+static std::mutex                                      shader_modules_mutex;
+
+// Pipelines are reference counted, identical PipelineDetails share the same Pipeline
+struct PipelineEntry {
+	std::string key;
+	VkPipeline  pipeline;
+	int         ref_count;
+};
+static std::vector<PipelineEntry> pipelines;
+
+struct PipelinePending {
+	std::string                    key;
+	VulkanContext::PipelineDetails details;
+	std::vector<VkPipeline *>      outputs;
+};
+static std::vector<PipelinePending> pipelines_pending;
+static int                          pipelines_deduplicated = 0;
+
+// Format and sample count of every attachment of the Render Passes made by create_render_pass, which fully determines their compatibility.
+// Pipelines are keyed on this instead of the handle, so that Render Tasks with compatible Render Passes share Pipelines
+// Entries are erased by destroy_render_pass, so a recycled handle never maps to the description of a destroyed Render Pass
+static std::unordered_map<VkRenderPass, std::string> render_pass_keys;
+
 #ifdef NDEBUG
 static constexpr bool validation_layers_enabled = false;
 #else
@@ -50,24 +118,26 @@ static VkBool32 debug_callback(
 	if (msg_severity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
 		printf("VULKAN Debug Callback: '%s'\n", callback_data->pMessage);
 
-		__debugbreak();
+		DEBUG_BREAK();
 	}
 
 	return VK_FALSE;
 }
 
-std::vector<char const *> const device_extensions = {
-	VK_KHR_SWAPCHAIN_EXTENSION_NAME
-};
+std::vector<char const *> device_extensions;
 
 #define VULKAN_PROC(func_name) ( (PFN_##func_name)vkGetInstanceProcAddr(instance, #func_name) )
 
 static void init_instance() {
-	// Get GLFW required extensions
-	u32  glfw_extension_count = 0;
-	auto glfw_extensions      = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+	std::vector<char const *> extensions;
+
+	// Get GLFW required extensions, in headless mode no surface extensions are needed
+	if (!headless) {
+		u32  glfw_extension_count = 0;
+		auto glfw_extensions      = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
 
-	std::vector<char const *> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+		extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+	}
 
 	// Init validation layers
 	if (validation_layers_enabled) {
@@ -97,7 +167,7 @@ static void init_instance() {
 	app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	app_info.pEngineName = "Vulkan";
 	app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	app_info.apiVersion = VK_API_VERSION_1_0;
+	app_info.apiVersion = VK_API_VERSION_1_2;
 
 	VkInstanceCreateInfo instance_create_info = { VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
 	instance_create_info.pApplicationInfo = &app_info;
@@ -145,7 +215,48 @@ static void init_physical_device() {
 
 	min_uniform_buffer_alignment = properties.limits.minUniformBufferOffsetAlignment;
 
+	timestamp_period = properties.limits.timestampPeriod;
+
+	// Check support for bindless Textures, which requires Descriptor Indexing (core in Vulkan 1.2)
+	if (properties.apiVersion >= VK_API_VERSION_1_2) {
+		VkPhysicalDeviceVulkan12Properties properties_12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES };
+		VkPhysicalDeviceProperties2        properties_2  = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+		properties_2.pNext = &properties_12;
+
+		vkGetPhysicalDeviceProperties2(physical_device, &properties_2);
+
+		VkPhysicalDeviceVulkan12Features features_12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+		VkPhysicalDeviceFeatures2        features_2  = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
+		features_2.pNext = &features_12;
+
+		vkGetPhysicalDeviceFeatures2(physical_device, &features_2);
+
+		bindless_supported =
+			features_2.features.shaderSampledImageArrayDynamicIndexing &&
+			features_12.descriptorBindingPartiallyBound &&
+			features_12.descriptorBindingSampledImageUpdateAfterBind;
+
+		bindless_max_textures = Math::min(
+			properties_12.maxPerStageDescriptorUpdateAfterBindSamplers,
+			properties_12.maxDescriptorSetUpdateAfterBindSampledImages
+		);
+
+		draw_indirect_count_supported =
+			features_2.features.multiDrawIndirect &&
+			features_2.features.drawIndirectFirstInstance &&
+			features_12.drawIndirectCount;
+
+		// The Visibility Buffer reads gl_PrimitiveID in the Fragment Shader and selects a bindless Texture per pixel
+		visibility_buffer_supported =
+			bindless_supported &&
+			features_2.features.geometryShader &&
+			features_12.shaderSampledImageArrayNonUniformIndexing;
+	}
+
 	printf("Picked Device Name: %s\n", properties.deviceName);
+	printf("Bindless Textures: %s\n", bindless_supported ? "supported" : "unsupported");
+	printf("Draw Indirect Count: %s\n", draw_indirect_count_supported ? "supported" : "unsupported");
+	printf("Visibility Buffer: %s\n", visibility_buffer_supported ? "supported" : "unsupported");
 }
 
 static void init_surface(GLFWwindow * window) {
@@ -160,20 +271,31 @@ static void init_queue_families() {
 	std::optional<u32> opt_queue_family_compute;
 	std::optional<u32> opt_queue_family_present;
 
+	std::optional<u32> opt_queue_family_compute_dedicated;
+
 	for (int i = 0; i < queue_families_count; i++) {
 		bool supports_graphics = queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT;
 		bool supports_compute  = queue_families[i].queueFlags & VK_QUEUE_COMPUTE_BIT;
 
-		VkBool32 supports_present = false;
-		VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &supports_present));
+		// A compute only Queue Family runs asynchronously to the graphics Queue, timestamps are required to profile it
+		if (supports_compute && !supports_graphics && queue_families[i].timestampValidBits > 0 && !opt_queue_family_compute_dedicated.has_value()) {
+			opt_queue_family_compute_dedicated = i;
+		}
 
-		if (supports_graphics) opt_queue_family_graphics = i;
-		if (supports_compute)  opt_queue_family_compute  = i;
-		if (supports_present)  opt_queue_family_present  = i;
+		VkBool32 supports_present = false;
+		if (headless) {
+			supports_present = supports_graphics; // Nothing is presented, reuse the graphics queue
+		} else {
+			VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface, &supports_present));
+		}
 
-		if (opt_queue_family_graphics.has_value() && opt_queue_family_compute.has_value() && opt_queue_family_present.has_value()) break;
+		if (supports_graphics && !opt_queue_family_graphics.has_value()) opt_queue_family_graphics = i;
+		if (supports_compute  && !opt_queue_family_compute .has_value()) opt_queue_family_compute  = i;
+		if (supports_present  && !opt_queue_family_present .has_value()) opt_queue_family_present  = i;
 	}
 
+	if (opt_queue_family_compute_dedicated.has_value()) opt_queue_family_compute = opt_queue_family_compute_dedicated;
+
 	if (!opt_queue_family_graphics.has_value() || !opt_queue_family_compute.has_value() || !opt_queue_family_present.has_value()) {
 		printf("Failed to create queue families!\n");
 		abort();
@@ -182,6 +304,10 @@ static void init_queue_families() {
 	queue_family_graphics = opt_queue_family_graphics.value();
 	queue_family_compute  = opt_queue_family_compute .value();
 	queue_family_present  = opt_queue_family_present .value();
+
+	timestamp_valid_bits = queue_families[queue_family_graphics].timestampValidBits;
+
+	printf("Async Compute: %s\n", queue_family_compute != queue_family_graphics ? "supported" : "unsupported");
 }
 
 static void init_device() {
@@ -189,6 +315,7 @@ static void init_device() {
 
 	std::set<u32> unique_queue_families = {
 		queue_family_graphics,
+		queue_family_compute,
 		queue_family_present
 	};
 	std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
@@ -205,9 +332,18 @@ static void init_device() {
 	device_features.samplerAnisotropy = true;
 	device_features.independentBlend = true;
 	device_features.depthBiasClamp = true;
-
-	VkPhysicalDeviceSeparateDepthStencilLayoutsFeatures dsf = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SEPARATE_DEPTH_STENCIL_LAYOUTS_FEATURES };
-	dsf.separateDepthStencilLayouts = true;
+	device_features.shaderSampledImageArrayDynamicIndexing = bindless_supported;
+	device_features.multiDrawIndirect         = draw_indirect_count_supported;
+	device_features.drawIndirectFirstInstance = draw_indirect_count_supported;
+	device_features.geometryShader = visibility_buffer_supported;
+
+	VkPhysicalDeviceVulkan12Features device_features_12 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES };
+	device_features_12.separateDepthStencilLayouts = true;
+	device_features_12.timelineSemaphore = true; // Required by Vulkan 1.2
+	device_features_12.descriptorBindingPartiallyBound              = bindless_supported;
+	device_features_12.descriptorBindingSampledImageUpdateAfterBind = bindless_supported;
+	device_features_12.drawIndirectCount = draw_indirect_count_supported;
+	device_features_12.shaderSampledImageArrayNonUniformIndexing = visibility_buffer_supported;
 
 	VkDeviceCreateInfo device_create_info = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
 	device_create_info.queueCreateInfoCount = queue_create_infos.size();
@@ -215,7 +351,7 @@ static void init_device() {
 	device_create_info.pEnabledFeatures = &device_features;
 	device_create_info.enabledExtensionCount   = device_extensions.size();
 	device_create_info.ppEnabledExtensionNames = device_extensions.data();
-	device_create_info.pNext = &dsf;
+	device_create_info.pNext = &device_features_12;
 
 	if constexpr (validation_layers_enabled) {
 		device_create_info.enabledLayerCount   = validation_layers_names.size();
@@ -237,35 +373,161 @@ static void init_command_pool() {
 	command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 	VK_CHECK(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool));
+
+	command_pool_create_info.queueFamilyIndex = queue_family_compute;
+
+	VK_CHECK(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool_compute));
+}
+
+static void init_timeline_semaphore() {
+	VkSemaphoreTypeCreateInfo semaphore_type_create_info = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO };
+	semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphore_type_create_info.initialValue  = 0;
+
+	VkSemaphoreCreateInfo semaphore_create_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	semaphore_create_info.pNext = &semaphore_type_create_info;
+
+	VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &timeline_semaphore));
+
+	timeline_value = 0;
+}
+
+static void init_pipeline_cache() {
+	VkPhysicalDeviceProperties properties; vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	std::vector<u8> cache_data;
+
+	// Try to load the Pipeline Cache from disk, it is only used if it was created by the same device and driver
+	FILE * file = fopen(PIPELINE_CACHE_FILENAME, "rb");
+	if (file) {
+		PipelineCacheFileHeader header = { };
+
+		bool valid =
+			fread(&header, sizeof(header), 1, file) == 1 &&
+			header.magic          == PIPELINE_CACHE_MAGIC &&
+			header.vendor_id      == properties.vendorID &&
+			header.device_id      == properties.deviceID &&
+			header.driver_version == properties.driverVersion &&
+			memcmp(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+		if (valid) {
+			cache_data.resize(header.data_size);
+			valid = fread(cache_data.data(), 1, cache_data.size(), file) == cache_data.size();
+		}
+
+		// The data itself starts with a VkPipelineCacheHeaderVersionOne, check it as well to be safe
+		if (valid) {
+			u32 header_version_one[4] = { };
+			if (cache_data.size() >= sizeof(header_version_one) + VK_UUID_SIZE) memcpy(header_version_one, cache_data.data(), sizeof(header_version_one));
+
+			valid =
+				header_version_one[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+				header_version_one[2] == properties.vendorID &&
+				header_version_one[3] == properties.deviceID &&
+				memcmp(cache_data.data() + sizeof(header_version_one), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+		}
+
+		fclose(file);
+
+		if (!valid) {
+			printf("WARNING: Pipeline Cache '%s' is invalid or from a different device/driver, ignoring it!\n", PIPELINE_CACHE_FILENAME);
+			cache_data.clear();
+		}
+	}
+
+	pipeline_cache_warm = cache_data.size() > 0;
+
+	VkPipelineCacheCreateInfo pipeline_cache_create_info = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+	pipeline_cache_create_info.initialDataSize = cache_data.size();
+	pipeline_cache_create_info.pInitialData    = cache_data.data();
+
+	VK_CHECK(vkCreatePipelineCache(device, &pipeline_cache_create_info, nullptr, &pipeline_cache));
+}
+
+static void save_pipeline_cache() {
+	VkPhysicalDeviceProperties properties; vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+	size_t          cache_size; VK_CHECK(vkGetPipelineCacheData(device, pipeline_cache, &cache_size, nullptr));
+	std::vector<u8> cache_data(cache_size);
+	VK_CHECK(vkGetPipelineCacheData(device, pipeline_cache, &cache_size, cache_data.data()));
+
+	PipelineCacheFileHeader header = { };
+	header.magic          = PIPELINE_CACHE_MAGIC;
+	header.vendor_id      = properties.vendorID;
+	header.device_id      = properties.deviceID;
+	header.driver_version = properties.driverVersion;
+	memcpy(header.uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.data_size = cache_size;
+
+	FILE * file = fopen(PIPELINE_CACHE_FILENAME, "wb");
+	if (file == nullptr) {
+		printf("WARNING: Unable to write Pipeline Cache to '%s'!\n", PIPELINE_CACHE_FILENAME);
+		return;
+	}
+
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(cache_data.data(), 1, cache_size, file);
+	fclose(file);
 }
 
 void VulkanContext::init(GLFWwindow * window) {
+	headless = window == nullptr;
+
+	if (!headless) device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
 	init_instance();
 	init_physical_device();
-	init_surface(window);
+	if (!headless) init_surface(window);
 	init_queue_families();
 	init_device();
 	init_queues();
 	init_command_pool();
+	init_timeline_semaphore();
+	init_pipeline_cache();
 }
 
 void VulkanContext::destroy() {
-	vkDestroyCommandPool(device, command_pool, nullptr);
+	if (pipelines.size() > 0) printf("WARNING: %zu Pipelines were not destroyed!\n", pipelines.size());
+
+	save_pipeline_cache();
+	vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+
+	for (auto const & [filename, module] : shader_modules) {
+		vkDestroyShaderModule(device, module, nullptr);
+	}
+	shader_modules.clear();
+
+	vkDestroyCommandPool(device, command_pool,         nullptr);
+	vkDestroyCommandPool(device, command_pool_compute, nullptr);
+
+	vkDestroySemaphore(device, timeline_semaphore, nullptr);
 
 	if (validation_layers_enabled) {
 		VULKAN_PROC(vkDestroyDebugUtilsMessengerEXT)(instance, debug_messenger, nullptr);
 	}
 
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	if (!headless) vkDestroySurfaceKHR(instance, surface, nullptr);
 
 	vkDestroyDevice  (device,   nullptr);
 	vkDestroyInstance(instance, nullptr);
 }
 
-VkSwapchainKHR VulkanContext::create_swapchain(u32 width, u32 height) {
+VkSwapchainKHR VulkanContext::create_swapchain(u32 width, u32 height, VkPresentModeKHR & present_mode, VkSwapchainKHR old_swapchain) {
 	VkSurfaceCapabilitiesKHR surface_capabilities;
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &surface_capabilities);
 
+	u32                           present_mode_count;
+	std::vector<VkPresentModeKHR> present_modes;
+
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, nullptr);
+	present_modes.resize(present_mode_count);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &present_mode_count, present_modes.data());
+
+	if (std::find(present_modes.begin(), present_modes.end(), present_mode) == present_modes.end()) {
+		printf("WARNING: Present Mode %i not supported, falling back to FIFO!\n", int(present_mode));
+		present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	}
+
 	VkExtent2D extent;
 	extent.width  = Math::max(surface_capabilities.minImageExtent.width,  Math::min(surface_capabilities.maxImageExtent.width , width));
 	extent.height = Math::max(surface_capabilities.minImageExtent.height, Math::min(surface_capabilities.maxImageExtent.height, height));
@@ -301,9 +563,9 @@ VkSwapchainKHR VulkanContext::create_swapchain(u32 width, u32 height) {
 
 	swapchain_create_info.preTransform = surface_capabilities.currentTransform;
 	swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	swapchain_create_info.presentMode = PRESENT_MODE;
+	swapchain_create_info.presentMode = present_mode;
 	swapchain_create_info.clipped = VK_TRUE;
-	swapchain_create_info.oldSwapchain = VK_NULL_HANDLE;
+	swapchain_create_info.oldSwapchain = old_swapchain;
 
 	VkSwapchainKHR swapchain; VK_CHECK(vkCreateSwapchainKHR(device, &swapchain_create_info, nullptr, &swapchain));
 
@@ -333,15 +595,26 @@ VkFormat VulkanContext::get_supported_depth_format() {
 }
 
 VulkanContext::Shader VulkanContext::shader_load(std::string const & filename, VkShaderStageFlagBits stage) {
-	std::vector<char> spirv = Util::read_file(filename);
+	Shader shader;
 
-	VkShaderModuleCreateInfo create_info = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-	create_info.codeSize = spirv.size();
-	create_info.pCode = reinterpret_cast<const u32 *>(spirv.data());
+	{
+		std::lock_guard lock(shader_modules_mutex);
 
-	Shader shader;
+		auto cached = shader_modules.find(filename);
+		if (cached != shader_modules.end()) {
+			shader.module = cached->second;
+		} else {
+			std::vector<char> spirv = Util::read_file(filename);
+
+			VkShaderModuleCreateInfo create_info = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+			create_info.codeSize = spirv.size();
+			create_info.pCode = reinterpret_cast<const u32 *>(spirv.data());
 
-	VK_CHECK(vkCreateShaderModule(device, &create_info, nullptr, &shader.module));
+			VK_CHECK(vkCreateShaderModule(device, &create_info, nullptr, &shader.module));
+
+			shader_modules[filename] = shader.module;
+		}
+	}
 
 	shader.stage_create_info = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
 	shader.stage_create_info.stage  = stage;
@@ -409,9 +682,22 @@ VkRenderPass VulkanContext::create_render_pass(std::vector<VkAttachmentDescripti
 
 	VkRenderPass render_pass; VK_CHECK(vkCreateRenderPass(device, &render_pass_create_info, nullptr, &render_pass));
 
+	auto & render_pass_key = render_pass_keys[render_pass];
+
+	for (auto const & attachment : attachments) {
+		render_pass_key.append(reinterpret_cast<char const *>(&attachment.format),  sizeof(attachment.format));
+		render_pass_key.append(reinterpret_cast<char const *>(&attachment.samples), sizeof(attachment.samples));
+	}
+
 	return render_pass;
 }
 
+void VulkanContext::destroy_render_pass(VkRenderPass render_pass) {
+	render_pass_keys.erase(render_pass);
+
+	vkDestroyRenderPass(device, render_pass, nullptr);
+}
+
 VkPipelineLayout VulkanContext::create_pipeline_layout(PipelineLayoutDetails const & details) {
 	VkPipelineLayoutCreateInfo pipeline_layout_create_info = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
 	pipeline_layout_create_info.setLayoutCount = details.descriptor_set_layouts.size();
@@ -424,8 +710,89 @@ VkPipelineLayout VulkanContext::create_pipeline_layout(PipelineLayoutDetails con
 	return pipeline_layout;
 }
 
-VkPipeline VulkanContext::create_pipeline(PipelineDetails const & details) {
-	// Create Pipeline Layout
+// Serializes all state of the PipelineDetails, two Pipelines with the same key are identical
+// Render Passes are described by their attachments, so Pipelines are shared between compatible Render Passes of different Render Tasks.
+// Pipeline Layouts are still compared by handle, Descriptor Set Layouts are not created through the Context so their bindings are unknown here.
+// Every Render Task creates its own Pipeline Layouts, so deduplication of Pipelines with a layout only happens within a single Render Task
+static std::string get_pipeline_key(VulkanContext::PipelineDetails const & details) {
+	std::string key;
+
+	auto append = [&key](void const * data, size_t size) {
+		key.append(reinterpret_cast<char const *>(data), size);
+	};
+	auto append_vector = [&](auto const & vector) {
+		size_t size = vector.size();
+		append(&size, sizeof(size));
+		append(vector.data(), vector.size() * sizeof(vector[0]));
+	};
+
+	append_vector(details.vertex_bindings);
+	append_vector(details.vertex_attributes);
+	append_vector(details.blends);
+	append_vector(details.specialization_constants);
+
+	for (auto const & [filename, stage] : details.shaders) {
+		key += filename;
+		key += '\0';
+		append(&stage, sizeof(stage));
+	}
+
+	append(&details.cull_mode,          sizeof(details.cull_mode));
+	append(&details.enable_depth_test,  sizeof(details.enable_depth_test));
+	append(&details.enable_depth_write, sizeof(details.enable_depth_write));
+	append(&details.enable_depth_bias,  sizeof(details.enable_depth_bias));
+	append(&details.depth_compare,      sizeof(details.depth_compare));
+	append(&details.pipeline_layout,    sizeof(details.pipeline_layout));
+
+	auto render_pass_key = render_pass_keys.find(details.render_pass);
+	if (render_pass_key != render_pass_keys.end()) {
+		key += render_pass_key->second;
+	} else {
+		append(&details.render_pass, sizeof(details.render_pass));
+	}
+
+	return key;
+}
+
+static VkPipeline compile_pipeline(VulkanContext::PipelineDetails const & details) {
+	std::vector<VkSpecializationMapEntry> specialization_entries(details.specialization_constants.size());
+	for (int i = 0; i < details.specialization_constants.size(); i++) {
+		specialization_entries[i].constantID = details.specialization_constants[i].id;
+		specialization_entries[i].offset     = i * sizeof(VulkanContext::PipelineDetails::SpecializationConstant) + offsetof(VulkanContext::PipelineDetails::SpecializationConstant, value);
+		specialization_entries[i].size       = sizeof(u32);
+	}
+
+	VkSpecializationInfo specialization_info = { };
+	specialization_info.mapEntryCount = specialization_entries.size();
+	specialization_info.pMapEntries   = specialization_entries.data();
+	specialization_info.dataSize = details.specialization_constants.size() * sizeof(VulkanContext::PipelineDetails::SpecializationConstant);
+	specialization_info.pData    = details.specialization_constants.data();
+
+	std::vector<Shader>                          shaders(details.shaders.size());
+	std::vector<VkPipelineShaderStageCreateInfo> stages (details.shaders.size());
+
+	for (int i = 0; i < details.shaders.size(); i++) {
+		auto [filename, stage] = details.shaders[i];
+
+		shaders[i] = VulkanContext::shader_load(filename, stage);
+		stages [i] = shaders[i].stage_create_info;
+
+		if (details.specialization_constants.size() > 0) stages[i].pSpecializationInfo = &specialization_info;
+	}
+
+	// A single Compute Shader stage makes this a Compute Pipeline, all fixed function state is ignored
+	if (stages.size() == 1 && stages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT) {
+		VkComputePipelineCreateInfo pipeline_create_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+		pipeline_create_info.stage  = stages[0];
+		pipeline_create_info.layout = details.pipeline_layout;
+		pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+		pipeline_create_info.basePipelineIndex  = -1;
+
+		VkPipeline pipeline; VK_CHECK(vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_create_info, nullptr, &pipeline));
+
+		return pipeline;
+	}
+
 	VkPipelineVertexInputStateCreateInfo vertex_input_create_info = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO };
 	vertex_input_create_info.vertexBindingDescriptionCount = details.vertex_bindings.size();
 	vertex_input_create_info.pVertexBindingDescriptions    = details.vertex_bindings.data();
@@ -436,15 +803,21 @@ VkPipeline VulkanContext::create_pipeline(PipelineDetails const & details) {
 	input_asm_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	input_asm_create_info.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport = { 0.0f, 0.0f, float(details.width), float(details.height), 0.0f, 1.0f };
-
-	VkRect2D scissor = { 0, 0, details.width, details.height };
-
+	// Viewport and Scissor are provided when recording, see set_viewport
 	VkPipelineViewportStateCreateInfo viewport_state_create_info = { VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO };
 	viewport_state_create_info.viewportCount = 1;
-	viewport_state_create_info.pViewports    = &viewport;
+	viewport_state_create_info.pViewports    = nullptr;
 	viewport_state_create_info.scissorCount = 1;
-	viewport_state_create_info.pScissors    = &scissor;
+	viewport_state_create_info.pScissors    = nullptr;
+
+	VkDynamicState dynamic_states[] = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamic_state_create_info = { VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO };
+	dynamic_state_create_info.dynamicStateCount = Util::array_element_count(dynamic_states);
+	dynamic_state_create_info.pDynamicStates    = dynamic_states;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer_create_info = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO };
 	rasterizer_create_info.depthClampEnable = VK_FALSE;
@@ -471,16 +844,6 @@ VkPipeline VulkanContext::create_pipeline(PipelineDetails const & details) {
 	blend_state_create_info.attachmentCount = details.blends.size();
 	blend_state_create_info.pAttachments    = details.blends.data();
 
-	std::vector<Shader>                          shaders(details.shaders.size());
-	std::vector<VkPipelineShaderStageCreateInfo> stages (details.shaders.size());
-
-	for (int i = 0; i < details.shaders.size(); i++) {
-		auto [filename, stage] = details.shaders[i];
-
-		shaders[i] = VulkanContext::shader_load(filename, stage);
-		stages [i] = shaders[i].stage_create_info;
-	}
-
 	VkPipelineDepthStencilStateCreateInfo depth_stencil_create_info = { VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
 	depth_stencil_create_info.depthTestEnable  = details.enable_depth_test;
 	depth_stencil_create_info.depthWriteEnable = details.enable_depth_write;
@@ -500,20 +863,114 @@ VkPipeline VulkanContext::create_pipeline(PipelineDetails const & details) {
 	pipeline_create_info.pMultisampleState   = &multisample_create_info;
 	pipeline_create_info.pDepthStencilState  = &depth_stencil_create_info;
 	pipeline_create_info.pColorBlendState    = &blend_state_create_info;
-	pipeline_create_info.pDynamicState       = nullptr;
+	pipeline_create_info.pDynamicState       = &dynamic_state_create_info;
 	pipeline_create_info.layout     = details.pipeline_layout;
 	pipeline_create_info.renderPass = details.render_pass;
 	pipeline_create_info.subpass    = 0;
 	pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
 	pipeline_create_info.basePipelineIndex  = -1;
 
-	VkPipeline pipeline; VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline));
+	VkPipeline pipeline; VK_CHECK(vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_create_info, nullptr, &pipeline));
+
+	return pipeline;
+}
+
+void VulkanContext::create_pipeline_deferred(PipelineDetails const & details, VkPipeline * pipeline) {
+	auto key = get_pipeline_key(details);
 
-	for (auto & shader : shaders) {
-		vkDestroyShaderModule(device, shader.module, nullptr);
+	// Check if an identical Pipeline already exists
+	for (auto & entry : pipelines) {
+		if (entry.key == key) {
+			entry.ref_count++;
+			*pipeline = entry.pipeline;
+
+			pipelines_deduplicated++;
+			return;
+		}
 	}
 
-	return pipeline;
+	// Check if an identical Pipeline is already waiting to be compiled
+	for (auto & pending : pipelines_pending) {
+		if (pending.key == key) {
+			pending.outputs.push_back(pipeline);
+
+			pipelines_deduplicated++;
+			return;
+		}
+	}
+
+	// Load Shaders on the calling thread, so that the worker threads only hit the Shader cache
+	for (auto const & [filename, stage] : details.shaders) {
+		(void)shader_load(filename, stage);
+	}
+
+	pipelines_pending.push_back({ key, details, { pipeline } });
+}
+
+void VulkanContext::compile_pipelines() {
+	if (pipelines_pending.size() == 0) return;
+
+	auto time_start = std::chrono::high_resolution_clock::now();
+
+	std::vector<VkPipeline> results(pipelines_pending.size());
+
+	// Distribute Pipelines over worker threads, the Pipeline Cache is internally synchronized
+	std::atomic<int> next_index = 0;
+
+	auto worker = [&]() {
+		while (true) {
+			int index = next_index++;
+			if (index >= pipelines_pending.size()) break;
+
+			results[index] = compile_pipeline(pipelines_pending[index].details);
+		}
+	};
+
+	int thread_count = Math::clamp(int(std::thread::hardware_concurrency()), 1, int(pipelines_pending.size()));
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < thread_count; i++) threads.emplace_back(worker);
+
+	worker();
+
+	for (auto & thread : threads) thread.join();
+
+	for (int i = 0; i < pipelines_pending.size(); i++) {
+		auto & pending = pipelines_pending[i];
+
+		for (auto output : pending.outputs) *output = results[i];
+
+		pipelines.push_back({ std::move(pending.key), results[i], int(pending.outputs.size()) });
+	}
+
+	float time = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - time_start).count();
+
+	printf("Created %zu Pipelines (%i deduplicated) using %i threads in %.2f ms, Pipeline Cache was %s\n", pipelines_pending.size(), pipelines_deduplicated, thread_count, time, pipeline_cache_warm ? "warm" : "cold");
+
+	pipelines_pending.clear();
+	pipelines_deduplicated = 0;
+}
+
+void VulkanContext::destroy_pipeline(VkPipeline pipeline) {
+	for (int i = 0; i < pipelines.size(); i++) {
+		if (pipelines[i].pipeline == pipeline) {
+			if (--pipelines[i].ref_count == 0) {
+				vkDestroyPipeline(device, pipeline, nullptr);
+				pipelines.erase(pipelines.begin() + i);
+			}
+			return;
+		}
+	}
+
+	vkDestroyPipeline(device, pipeline, nullptr);
+}
+
+void VulkanContext::set_viewport(VkCommandBuffer command_buffer, int width, int height) {
+	VkViewport viewport = { 0.0f, 0.0f, float(width), float(height), 0.0f, 1.0f };
+	VkRect2D   scissor  = { 0, 0, u32(width), u32(height) };
+
+	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+	vkCmdSetScissor (command_buffer, 0, 1, &scissor);
 }
 
 VkFramebuffer VulkanContext::create_frame_buffer(int width, int height, VkRenderPass render_pass, std::vector<VkImageView> const & attachments) {
@@ -550,11 +1007,54 @@ VkDevice         VulkanContext::get_device()          { return device; }
 VkSurfaceKHR VulkanContext::get_surface() { return surface; }
 
 u32 VulkanContext::get_queue_family_graphics() { return queue_family_graphics; }
+u32 VulkanContext::get_queue_family_compute()  { return queue_family_compute; }
 u32 VulkanContext::get_queue_family_present()  { return queue_family_present; }
 
 VkQueue VulkanContext::get_queue_graphics() { return queue_graphics; }
+VkQueue VulkanContext::get_queue_compute()  { return queue_compute;  }
 VkQueue VulkanContext::get_queue_present()  { return queue_present;  }
 
-VkCommandPool VulkanContext::get_command_pool() { return command_pool; }
+VkCommandPool VulkanContext::get_command_pool()         { return command_pool; }
+VkCommandPool VulkanContext::get_command_pool_compute() { return command_pool_compute; }
+
+bool VulkanContext::has_async_compute() { return queue_family_compute != queue_family_graphics; }
 
 size_t VulkanContext::get_min_uniform_buffer_alignment() { return min_uniform_buffer_alignment; }
+
+float VulkanContext::get_timestamp_period() { return timestamp_period; }
+
+u32 VulkanContext::get_timestamp_valid_bits() { return timestamp_valid_bits; }
+
+VkPipelineCache VulkanContext::get_pipeline_cache() { return pipeline_cache; }
+
+VkSemaphore VulkanContext::get_timeline_semaphore() { return timeline_semaphore; }
+
+u64 VulkanContext::timeline_next_value() {
+	return ++timeline_value;
+}
+
+u64 VulkanContext::timeline_completed_value() {
+	u64 value; VK_CHECK(vkGetSemaphoreCounterValue(device, timeline_semaphore, &value));
+	return value;
+}
+
+void VulkanContext::timeline_wait(u64 value) {
+	VkSemaphoreWaitInfo wait_info = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO };
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &timeline_semaphore;
+	wait_info.pValues     = &value;
+
+	VK_CHECK(vkWaitSemaphores(device, &wait_info, UINT64_MAX));
+}
+
+bool VulkanContext::is_bindless_supported() { return bindless_supported; }
+
+u32 VulkanContext::get_bindless_max_textures() { return bindless_max_textures; }
+
+bool VulkanContext::is_draw_indirect_count_supported() { return draw_indirect_count_supported; }
+
+bool VulkanContext::is_visibility_buffer_supported() { return visibility_buffer_supported; }
+
+bool VulkanContext::is_pipeline_cache_warm() { return pipeline_cache_warm; }
+
+bool VulkanContext::is_headless() { return headless; }
@@ -12,12 +12,13 @@
 
 namespace VulkanContext {
 	inline constexpr VkSurfaceFormatKHR FORMAT = { VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
-	inline constexpr VkPresentModeKHR   PRESENT_MODE = VK_PRESENT_MODE_MAILBOX_KHR;
 
-	void init(GLFWwindow * window);
+	void init(GLFWwindow * window); // Passing nullptr initializes in headless mode, without surface or swapchain support
 	void destroy();
 
-	[[nodiscard]] VkSwapchainKHR create_swapchain(u32 width, u32 height);
+	// If the requested Present Mode is not supported by the Surface it falls back to FIFO, which is always available
+	// The old Swapchain is retired, but still needs to be destroyed by the caller
+	[[nodiscard]] VkSwapchainKHR create_swapchain(u32 width, u32 height, VkPresentModeKHR & present_mode, VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
 
 	VkFormat get_supported_depth_format();
 
@@ -26,9 +27,10 @@ namespace VulkanContext {
 		VkPipelineShaderStageCreateInfo stage_create_info;
 	};
 
-	[[nodiscard]] Shader shader_load(std::string const & filename, VkShaderStageFlagBits stage);
+	[[nodiscard]] Shader shader_load(std::string const & filename, VkShaderStageFlagBits stage); // Shader Modules are cached by filename and owned by the Context
 
 	[[nodiscard]] VkRenderPass create_render_pass(std::vector<VkAttachmentDescription> const & attachments);
+	void                       destroy_render_pass(VkRenderPass render_pass); // Render Passes made by create_render_pass must be destroyed through the Context
 
 	struct PipelineLayoutDetails {
 		std::vector<VkDescriptorSetLayout> descriptor_set_layouts;
@@ -41,9 +43,6 @@ namespace VulkanContext {
 		std::vector<VkVertexInputBindingDescription>   vertex_bindings;
 		std::vector<VkVertexInputAttributeDescription> vertex_attributes;
 
-		int width;
-		int height;
-
 		VkCullModeFlagBits cull_mode = VK_CULL_MODE_BACK_BIT;
 
 		inline static VkPipelineColorBlendAttachmentState constexpr BLEND_NONE = {
@@ -78,10 +77,27 @@ namespace VulkanContext {
 
 		VkCompareOp depth_compare = VK_COMPARE_OP_LESS;
 
+		// Specialization Constants select a permutation of the Shaders, features that are disabled compile out
+		// The same constants are provided to all Shader stages, constants a stage does not declare are ignored
+		struct SpecializationConstant {
+			u32 id;
+			u32 value; // Both bool and int constants are 32 bit
+		};
+		std::vector<SpecializationConstant> specialization_constants;
+
 		VkPipelineLayout pipeline_layout;
 		VkRenderPass     render_pass;
 	};
-	[[nodiscard]] VkPipeline create_pipeline(PipelineDetails const & details);
+	// Viewport and Scissor are dynamic state, so Pipelines do not depend on the render resolution
+	// PipelineDetails with a single Compute Shader stage create a Compute Pipeline, only the layout and Specialization Constants are used
+	// Creation is deferred until compile_pipelines, which writes the resulting handle to the given pointer
+	// Requests with identical PipelineDetails share a single Pipeline, compatible Render Passes count as identical but Pipeline Layouts must be the same handle
+	void create_pipeline_deferred(PipelineDetails const & details, VkPipeline * pipeline);
+	void compile_pipelines(); // Creates all pending Pipelines in parallel using the persistent Pipeline Cache
+
+	void destroy_pipeline(VkPipeline pipeline); // Pipelines are reference counted, only the last reference destroys it
+
+	void set_viewport(VkCommandBuffer command_buffer, int width, int height); // Sets both Viewport and Scissor
 
 	[[nodiscard]] VkFramebuffer create_frame_buffer(int width, int height, VkRenderPass render_pass, std::vector<VkImageView> const & attachments);
 
@@ -96,12 +112,41 @@ namespace VulkanContext {
 	VkSurfaceKHR get_surface();
 
 	u32 get_queue_family_graphics();
+	u32 get_queue_family_compute();
 	u32 get_queue_family_present();
 
 	VkQueue get_queue_graphics();
+	VkQueue get_queue_compute();
 	VkQueue get_queue_present();
 
 	VkCommandPool get_command_pool();
+	VkCommandPool get_command_pool_compute();
+
+	bool has_async_compute(); // True if the compute Queue belongs to a separate Queue Family, otherwise it is the graphics Queue
 
 	size_t get_min_uniform_buffer_alignment();
+
+	float get_timestamp_period(); // Nanoseconds per timestamp tick
+	u32   get_timestamp_valid_bits(); // Number of meaningful bits in timestamps written on the graphics Queue, the remaining upper bits are undefined
+
+	VkPipelineCache get_pipeline_cache();
+
+	// Timeline Semaphore that every submission to the graphics Queue signals, its value only ever increases
+	// Reaching a value means that submission, and all graphics submissions before it, have completed
+	VkSemaphore get_timeline_semaphore();
+
+	u64  timeline_next_value();      // Reserves the value the next graphics submission must signal
+	u64  timeline_completed_value(); // Does not block
+	void timeline_wait(u64 value);   // Waiting for 0 returns immediately
+
+	bool is_pipeline_cache_warm(); // True if valid Pipeline Cache data was loaded from disk
+
+	bool is_bindless_supported(); // Partially bound, update after bind arrays of sampled images with dynamic indexing
+	u32  get_bindless_max_textures();
+
+	bool is_draw_indirect_count_supported(); // vkCmdDrawIndexedIndirectCount with multiple draws and a non-zero first instance
+
+	bool is_visibility_buffer_supported(); // Bindless plus gl_PrimitiveID in Fragment Shaders and non-uniform indexing of sampled image arrays
+
+	bool is_headless();
 };
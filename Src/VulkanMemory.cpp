@@ -3,6 +3,8 @@
 #include "VulkanCheck.h"
 #include "VulkanContext.h"
 
+#include "Profiler.h"
+
 u32 VulkanMemory::find_memory_type(u32 type_filter, VkMemoryPropertyFlags properties) {
 	VkPhysicalDeviceMemoryProperties memory_properties;
 	vkGetPhysicalDeviceMemoryProperties(VulkanContext::get_physical_device(), &memory_properties);
@@ -49,6 +51,8 @@ VulkanMemory::Buffer::~Buffer() {
 }
 
 void VulkanMemory::buffer_copy_staged(Buffer const & buffer_dst, void const * data_src, size_t size) {
+	PROFILE_SCOPE("Upload Staged");
+
 	// Create temporary staging buffer
 	auto staging_buffer = VulkanMemory::Buffer(
 		size,
@@ -71,6 +75,8 @@ void VulkanMemory::buffer_copy_staged(Buffer const & buffer_dst, void const * da
 }
 
 void VulkanMemory::buffer_copy_direct(Buffer const & buffer_dst, void const * data_src, size_t size) {
+	PROFILE_SCOPE("Upload Direct");
+
 	auto device = VulkanContext::get_device();
 
 	void * dst = buffer_map(buffer_dst, size);
@@ -106,14 +112,24 @@ VkCommandBuffer VulkanMemory::command_buffer_single_use_begin() {
 void VulkanMemory::command_buffer_single_use_end(VkCommandBuffer command_buffer) {
 	vkEndCommandBuffer(command_buffer);
 
+	// Only wait for this submission, instead of for the whole Queue to become idle
+	auto timeline_semaphore = VulkanContext::get_timeline_semaphore();
+	auto timeline_value     = VulkanContext::timeline_next_value();
+
+	VkTimelineSemaphoreSubmitInfo timeline_submit_info = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO };
+	timeline_submit_info.signalSemaphoreValueCount = 1;
+	timeline_submit_info.pSignalSemaphoreValues    = &timeline_value;
+
 	VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submit_info.pNext = &timeline_submit_info;
 	submit_info.commandBufferCount = 1;
 	submit_info.pCommandBuffers = &command_buffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores    = &timeline_semaphore;
 
-	VkQueue queue_graphics = VulkanContext::get_queue_graphics();
+	VK_CHECK(vkQueueSubmit(VulkanContext::get_queue_graphics(), 1, &submit_info, VK_NULL_HANDLE));
 
-	VK_CHECK(vkQueueSubmit(queue_graphics, 1, &submit_info, VK_NULL_HANDLE));
-	VK_CHECK(vkQueueWaitIdle(queue_graphics));
+	VulkanContext::timeline_wait(timeline_value);
 
 	vkFreeCommandBuffers(VulkanContext::get_device(), VulkanContext::get_command_pool(), 1, &command_buffer);
 }
@@ -150,7 +166,7 @@ void VulkanMemory::create_image(u32 width, u32 height, u32 mip_levels, VkFormat
 	VK_CHECK(vkBindImageMemory(device, image, image_memory, 0));
 }
 
-VkImageView VulkanMemory::create_image_view(VkImage image, u32 mip_levels, VkFormat format, VkImageAspectFlags aspect_mask) {
+VkImageView VulkanMemory::create_image_view(VkImage image, u32 mip_levels, VkFormat format, VkImageAspectFlags aspect_mask, u32 base_mip_level) {
 	VkImageViewCreateInfo image_view_create_info = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
 	image_view_create_info.image = image;
 	image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -162,7 +178,7 @@ VkImageView VulkanMemory::create_image_view(VkImage image, u32 mip_levels, VkFor
 	image_view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 
 	image_view_create_info.subresourceRange.aspectMask = aspect_mask;
-	image_view_create_info.subresourceRange.baseMipLevel = 0;
+	image_view_create_info.subresourceRange.baseMipLevel = base_mip_level;
 	image_view_create_info.subresourceRange.levelCount   = mip_levels;
 	image_view_create_info.subresourceRange.baseArrayLayer = 0;
 	image_view_create_info.subresourceRange.layerCount     = 1;
@@ -210,6 +226,12 @@ void VulkanMemory::transition_image_layout(VkImage image, u32 mip_levels, VkForm
 
 		stage_src = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 		stage_dst = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	} else if (layout_old == VK_IMAGE_LAYOUT_UNDEFINED && layout_new == VK_IMAGE_LAYOUT_GENERAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		stage_src = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		stage_dst = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	} else {
 		printf("ERROR: unsupported layout transition!");
 		abort();
@@ -8,6 +8,7 @@ namespace VulkanMemory {
 		VkBuffer       buffer;
 		VkDeviceMemory memory;
 
+		Buffer() : buffer(nullptr), memory(nullptr) { } // Empty, for Buffers that are only created in some configurations
 		Buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
 		~Buffer();
 
@@ -22,12 +23,16 @@ namespace VulkanMemory {
 
 		Buffer & operator=(Buffer const & other) noexcept = delete;
 
+		// Swaps, so that the previous contents are destroyed together with the other Buffer
 		Buffer & operator=(Buffer && other) noexcept {
+			auto buffer_old = buffer;
+			auto memory_old = memory;
+
 			buffer = other.buffer;
 			memory = other.memory;
 
-			other.buffer = nullptr;
-			other.memory = nullptr;
+			other.buffer = buffer_old;
+			other.memory = memory_old;
 
 			return *this;
 		}
@@ -45,7 +50,7 @@ namespace VulkanMemory {
 	void   buffer_unmap(Buffer const & buffer_dst);
 
 	void        create_image(u32 width, u32 height, u32 mip_levels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage & image, VkDeviceMemory & image_memory);
-	VkImageView create_image_view(VkImage image, u32 mip_levels, VkFormat format, VkImageAspectFlags aspect_mask);
+	VkImageView create_image_view(VkImage image, u32 mip_levels, VkFormat format, VkImageAspectFlags aspect_mask, u32 base_mip_level = 0);
 
 	void transition_image_layout(VkImage image, u32 mip_levels, VkFormat format, VkImageLayout layout_old, VkImageLayout layout_new);
 
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Performance regression gate
+
+Compares benchmark reports (as written by running the renderer with --headless --camera-path)
+against stored baselines for the same scene and resolution.
+
+For every metric (CPU/GPU frame time and each GPU pass) the median and p99 are compared.
+A bootstrap confidence interval is computed for the relative change of each statistic,
+a metric only counts as regressed if the entire interval lies above the threshold.
+
+Usage:
+	perf_gate.py run.json [run.json ...]            Compare against baselines, exits with 1 on regression
+	perf_gate.py --update run.json [run.json ...]   Store the given runs as new baselines
+"""
+import argparse
+import json
+import math
+import os
+import random
+import sys
+
+DEFAULT_BASELINE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'Data', 'Benchmarks', 'Baselines')
+
+STATISTICS = [ ('p50', 0.50), ('p99', 0.99) ]
+
+# Nearest rank percentile, matches Benchmark::calc_statistics
+def percentile(sorted_samples, p):
+	rank = int(math.ceil(p * len(sorted_samples)))
+	return sorted_samples[min(max(rank - 1, 0), len(sorted_samples) - 1)]
+
+def baseline_filename(report, baseline_dir):
+	return os.path.join(baseline_dir, '{}_{}x{}.json'.format(report['scene'], report['width'], report['height']))
+
+def get_metrics(report):
+	metrics = { }
+	for name, data in report['frame'].items():
+		metrics['frame.' + name] = data['samples']
+	for name, data in report['passes'].items():
+		metrics['pass.' + name] = data['samples']
+	return metrics
+
+# Bootstrap confidence interval of the relative change (current / baseline - 1) of each statistic
+def bootstrap(samples_base, samples_curr, iterations, confidence, rng):
+	resampled = { name: [] for name, _ in STATISTICS }
+
+	for _ in range(iterations):
+		base = sorted(rng.choices(samples_base, k=len(samples_base)))
+		curr = sorted(rng.choices(samples_curr, k=len(samples_curr)))
+
+		for name, p in STATISTICS:
+			stat_base = percentile(base, p)
+			stat_curr = percentile(curr, p)
+			resampled[name].append(stat_curr / stat_base - 1.0 if stat_base > 0.0 else 0.0)
+
+	alpha = 0.5 * (1.0 - confidence)
+
+	intervals = { }
+	for name, _ in STATISTICS:
+		changes = sorted(resampled[name])
+		intervals[name] = (percentile(changes, alpha), percentile(changes, 1.0 - alpha))
+
+	return intervals
+
+def compare(report, baseline, args, rng):
+	metrics_base = get_metrics(baseline)
+	metrics_curr = get_metrics(report)
+
+	rows        = [ ]
+	regressions = [ ]
+
+	for metric, samples_curr in metrics_curr.items():
+		samples_base = metrics_base.get(metric)
+
+		if not samples_base or not samples_curr:
+			rows.append((metric, '', '', '', '', '', 'NEW' if not samples_base else 'EMPTY'))
+			continue
+
+		intervals = bootstrap(samples_base, samples_curr, args.iterations, args.confidence, rng)
+
+		sorted_base = sorted(samples_base)
+		sorted_curr = sorted(samples_curr)
+
+		for name, p in STATISTICS:
+			stat_base = percentile(sorted_base, p)
+			stat_curr = percentile(sorted_curr, p)
+
+			change = stat_curr / stat_base - 1.0 if stat_base > 0.0 else 0.0
+			lo, hi = intervals[name]
+
+			# Small absolute differences are ignored, these are dominated by timer resolution
+			significant = abs(stat_curr - stat_base) >= args.min_delta
+
+			if lo > args.threshold and significant:
+				result = 'REGRESSION'
+				regressions.append((metric, name))
+			elif hi < -args.threshold and significant:
+				result = 'improved'
+			else:
+				result = 'ok'
+
+			rows.append((metric, name, '{:.3f}'.format(stat_base), '{:.3f}'.format(stat_curr), '{:+.1f}%'.format(100.0 * change), '[{:+.1f}%, {:+.1f}%]'.format(100.0 * lo, 100.0 * hi), result))
+
+	for metric in metrics_base:
+		if metric not in metrics_curr:
+			rows.append((metric, '', '', '', '', '', 'MISSING'))
+
+	return rows, regressions
+
+def print_table(rows, confidence):
+	header = ('metric', 'stat', 'base ms', 'curr ms', 'change', '{:.0f}% CI'.format(100.0 * confidence), 'result')
+	widths = [ max(len(row[i]) for row in rows + [header]) for i in range(len(header)) ]
+
+	def format_row(row):
+		return '  '.join(cell.ljust(width) if i < 2 else cell.rjust(width) for i, (cell, width) in enumerate(zip(row, widths)))
+
+	print(format_row(header))
+	print('-' * len(format_row(header)))
+	for row in rows:
+		print(format_row(row))
+
+def main():
+	parser = argparse.ArgumentParser(description='Compare benchmark reports against stored baselines')
+	parser.add_argument('reports', nargs='+', help='Benchmark report JSON files')
+	parser.add_argument('--baseline-dir', default=DEFAULT_BASELINE_DIR, help='Directory containing the baselines')
+	parser.add_argument('--update',       action='store_true', help='Store the given reports as new baselines instead of comparing')
+	parser.add_argument('--threshold',    type=float, default=0.05, help='Relative slowdown that counts as regression (default: 0.05)')
+	parser.add_argument('--min-delta',    type=float, default=0.05, help='Absolute difference in ms below which changes are ignored (default: 0.05)')
+	parser.add_argument('--confidence',   type=float, default=0.95, help='Confidence level of the bootstrap intervals (default: 0.95)')
+	parser.add_argument('--iterations',   type=int,   default=1000, help='Number of bootstrap resamples (default: 1000)')
+	parser.add_argument('--seed',         type=int,   default=1337, help='Seed for the bootstrap resampling')
+	args = parser.parse_args()
+
+	rng = random.Random(args.seed)
+
+	failed = False
+
+	for report_filename in args.reports:
+		with open(report_filename) as file:
+			report = json.load(file)
+
+		baseline_path = baseline_filename(report, args.baseline_dir)
+
+		if args.update:
+			os.makedirs(args.baseline_dir, exist_ok=True)
+			with open(baseline_path, 'w') as file:
+				json.dump(report, file, indent='\t')
+			print('Updated baseline {}'.format(os.path.normpath(baseline_path)))
+			continue
+
+		print('\n{} - scene "{}" at {}x{}'.format(report_filename, report['scene'], report['width'], report['height']))
+
+		if not os.path.exists(baseline_path):
+			print('No baseline found at {}, run with --update to create one'.format(os.path.normpath(baseline_path)))
+			failed = True
+			continue
+
+		with open(baseline_path) as file:
+			baseline = json.load(file)
+
+		for key in ('timestep', 'seed', 'warmup_frames'):
+			if baseline.get(key) != report.get(key):
+				print('WARNING: {} differs from baseline ({} vs {}), results may not be comparable'.format(key, report.get(key), baseline.get(key)))
+
+		rows, regressions = compare(report, baseline, args, rng)
+		print_table(rows, args.confidence)
+
+		if regressions:
+			failed = True
+			print('\nFAILED: {} regressed by more than {:.1f}%:'.format(len(regressions), 100.0 * args.threshold))
+			for metric, stat in regressions:
+				print('\t{} {}'.format(metric, stat))
+		else:
+			print('\nPASSED')
+
+	return 1 if failed else 0
+
+if __name__ == '__main__':
+	sys.exit(main())